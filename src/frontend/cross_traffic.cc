@@ -0,0 +1,156 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fstream>
+
+#include "cross_traffic.hh"
+#include "dropping_packet_queue.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+static const unsigned int DEFAULT_PACKET_SIZE = 1500;
+
+static unsigned int get_packet_size( const string & args )
+{
+    const unsigned int packet_size = DroppingPacketQueue::get_arg( args, "bytes" );
+    return packet_size ? packet_size : DEFAULT_PACKET_SIZE;
+}
+
+static unsigned int get_rate( const string & args )
+{
+    const unsigned int rate_kbps = DroppingPacketQueue::get_arg( args, "kbps" );
+    if ( rate_kbps == 0 ) {
+        throw runtime_error( "cross traffic must have a nonzero rate (kbps): " + args );
+    }
+    return rate_kbps;
+}
+
+CrossTraffic::CrossTraffic( const string & args )
+    : next_arrival_( timestamp() ),
+      packet_size_( get_packet_size( args ) ),
+      prng_( random_device()() )
+{}
+
+double CrossTraffic::constant_gap( const unsigned int rate_kbps ) const
+{
+    return packet_size_ * 8.0 / rate_kbps; /* bits / (kbit/s) = ms */
+}
+
+ConstantCrossTraffic::ConstantCrossTraffic( const string & args )
+    : CrossTraffic( args ),
+      rate_kbps_( get_rate( args ) )
+{}
+
+string ConstantCrossTraffic::to_string( void ) const
+{
+    return "cbr [kbps=" + ::to_string( rate_kbps_ ) + ", bytes=" + ::to_string( packet_size_ ) + "]";
+}
+
+PoissonCrossTraffic::PoissonCrossTraffic( const string & args )
+    : CrossTraffic( args ),
+      rate_kbps_( get_rate( args ) ),
+      gap_( 1.0 / constant_gap( rate_kbps_ ) )
+{
+    delay_first_arrival( next_gap() );
+}
+
+string PoissonCrossTraffic::to_string( void ) const
+{
+    return "poisson [kbps=" + ::to_string( rate_kbps_ ) + ", bytes=" + ::to_string( packet_size_ ) + "]";
+}
+
+OnOffCrossTraffic::OnOffCrossTraffic( const string & args )
+    : CrossTraffic( args ),
+      rate_kbps_( get_rate( args ) ),
+      mean_on_ms_( DroppingPacketQueue::get_arg( args, "on" ) ),
+      mean_off_ms_( DroppingPacketQueue::get_arg( args, "off" ) ),
+      on_time_( 1.0 / mean_on_ms_ ),
+      off_time_( 1.0 / mean_off_ms_ ),
+      on_time_left_( 0 )
+{
+    if ( mean_on_ms_ == 0 or mean_off_ms_ == 0 ) {
+        throw runtime_error( "on/off cross traffic must have nonzero mean on and off times (ms): " + args );
+    }
+
+    on_time_left_ = on_time_( prng_ );
+}
+
+double OnOffCrossTraffic::next_gap( void )
+{
+    const double gap = constant_gap( rate_kbps_ );
+
+    if ( gap <= on_time_left_ ) {
+        on_time_left_ -= gap;
+        return gap;
+    }
+
+    /* sit out an off period; the next packet starts the next on period */
+    const double until_next_on = on_time_left_ + off_time_( prng_ );
+    on_time_left_ = on_time_( prng_ );
+    return until_next_on;
+}
+
+string OnOffCrossTraffic::to_string( void ) const
+{
+    return "onoff [kbps=" + ::to_string( rate_kbps_ ) + ", bytes=" + ::to_string( packet_size_ )
+        + ", on=" + ::to_string( mean_on_ms_ ) + ", off=" + ::to_string( mean_off_ms_ ) + "]";
+}
+
+TraceCrossTraffic::TraceCrossTraffic( const string & args )
+    : CrossTraffic( "" ),
+      filename_( args ),
+      arrivals_(),
+      next_index_( 0 )
+{
+    ifstream trace_file( filename_ );
+
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename_ + ": error opening for reading" );
+    }
+
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename_ + ": invalid empty line" );
+        }
+
+        const uint64_t ms = myatoi( line );
+
+        if ( not arrivals_.empty() and ms < arrivals_.back() ) {
+            throw runtime_error( filename_ + ": timestamps must be monotonically nondecreasing" );
+        }
+
+        arrivals_.emplace_back( ms );
+    }
+
+    if ( arrivals_.empty() ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    if ( arrivals_.back() == 0 ) {
+        throw runtime_error( filename_ + ": trace must last for a nonzero amount of time" );
+    }
+
+    delay_first_arrival( arrivals_.front() );
+}
+
+double TraceCrossTraffic::next_gap( void )
+{
+    const uint64_t this_arrival = arrivals_.at( next_index_ );
+    next_index_ = ( next_index_ + 1 ) % arrivals_.size();
+
+    /* wraparound */
+    if ( next_index_ == 0 ) {
+        return arrivals_.back() - this_arrival + arrivals_.front();
+    }
+
+    return arrivals_.at( next_index_ ) - this_arrival;
+}
+
+string TraceCrossTraffic::to_string( void ) const
+{
+    return "trace [" + filename_ + "]";
+}
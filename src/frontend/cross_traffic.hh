@@ -0,0 +1,107 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef CROSS_TRAFFIC_HH
+#define CROSS_TRAFFIC_HH
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+/* arrivals of synthetic packets that compete with the real ones for a
+   link's queue and delivery opportunities (but are never delivered) */
+class CrossTraffic
+{
+private:
+    double next_arrival_; /* ms timestamp */
+
+    /* ms from one arrival to the next */
+    virtual double next_gap( void ) = 0;
+
+protected:
+    const unsigned int packet_size_;
+    std::default_random_engine prng_;
+
+    /* interarrival time for rate_kbps of packet_size_-byte packets */
+    double constant_gap( const unsigned int rate_kbps ) const;
+
+    /* the first packet arrives when the link starts, unless delayed */
+    void delay_first_arrival( const double ms ) { next_arrival_ += ms; }
+
+public:
+    CrossTraffic( const std::string & args );
+    virtual ~CrossTraffic() {}
+
+    uint64_t next_arrival_time( void ) const { return next_arrival_; }
+    unsigned int packet_size( void ) const { return packet_size_; }
+
+    /* move on to the arrival after next_arrival_time() */
+    void advance( void ) { next_arrival_ += next_gap(); }
+
+    virtual std::string to_string( void ) const = 0;
+};
+
+/* evenly spaced packets */
+class ConstantCrossTraffic : public CrossTraffic
+{
+private:
+    const unsigned int rate_kbps_;
+
+    double next_gap( void ) override { return constant_gap( rate_kbps_ ); }
+
+public:
+    ConstantCrossTraffic( const std::string & args );
+
+    std::string to_string( void ) const override;
+};
+
+/* exponentially distributed interarrival times */
+class PoissonCrossTraffic : public CrossTraffic
+{
+private:
+    const unsigned int rate_kbps_;
+    std::exponential_distribution<> gap_;
+
+    double next_gap( void ) override { return gap_( prng_ ); }
+
+public:
+    PoissonCrossTraffic( const std::string & args );
+
+    std::string to_string( void ) const override;
+};
+
+/* constant rate while on; on and off periods are exponentially distributed */
+class OnOffCrossTraffic : public CrossTraffic
+{
+private:
+    const unsigned int rate_kbps_, mean_on_ms_, mean_off_ms_;
+    std::exponential_distribution<> on_time_, off_time_;
+
+    double on_time_left_;
+
+    double next_gap( void ) override;
+
+public:
+    OnOffCrossTraffic( const std::string & args );
+
+    std::string to_string( void ) const override;
+};
+
+/* arrivals replayed from a trace file (in mm-link's format: one line per
+   packet, giving its ms timestamp), repeated when it runs out */
+class TraceCrossTraffic : public CrossTraffic
+{
+private:
+    const std::string filename_;
+    std::vector<uint64_t> arrivals_;
+    size_t next_index_;
+
+    double next_gap( void ) override;
+
+public:
+    TraceCrossTraffic( const std::string & args );
+
+    std::string to_string( void ) const override;
+};
+
+#endif /* CROSS_TRAFFIC_HH */
@@ -1,39 +1,66 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
-#include <arpa/inet.h>
 #include <fcntl.h>
 #include <fstream>
 #include <limits>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <string.h>
 #include <unistd.h>
 
 #include "delay_queue.hh"
+#include "packet_info.hh"
 #include "timestamp.hh"
 
 using namespace std;
 
+DelayQueue::DelayQueue(const uint64_t &s_delay_ms, const string &delay_schedule,
+                       const string &loss_schedule,
+                       const string &onoff_schedule)
+    : delay_ms_(s_delay_ms), packet_queue_() {
+  /* each value is in effect from its time until the next one's */
+  if (not delay_schedule.empty()) {
+    delay_schedule_.reset(new Schedule(delay_schedule, 0, 1 << 30)); /* ms */
+  }
+  if (not loss_schedule.empty()) {
+    loss_schedule_.reset(new Schedule(loss_schedule, 0, 1)); /* rate */
+  }
+  if (not onoff_schedule.empty()) {
+    onoff_schedule_.reset(new Schedule(onoff_schedule, 0, 1)); /* 0 = off */
+  }
+
+  load_delay_ip_mapping();
+}
+
 void DelayQueue::read_packet(const string &contents) {
-  string no_tun_contents = contents.substr(4);
-
-  struct iphdr *iph = (struct iphdr *)no_tun_contents.c_str();
-  struct sockaddr_in dest;
-  memset(&dest, 0, sizeof(dest));
-  dest.sin_addr.s_addr = iph->daddr;
-  std::map<string, float>::iterator it =
-      delay_map.find(inet_ntoa(dest.sin_addr));
+  const uint64_t now = timestamp();
+
+  /* link down, or packet lost, on the recorded path */
+  if (onoff_schedule_ and onoff_schedule_->value_at(now) == 0) {
+    return;
+  }
+  if (loss_schedule_ and
+      bernoulli_distribution(loss_schedule_->value_at(now))(prng_)) {
+    return;
+  }
+
+  /* (a packet whose delay drops below its predecessor's still waits for
+   * it: the queue stays in order) */
+  const uint64_t delay_ms =
+      delay_schedule_ ? delay_schedule_->value_at(now) : delay_ms_;
+
+  /* per-server delays, by destination address */
   int RTT_delay = 0;
-  if (it != delay_map.end()) {
-    // mapping file times are in milliseconds
-    // we add all delay on uplink because dest ip
-    // on downlink is client ip (note that this shouldn't matter)
-    RTT_delay = (it->second);
-    // cout << "Imposing delay: " << it->first << " of: " <<
-    // to_string(RTT_delay)
-    // << "ms" << endl;
-  }
-  packet_queue_.emplace(timestamp() + delay_ms_ + RTT_delay, contents);
+  if (not delay_map.empty()) {
+    const PacketInfo info(contents);
+    if (info.ip_version == 4) {
+      const auto it = delay_map.find(info.destination_ip());
+      if (it != delay_map.end()) {
+        // mapping file times are in milliseconds
+        // we add all delay on uplink because dest ip
+        // on downlink is client ip (note that this shouldn't matter)
+        RTT_delay = (it->second);
+      }
+    }
+  }
+  packet_queue_.emplace(now + delay_ms + RTT_delay, contents);
 }
 
 void DelayQueue::write_packets(FileDescriptor &fd) {
@@ -11,9 +11,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <iostream>
+#include <memory>
+#include <random>
 
 #include "config.h"
 #include "file_descriptor.hh"
+#include "schedule.hh"
 
 class DelayQueue
 {
@@ -23,8 +26,13 @@ private:
     /* release timestamp, contents */
     std::map<std::string, float>delay_map = {};
 
-public:
-    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_() {
+    /* a recorded path: delay, loss rate and outages that change over time */
+    std::unique_ptr<Schedule> delay_schedule_ {};
+    std::unique_ptr<Schedule> loss_schedule_ {};
+    std::unique_ptr<Schedule> onoff_schedule_ {};
+    std::default_random_engine prng_ { std::random_device()() };
+
+    void load_delay_ip_mapping( void ) {
         std::string path_prefix = PATH_PREFIX;
         std::string comp_file = path_prefix + "/bin/delay_ip_mapping.txt";
         std::ifstream dfile(comp_file);
@@ -46,6 +54,16 @@ public:
         }
     }
 
+public:
+    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_() {
+        load_delay_ip_mapping();
+    }
+
+    /* any schedule may be empty (to leave out): then the delay is the
+       fixed s_delay_ms, and no packets are lost */
+    DelayQueue( const uint64_t & s_delay_ms, const std::string & delay_schedule,
+                const std::string & loss_schedule, const std::string & onoff_schedule );
+
     DelayQueue( const uint64_t & s_delay_ms, const std::string & ip_mapping_filename ) 
       : delay_ms_( s_delay_ms ), packet_queue_() {
 
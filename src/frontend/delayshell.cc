@@ -20,27 +20,54 @@ int main( int argc, char *argv[] )
         check_requirements( argc, argv );
 
         if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " delay-milliseconds [command...]" );
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " delay-milliseconds|--schedule=FILE"
+                                 + " [--loss-schedule=FILE] [--onoff-schedule=FILE] [command...]" );
         }
 
-        const uint64_t delay_ms = myatoi( argv[ 1 ] );
+        /* a recorded path in one stage: the delay, loss rate and outages
+           over time (in both directions), each from a file of "MS VALUE"
+           lines with a line per change */
+        auto option_value = [] ( const string & arg, const string & option ) {
+            return arg.compare( 0, option.size(), option ) == 0 ? arg.substr( option.size() ) : string();
+        };
+
+        const string delay_schedule = option_value( argv[ 1 ], "--schedule=" );
+        const uint64_t delay_ms = delay_schedule.empty() ? myatoi( argv[ 1 ] ) : 0;
+
+        string loss_schedule, onoff_schedule;
+
+        int first_command_arg = 2;
+        for ( ; first_command_arg < argc; first_command_arg++ ) {
+            const string arg = argv[ first_command_arg ];
+            if ( not option_value( arg, "--loss-schedule=" ).empty() ) {
+                loss_schedule = option_value( arg, "--loss-schedule=" );
+            } else if ( not option_value( arg, "--onoff-schedule=" ).empty() ) {
+                onoff_schedule = option_value( arg, "--onoff-schedule=" );
+            } else {
+                break;
+            }
+        }
 
         vector< string > command;
 
-        if ( argc == 2 ) {
+        if ( first_command_arg == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = first_command_arg; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
         PacketShell<DelayQueue> delay_shell_app( "delay", user_environment );
 
-        delay_shell_app.start_uplink( "[delay " + to_string( delay_ms ) + " ms] ",
+        const string shell_prefix = delay_schedule.empty()
+            ? "[delay " + to_string( delay_ms ) + " ms] "
+            : "[delay " + delay_schedule + "] ";
+
+        delay_shell_app.start_uplink( shell_prefix,
                                       command,
-                                      delay_ms );
-        delay_shell_app.start_downlink( delay_ms );
+                                      delay_ms, delay_schedule, loss_schedule, onoff_schedule );
+        delay_shell_app.start_downlink( delay_ms, delay_schedule, loss_schedule, onoff_schedule );
         return delay_shell_app.wait_for_exit();
     } catch ( const exception & e ) {
         print_exception( e );
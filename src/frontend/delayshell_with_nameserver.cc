@@ -7,7 +7,7 @@
 #include "util.hh"
 #include "ezio.hh"
 #include "packetshell.cc"
-#include "vpn.hh"
+#include "udp_tunnel.hh"
 
 using namespace std;
 
@@ -31,13 +31,17 @@ int main( int argc, char *argv[] )
 
         Address nameserver_address(nameserver_ip, 53);
 
-        vector< string > command; // This should be OpenVPN but will be handled in packetshell
+        /* (without a command, the phone's tunnel runs until we're interrupted) */
+        vector< string > command;
+        for ( int i = 4; i < argc; i++ ) {
+            command.push_back( argv[ i ] );
+        }
 
-        PacketShell<DelayQueue> delay_shell_app( "delay", user_environment, 1194 );
+        PacketShell<DelayQueue> delay_shell_app( "delay", user_environment, UDPTunnel::DEFAULT_PORT );
 
         delay_shell_app.start_uplink_and_forward_packets_with_nameserver
           ( "[delay " + to_string( delay_ms ) + " ms] ",
-            1194 /* openvpn port */, nameserver_address,
+            UDPTunnel::DEFAULT_PORT, nameserver_address,
             command, delay_ms, webserver_to_reverse_proxy_ip_mapping_filename );
         delay_shell_app.start_downlink( delay_ms );
         return delay_shell_app.wait_for_exit();
@@ -0,0 +1,190 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <limits>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+
+#include "kernel_link.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+#include "ezio.hh"
+#include "util.hh"
+
+using namespace std;
+
+namespace {
+    /* what each delivery opportunity carries, as in LinkQueue */
+    const uint64_t OPPORTUNITY_BYTES = 1504;
+
+    /* let the bucket hold a millisecond's worth of bytes, but at least
+       two full-size packets so that the link never stalls */
+    const uint32_t MIN_BURST = 2 * OPPORTUNITY_BYTES;
+
+    uint32_t burst_for( const uint64_t rate )
+    {
+        return max( uint64_t( MIN_BURST ), min( rate / 1000, uint64_t( numeric_limits<uint32_t>::max() ) ) );
+    }
+}
+
+KernelLink::KernelLink( const string & filename, const unsigned int interval_ms, const uint32_t limit )
+    : schedule_(),
+      interval_ms_( interval_ms ),
+      limit_( limit )
+{
+    if ( interval_ms_ == 0 ) {
+        throw runtime_error( "KernelLink: update interval must be nonzero" );
+    }
+
+    if ( limit_ == 0 ) {
+        throw runtime_error( "KernelLink: queue limit must be nonzero" );
+    }
+
+    /* read the user's file as the user */
+    TemporarilyUnprivileged tu;
+
+    ifstream trace_file( filename );
+
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename + ": invalid empty line" );
+        }
+
+        const uint64_t ms = myatoi( line );
+
+        if ( not schedule_.empty() ) {
+            if ( ms < schedule_.back() ) {
+                throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
+            }
+        }
+
+        schedule_.emplace_back( ms );
+    }
+
+    if ( schedule_.empty() ) {
+        throw runtime_error( filename + ": no valid timestamps found" );
+    }
+
+    if ( schedule_.back() == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+}
+
+uint64_t KernelLink::rate_at( const uint64_t ms ) const
+{
+    /* opportunities before time t, with the trace repeating forever */
+    auto opportunities_before = [&] ( const uint64_t t ) {
+        return ( t / period() ) * schedule_.size()
+            + ( lower_bound( schedule_.begin(), schedule_.end(), t % period() ) - schedule_.begin() );
+    };
+
+    const uint64_t opportunities = opportunities_before( ms + interval_ms_ ) - opportunities_before( ms );
+
+    return opportunities * OPPORTUNITY_BYTES * 1000 / interval_ms_;
+}
+
+bool KernelLink::trackable( void ) const
+{
+    /* the gap from the end of the trace to its start when it repeats */
+    uint64_t longest_gap = schedule_.front() + period() - schedule_.back();
+
+    for ( unsigned int i = 1; i < schedule_.size(); i++ ) {
+        longest_gap = max( longest_gap, schedule_.at( i ) - schedule_.at( i - 1 ) );
+    }
+
+    /* so every interval has some opportunities */
+    return longest_gap < interval_ms_;
+}
+
+void KernelLink::install( const string & device )
+{
+    if ( rtnl_ ) {
+        throw runtime_error( "KernelLink: already installed on " + device_ );
+    }
+
+    device_ = device;
+    rtnl_.reset( new NetlinkSocket( NETLINK_ROUTE ) );
+
+    set_rate( rate_at( 0 ), true );
+    start_ = timestamp();
+}
+
+void KernelLink::set_rate( const uint64_t rate, const bool create )
+{
+    const unsigned int index = if_nametoindex( device_.c_str() );
+    if ( index == 0 ) {
+        throw unix_error( "if_nametoindex " + device_ );
+    }
+
+    /* create (or replace) the root qdisc, or change its parameters */
+    NetlinkMessage request( RTM_NEWQDISC, NLM_F_REQUEST | NLM_F_ACK
+                            | ( create ? NLM_F_CREATE | NLM_F_REPLACE : 0 ) );
+
+    tcmsg tcm;
+    zero( tcm );
+    tcm.tcm_family = AF_UNSPEC;
+    tcm.tcm_ifindex = index;
+    tcm.tcm_handle = TC_H_MAKE( 1 << 16, 0 );
+    tcm.tcm_parent = TC_H_ROOT;
+    request.add_header( tcm );
+
+    request.add_string( TCA_KIND, "tbf" );
+
+    /* rates that don't fit the 32-bit field go in an attribute of their own */
+    tc_tbf_qopt qopt;
+    zero( qopt );
+    qopt.rate.rate = min( rate, uint64_t( numeric_limits<uint32_t>::max() ) );
+    qopt.rate.linklayer = TC_LINKLAYER_ETHERNET; /* so no rate table is needed */
+    qopt.limit = limit_;
+
+    request.begin_nested( TCA_OPTIONS );
+    request.add_attribute( TCA_TBF_PARMS, string( reinterpret_cast<const char *>( &qopt ), sizeof( qopt ) ) );
+    if ( rate > numeric_limits<uint32_t>::max() ) {
+        request.add_attribute( TCA_TBF_RATE64, string( reinterpret_cast<const char *>( &rate ), sizeof( rate ) ) );
+    }
+    request.add_attribute( TCA_TBF_BURST, burst_for( rate ) );
+    request.end_nested();
+
+    vector<NetlinkMessage> requests;
+    requests.push_back( move( request ) );
+    rtnl_->transact( requests );
+
+    rate_ = rate;
+}
+
+int KernelLink::follow_trace( void )
+{
+    if ( not rtnl_ ) {
+        throw runtime_error( "KernelLink: not installed" );
+    }
+
+    for ( uint64_t ms = interval_ms_; ; ms += interval_ms_ ) {
+        const uint64_t now = timestamp();
+        if ( start_ + ms > now ) {
+            this_thread::sleep_for( chrono::milliseconds( start_ + ms - now ) );
+        } else if ( start_ + ms + interval_ms_ <= now ) {
+            continue; /* fell behind: skip to the current interval */
+        }
+
+        const uint64_t rate = rate_at( ms );
+        if ( rate != rate_ ) {
+            set_rate( rate, false );
+        }
+    }
+}
+
+string KernelLink::to_string( void ) const
+{
+    return "tbf [interval=" + ::to_string( interval_ms_ ) + "ms, limit=" + ::to_string( limit_ ) + "]";
+}
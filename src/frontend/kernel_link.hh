@@ -0,0 +1,57 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef KERNEL_LINK_HH
+#define KERNEL_LINK_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "netlink.hh"
+
+/* one direction of a link emulated entirely in the kernel: a token-bucket
+   qdisc on a network device, whose rate is set once per update interval
+   to the average rate of the mm-link trace over that interval. This
+   only works for traces whose delivery opportunities never stop for as
+   long as an interval (otherwise the bursts and outages of the trace
+   would be smoothed over); see trackable(). */
+class KernelLink
+{
+private:
+    std::vector<uint64_t> schedule_; /* delivery opportunities, in ms */
+    unsigned int interval_ms_;
+    uint32_t limit_; /* bytes */
+
+    std::string device_ {};
+    std::unique_ptr<NetlinkSocket> rtnl_ {}; /* in the device's network namespace */
+    uint64_t rate_ { 0 }; /* bytes per second */
+    uint64_t start_ { 0 }; /* when the trace began, in ms */
+
+    uint64_t period( void ) const { return schedule_.back(); }
+
+    /* average rate, in bytes per second, over the interval that starts at ms */
+    uint64_t rate_at( const uint64_t ms ) const;
+
+    void set_rate( const uint64_t rate, const bool create );
+
+public:
+    KernelLink( const std::string & filename, const unsigned int interval_ms, const uint32_t limit );
+
+    /* can the qdisc follow the trace by changing its rate once per interval? */
+    bool trackable( void ) const;
+
+    /* put the qdisc on the device, in the current network namespace */
+    void install( const std::string & device );
+
+    /* keep the qdisc's rate in step with the trace (doesn't return) */
+    int follow_trace( void );
+
+    std::string to_string( void ) const;
+
+    /* forbid copying */
+    KernelLink( const KernelLink & other ) = delete;
+    KernelLink & operator=( const KernelLink & other ) = delete;
+};
+
+#endif /* KERNEL_LINK_HH */
@@ -14,7 +14,8 @@ using namespace std;
 LinkQueue::LinkQueue( const string & link_name, const string & filename, const string & logfile,
                       const bool repeat, const bool graph_throughput, const bool graph_delay,
                       unique_ptr<AbstractPacketQueue> && packet_queue,
-                      const string & command_line )
+                      const string & command_line,
+                      unique_ptr<CrossTraffic> && cross_traffic )
     : next_delivery_( 0 ),
       schedule_(),
       base_timestamp_( timestamp() ),
@@ -22,6 +23,7 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
       packet_in_transit_( "", 0 ),
       packet_in_transit_bytes_left_( 0 ),
       output_queue_(),
+      cross_traffic_( move( cross_traffic ) ),
       log_(),
       throughput_graph_( nullptr ),
       delay_graph_( nullptr ),
@@ -63,6 +65,11 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
         throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
     }
 
+    if ( cross_traffic_ and ( cross_traffic_->packet_size() == 0
+                              or cross_traffic_->packet_size() > PACKET_SIZE ) ) {
+        throw runtime_error( "cross traffic packet size must be between 1 and " + to_string( PACKET_SIZE ) );
+    }
+
     /* open logfile if called for */
     if ( not logfile.empty() ) {
         log_.reset( new ofstream( logfile ) );
@@ -73,6 +80,9 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
         *log_ << "# mahimahi mm-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
         *log_ << "# command line: " << command_line << endl;
         *log_ << "# queue: " << packet_queue_->to_string() << endl;
+        if ( cross_traffic_ ) {
+            *log_ << "# cross traffic (not logged): " << cross_traffic_->to_string() << endl;
+        }
         *log_ << "# init timestamp: " << initial_timestamp() << endl;
         *log_ << "# base timestamp: " << base_timestamp_ << endl;
         const char * prefix = getenv( "MAHIMAHI_SHELL_PREFIX" );
@@ -215,6 +225,8 @@ void LinkQueue::rationalize( const uint64_t now )
     while ( next_delivery_time() <= now ) {
         const uint64_t this_delivery_time = next_delivery_time();
 
+        inject_cross_traffic( this_delivery_time );
+
         /* burn a delivery opportunity */
         unsigned int bytes_left_in_this_delivery = PACKET_SIZE;
         use_a_delivery_opportunity();
@@ -242,7 +254,7 @@ void LinkQueue::rationalize( const uint64_t now )
             bytes_left_in_this_delivery -= amount_to_send;
 
             /* has the packet been fully sent? */
-            if ( packet_in_transit_bytes_left_ == 0 ) {
+            if ( packet_in_transit_bytes_left_ == 0 and not packet_in_transit_.synthetic ) {
                 record_departure( this_delivery_time, packet_in_transit_ );
 
                 /* this packet is ready to go */
@@ -250,6 +262,22 @@ void LinkQueue::rationalize( const uint64_t now )
             }
         }
     }
+
+    inject_cross_traffic( now );
+}
+
+/* enqueue the cross traffic that has arrived by the given time */
+void LinkQueue::inject_cross_traffic( const uint64_t until )
+{
+    if ( not cross_traffic_ or finished_ ) {
+        return;
+    }
+
+    while ( cross_traffic_->next_arrival_time() <= until ) {
+        packet_queue_->enqueue( QueuedPacket( string( cross_traffic_->packet_size(), 0 ),
+                                              cross_traffic_->next_arrival_time(), true ) );
+        cross_traffic_->advance();
+    }
 }
 
 void LinkQueue::write_packets( FileDescriptor & fd )
@@ -12,6 +12,7 @@
 #include "file_descriptor.hh"
 #include "binned_livegraph.hh"
 #include "abstract_packet_queue.hh"
+#include "cross_traffic.hh"
 
 class LinkQueue
 {
@@ -27,6 +28,8 @@ private:
     unsigned int packet_in_transit_bytes_left_;
     std::queue<std::string> output_queue_;
 
+    std::unique_ptr<CrossTraffic> cross_traffic_;
+
     std::unique_ptr<std::ofstream> log_;
     std::unique_ptr<BinnedLiveGraph> throughput_graph_;
     std::unique_ptr<BinnedLiveGraph> delay_graph_;
@@ -43,6 +46,7 @@ private:
     void record_departure_opportunity( void );
     void record_departure( const uint64_t departure_time, const QueuedPacket & packet );
 
+    void inject_cross_traffic( const uint64_t until );
     void rationalize( const uint64_t now );
     void dequeue_packet( void );
 
@@ -50,7 +54,8 @@ public:
     LinkQueue( const std::string & link_name, const std::string & filename, const std::string & logfile,
                const bool repeat, const bool graph_throughput, const bool graph_delay,
                std::unique_ptr<AbstractPacketQueue> && packet_queue,
-               const std::string & command_line );
+               const std::string & command_line,
+               std::unique_ptr<CrossTraffic> && cross_traffic = nullptr );
 
     void read_packet( const std::string & contents );
 
@@ -8,10 +8,23 @@
 #include "codel_packet_queue.hh"
 #include "pie_packet_queue.hh"
 #include "link_queue.hh"
+#include "cross_traffic.hh"
+#include "kernel_link.hh"
+#include "ezio.hh"
 #include "packetshell.cc"
 
 using namespace std;
 
+namespace {
+    const unsigned int DEFAULT_OFFLOAD_INTERVAL = 10; /* ms */
+
+    /* the kernel's queue when mm-link's would be infinite */
+    const uint32_t OFFLOAD_INFINITE_LIMIT = 1 << 30; /* bytes */
+
+    /* a packet's worth of the droptail queue's limit, as in LinkQueue */
+    const uint32_t OFFLOAD_PACKET_BYTES = 1504;
+}
+
 void usage_error( const string & program_name )
 {
     cerr << "Usage: " << program_name << " UPLINK-TRACE DOWNLINK-TRACE [OPTION]... [COMMAND]" << endl;
@@ -23,11 +36,23 @@ void usage_error( const string & program_name )
     cerr << "          --meter-all" << endl;
     cerr << "          --uplink-queue=QUEUE_TYPE --downlink-queue=QUEUE_TYPE" << endl;
     cerr << "          --uplink-queue-args=QUEUE_ARGS --downlink-queue-args=QUEUE_ARGS" << endl;
+    cerr << "          --uplink-cross-traffic=TRAFFIC_TYPE --downlink-cross-traffic=TRAFFIC_TYPE" << endl;
+    cerr << "          --uplink-cross-traffic-args=TRAFFIC_ARGS --downlink-cross-traffic-args=TRAFFIC_ARGS" << endl;
+    cerr << "          --kernel-offload[=INTERVAL_MS]" << endl;
     cerr << endl;
     cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie" << endl;
     cerr << "          QUEUE_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\"" << endl;
     cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst)" << endl;
-    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl << endl;
+    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl;
+    cerr << endl;
+    cerr << "          TRAFFIC_TYPE = cbr | poisson | onoff | trace" << endl;
+    cerr << "          TRAFFIC_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\" (or the trace's FILENAME)" << endl;
+    cerr << "              (with NAME = kbps | bytes | on | off)" << endl;
+    cerr << "                  on, off are mean periods in milli-second" << endl;
+    cerr << endl;
+    cerr << "          --kernel-offload has the kernel emulate the link (with the rate" << endl;
+    cerr << "              averaged over, and updated every, INTERVAL_MS: default " << DEFAULT_OFFLOAD_INTERVAL << ")," << endl;
+    cerr << "              unless a trace varies too fast or an option needs the userspace link" << endl << endl;
 
     throw runtime_error( "invalid arguments" );
 }
@@ -53,6 +78,45 @@ unique_ptr<AbstractPacketQueue> get_packet_queue( const string & type, const str
     return nullptr;
 }
 
+unique_ptr<CrossTraffic> get_cross_traffic( const string & type, const string & args, const string & program_name )
+{
+    if ( type.empty() ) {
+        return nullptr;
+    } else if ( type == "cbr" ) {
+        return unique_ptr<CrossTraffic>( new ConstantCrossTraffic( args ) );
+    } else if ( type == "poisson" ) {
+        return unique_ptr<CrossTraffic>( new PoissonCrossTraffic( args ) );
+    } else if ( type == "onoff" ) {
+        return unique_ptr<CrossTraffic>( new OnOffCrossTraffic( args ) );
+    } else if ( type == "trace" ) {
+        return unique_ptr<CrossTraffic>( new TraceCrossTraffic( args ) );
+    } else {
+        cerr << "Unknown cross traffic type: " << type << endl;
+    }
+
+    usage_error( program_name );
+
+    return nullptr;
+}
+
+/* the byte limit of the kernel's queue that stands in for this
+   one, or zero if the kernel can't do what this queue does */
+uint32_t offload_queue_limit( const string & type, const string & args )
+{
+    if ( type == "infinite" ) {
+        return OFFLOAD_INFINITE_LIMIT;
+    } else if ( type == "droptail" ) {
+        const unsigned int bytes = DroppingPacketQueue::get_arg( args, "bytes" );
+        const unsigned int packets = DroppingPacketQueue::get_arg( args, "packets" );
+        if ( packets and ( not bytes or uint64_t( packets ) * OFFLOAD_PACKET_BYTES < bytes ) ) {
+            return min( uint64_t( packets ) * OFFLOAD_PACKET_BYTES, uint64_t( OFFLOAD_INFINITE_LIMIT ) );
+        }
+        return bytes;
+    }
+
+    return 0;
+}
+
 string shell_quote( const string & arg )
 {
     string ret = "'";
@@ -99,6 +163,11 @@ int main( int argc, char *argv[] )
             { "downlink-queue",       required_argument, nullptr, 'w' },
             { "uplink-queue-args",    required_argument, nullptr, 'a' },
             { "downlink-queue-args",  required_argument, nullptr, 'b' },
+            { "uplink-cross-traffic",         required_argument, nullptr, 'c' },
+            { "downlink-cross-traffic",       required_argument, nullptr, 'e' },
+            { "uplink-cross-traffic-args",    required_argument, nullptr, 'f' },
+            { "downlink-cross-traffic-args",  required_argument, nullptr, 'g' },
+            { "kernel-offload",               optional_argument, nullptr, 'k' },
             { 0,                                      0, nullptr, 0 }
         };
 
@@ -108,6 +177,9 @@ int main( int argc, char *argv[] )
         bool meter_uplink_delay = false, meter_downlink_delay = false;
         string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
                uplink_queue_args, downlink_queue_args;
+        string uplink_cross_traffic_type, downlink_cross_traffic_type,
+               uplink_cross_traffic_args, downlink_cross_traffic_args;
+        unsigned int offload_interval = 0;
 
         while ( true ) {
             const int opt = getopt_long( argc, argv, "u:d:", command_line_options, nullptr );
@@ -154,6 +226,24 @@ int main( int argc, char *argv[] )
             case 'b':
                 downlink_queue_args = optarg;
                 break;
+            case 'c':
+                uplink_cross_traffic_type = optarg;
+                break;
+            case 'e':
+                downlink_cross_traffic_type = optarg;
+                break;
+            case 'f':
+                uplink_cross_traffic_args = optarg;
+                break;
+            case 'g':
+                downlink_cross_traffic_args = optarg;
+                break;
+            case 'k':
+                offload_interval = optarg ? myatoi( optarg ) : DEFAULT_OFFLOAD_INTERVAL;
+                if ( offload_interval == 0 ) {
+                    usage_error( argv[ 0 ] );
+                }
+                break;
             case '?':
                 usage_error( argv[ 0 ] );
                 break;
@@ -179,16 +269,58 @@ int main( int argc, char *argv[] )
             }
         }
 
+        if ( offload_interval ) {
+            const uint32_t uplink_limit = offload_queue_limit( uplink_queue_type, uplink_queue_args );
+            const uint32_t downlink_limit = offload_queue_limit( downlink_queue_type, downlink_queue_args );
+
+            string reason;
+            if ( not repeat ) {
+                reason = "--once";
+            } else if ( not uplink_logfile.empty() or not downlink_logfile.empty()
+                        or meter_uplink or meter_downlink or meter_uplink_delay or meter_downlink_delay ) {
+                reason = "logging and metering";
+            } else if ( not uplink_cross_traffic_type.empty() or not downlink_cross_traffic_type.empty() ) {
+                reason = "cross traffic";
+            } else if ( not uplink_limit or not downlink_limit ) {
+                reason = "this queue type";
+            } else {
+                KernelLink uplink( uplink_filename, offload_interval, uplink_limit );
+                KernelLink downlink( downlink_filename, offload_interval, downlink_limit );
+
+                if ( uplink.trackable() and downlink.trackable() ) {
+                    /* token-bucket qdiscs on a veth pair, so that packets never cross into userspace */
+                    PacketShell<LinkQueue> link_shell_app( "link", user_environment,
+                                                           PacketShell<LinkQueue>::Device::Veth );
+
+                    cout << "uplink: " << uplink.to_string() << " downlink: " << downlink.to_string() << endl;
+
+                    link_shell_app.start_veth_link( "[link] ", command,
+                                                    [&] ( const string & device ) { uplink.install( device ); },
+                                                    [&] () { return uplink.follow_trace(); },
+                                                    [&] ( const string & device ) { downlink.install( device ); },
+                                                    [&] () { return downlink.follow_trace(); } );
+
+                    return link_shell_app.wait_for_exit();
+                }
+
+                reason = "a trace that varies faster than every " + to_string( offload_interval ) + " ms";
+            }
+
+            cerr << "mm-link: can't offload " << reason << " to the kernel; using the userspace link" << endl;
+        }
+
         PacketShell<LinkQueue> link_shell_app( "link", user_environment );
 
         link_shell_app.start_uplink( "[link] ", command,
                                      "Uplink", uplink_filename, uplink_logfile, repeat, meter_uplink, meter_uplink_delay,
                                      get_packet_queue( uplink_queue_type, uplink_queue_args, argv[ 0 ] ),
-                                     command_line );
+                                     command_line,
+                                     get_cross_traffic( uplink_cross_traffic_type, uplink_cross_traffic_args, argv[ 0 ] ) );
 
         link_shell_app.start_downlink( "Downlink", downlink_filename, downlink_logfile, repeat, meter_downlink, meter_downlink_delay,
                                        get_packet_queue( downlink_queue_type, downlink_queue_args, argv[ 0 ] ),
-                                       command_line );
+                                       command_line,
+                                       get_cross_traffic( downlink_cross_traffic_type, downlink_cross_traffic_args, argv[ 0 ] ) );
 
         return link_shell_app.wait_for_exit();
     } catch ( const exception & e ) {
@@ -80,3 +80,28 @@ bool SwitchingLink::drop_packet( const string & packet __attribute((unused)) )
 {
     return !link_is_on_;
 }
+
+ScheduledLoss::ScheduledLoss( const string & schedule_filename )
+{
+    if ( not schedule_filename.empty() ) {
+        loss_schedule_.reset( new Schedule( schedule_filename, 0, 1 ) );
+    }
+}
+
+bool ScheduledLoss::drop_packet( const string & packet __attribute((unused)) )
+{
+    return loss_schedule_
+        and bernoulli_distribution( loss_schedule_->value_at( timestamp() ) )( prng_ );
+}
+
+ScheduledSwitchingLink::ScheduledSwitchingLink( const string & schedule_filename )
+{
+    if ( not schedule_filename.empty() ) {
+        onoff_schedule_.reset( new Schedule( schedule_filename, 0, 1 ) );
+    }
+}
+
+bool ScheduledSwitchingLink::drop_packet( const string & packet __attribute((unused)) )
+{
+    return onoff_schedule_ and onoff_schedule_->value_at( timestamp() ) == 0;
+}
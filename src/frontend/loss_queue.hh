@@ -7,8 +7,10 @@
 #include <cstdint>
 #include <string>
 #include <random>
+#include <memory>
 
 #include "file_descriptor.hh"
+#include "schedule.hh"
 
 class LossQueue
 {
@@ -65,4 +67,28 @@ public:
     unsigned int wait_time( void );
 };
 
+/* loss rate that changes over time (no loss without a schedule) */
+class ScheduledLoss : public LossQueue
+{
+private:
+    std::unique_ptr<Schedule> loss_schedule_ {};
+
+    bool drop_packet( const std::string & packet ) override;
+
+public:
+    ScheduledLoss( const std::string & schedule_filename );
+};
+
+/* link that goes down (0) and up (1) as recorded (always up without a schedule) */
+class ScheduledSwitchingLink : public LossQueue
+{
+private:
+    std::unique_ptr<Schedule> onoff_schedule_ {};
+
+    bool drop_packet( const std::string & packet ) override;
+
+public:
+    ScheduledSwitchingLink( const std::string & schedule_filename );
+};
+
 #endif /* LOSS_QUEUE_HH */
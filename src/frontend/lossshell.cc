@@ -15,7 +15,7 @@ using namespace std;
 
 void usage( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE|--schedule=FILE [COMMAND...]" );
 }
 
 int main( int argc, char *argv[] )
@@ -31,6 +31,37 @@ int main( int argc, char *argv[] )
             usage( argv[ 0 ] );
         }
 
+        const string link = argv[ 1 ];
+        if ( link != "uplink" and link != "downlink" ) {
+            usage( argv[ 0 ] );
+        }
+
+        vector<string> command;
+
+        if ( argc == 3 ) {
+            command.push_back( shell_path() );
+        } else {
+            for ( int i = 3; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        }
+
+        /* a loss rate that changes over time, one "MS RATE" line per change */
+        const string schedule_option = "--schedule=";
+        if ( string( argv[ 2 ] ).compare( 0, schedule_option.size(), schedule_option ) == 0 ) {
+            const string schedule = string( argv[ 2 ] ).substr( schedule_option.size() );
+            const string uplink_schedule = link == "uplink" ? schedule : "";
+            const string downlink_schedule = link == "downlink" ? schedule : "";
+
+            PacketShell<ScheduledLoss> loss_app( "loss", user_environment );
+
+            loss_app.start_uplink( "[loss " + string( link == "uplink" ? "up=" : "down=" ) + schedule + "] ",
+                                   command,
+                                   uplink_schedule );
+            loss_app.start_downlink( downlink_schedule );
+            return loss_app.wait_for_exit();
+        }
+
         const double loss_rate = myatof( argv[ 2 ] );
         if ( (0 <= loss_rate) and (loss_rate <= 1) ) {
             /* do nothing */
@@ -41,23 +72,10 @@ int main( int argc, char *argv[] )
 
         double uplink_loss = 0, downlink_loss = 0;
 
-        const string link = argv[ 1 ];
         if ( link == "uplink" ) {
             uplink_loss = loss_rate;
-        } else if ( link == "downlink" ) {
-            downlink_loss = loss_rate;
-        } else {
-            usage( argv[ 0 ] );
-        }
-
-        vector<string> command;
-
-        if ( argc == 3 ) {
-            command.push_back( shell_path() );
         } else {
-            for ( int i = 3; i < argc; i++ ) {
-                command.push_back( argv[ i ] );
-            }
+            downlink_loss = loss_rate;
         }
 
         PacketShell<IIDLoss> loss_app( "loss", user_environment );
@@ -0,0 +1,233 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <net/route.h>
+
+#include "namespace_pool.hh"
+#include "event_loop.hh"
+#include "exception.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* device names must fit in IFNAMSIZ, so use hex for the pid and id */
+static string veth_name( const char side, const unsigned int id )
+{
+    ostringstream name;
+    name << "veth-" << hex << getpid() << side << ( id & 0xfff );
+    return name.str();
+}
+
+PooledNamespace::PooledNamespace( const unsigned int id, const Address & nameserver )
+    : address_lease_(),
+      egress_addr_( address_lease_.egress() ),
+      ingress_addr_( address_lease_.ingress() ),
+      egress_name_( veth_name( 'o', id ) ),
+      ingress_name_( veth_name( 'i', id ) ),
+      veth_devices_( egress_name_, ingress_name_ ),
+      nat_rule_( ingress_addr_ ),
+      pipe_( UnixDomainSocket::make_pair() ),
+      dns_outside_(),
+      dns_process_(),
+      container_process_()
+{
+    /* bring up egress */
+    assign_address( egress_name_, egress_addr_, ingress_addr_ );
+
+    /* create DNS proxy, served from its own unprivileged process */
+    dns_outside_.reset( new DNSProxy( egress_addr_, nameserver, nameserver ) );
+
+    dns_process_.reset( new ChildProcess( "pool-dns", [&]() {
+                drop_privileges();
+
+                EventLoop dns_event_loop;
+                dns_outside_->register_handlers( dns_event_loop );
+                return dns_event_loop.loop();
+            } ) );
+
+    container_process_.reset( new ChildProcess( "pool-namespace", [&]() {
+                /* wait for the go signal */
+                pipe_.second.read();
+
+                /* bring up localhost */
+                interface_ioctl( SIOCSIFFLAGS, "lo",
+                                 [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
+
+                /* bring up veth device */
+                assign_address( ingress_name_, ingress_addr_, egress_addr_ );
+
+                /* create default route */
+                rtentry route;
+                zero( route );
+
+                route.rt_gateway = egress_addr_.to_sockaddr();
+                route.rt_dst = route.rt_genmask = Address().to_sockaddr();
+                route.rt_flags = RTF_UP | RTF_GATEWAY;
+
+                SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
+
+                /* create DNS proxy if nameserver address is local */
+                auto dns_inside = DNSProxy::maybe_proxy( nameserver,
+                                                         dns_outside_->udp_listener().local_address(),
+                                                         dns_outside_->tcp_listener().local_address() );
+
+                drop_privileges();
+
+                EventLoop container_event_loop;
+                if ( dns_inside ) {
+                    dns_inside->register_handlers( container_event_loop );
+                }
+
+                /* namespace is ready to be handed out */
+                pipe_.second.write( "x" );
+
+                return container_event_loop.loop();
+            }, true ) ); /* new network namespace */
+
+    /* give ingress to container */
+    move_to_namespace( ingress_name_, container_process_->pid() );
+    veth_devices_.set_kernel_will_destroy();
+
+    /* tell container it's ok to proceed, and wait until it is configured */
+    pipe_.first.write( "x" );
+    if ( pipe_.first.read() != "x" ) {
+        throw runtime_error( "PooledNamespace: container failed to start" );
+    }
+}
+
+FileDescriptor PooledNamespace::netns( void ) const
+{
+    const string path = "/proc/" + to_string( container_process_->pid() ) + "/ns/net";
+    return FileDescriptor( SystemCall( "open " + path, open( path.c_str(), O_RDONLY | O_CLOEXEC ) ) );
+}
+
+bool PooledNamespace::alive( void )
+{
+    for ( ChildProcess * process : { dns_process_.get(), container_process_.get() } ) {
+        if ( ( not process->terminated() ) and process->waitable() ) {
+            process->wait( true );
+        }
+
+        if ( process->terminated() ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+NamespacePool::NamespacePool( const unsigned int size )
+    : size_( size ),
+      nameserver_( first_nameserver() ),
+      next_id_( 0 ),
+      ready_(),
+      leases_(),
+      signals_( { SIGCHLD, SIGCONT, SIGHUP, SIGTERM, SIGQUIT, SIGINT } ),
+      poller_()
+{
+    if ( size_ == 0 ) {
+        throw runtime_error( "NamespacePool: size must be positive" );
+    }
+
+    signals_.set_as_mask(); /* block signals so we can later use signalfd to read them */
+}
+
+unique_ptr<PooledNamespace> NamespacePool::make_namespace( void )
+{
+    return unique_ptr<PooledNamespace>( new PooledNamespace( next_id_++, nameserver_ ) );
+}
+
+void NamespacePool::hand_out( UnixDomainSocket && connection )
+{
+    if ( ready_.empty() ) {
+        /* pool has run dry; the client has to wait for setup after all */
+        ready_.push_back( make_namespace() );
+    }
+
+    leases_.emplace_back( move( connection ), move( ready_.front() ) );
+    ready_.pop_front();
+
+    Lease & lease = leases_.back();
+
+    /* send the namespace and the MAHIMAHI_BASE to use inside it */
+    FileDescriptor netns = lease.name_space->netns();
+    lease.connection.send_fd( netns );
+    lease.connection.write( lease.name_space->egress_addr().ip() );
+
+    /* connection closes when the shell exits */
+    poller_.add_action( Poller::Action( lease.connection, Direction::In,
+                                        [&lease] () {
+                                            if ( lease.connection.read().empty() ) {
+                                                lease.finished = true;
+                                                return ResultType::Cancel;
+                                            }
+                                            return ResultType::Continue;
+                                        },
+                                        [] () { return true; },
+                                        [&lease] () { lease.finished = true; } ) );
+}
+
+int NamespacePool::housekeeping( void )
+{
+    /* the poller has already forgotten these connections */
+    leases_.remove_if( [] ( const Lease & lease ) { return lease.finished; } );
+
+    ready_.remove_if( [] ( const unique_ptr<PooledNamespace> & name_space ) {
+            return not name_space->alive();
+        } );
+
+    /* top up the pool one namespace at a time, so new clients aren't
+       held up behind a long refill */
+    if ( ready_.size() < size_ ) {
+        ready_.push_back( make_namespace() );
+    }
+
+    return ready_.size() < size_ ? 0 : -1;
+}
+
+Result NamespacePool::handle_signal( const signalfd_siginfo & sig )
+{
+    switch ( sig.ssi_signo ) {
+    case SIGCHLD:
+        /* dead namespaces are noticed in housekeeping() */
+    case SIGCONT:
+        break;
+
+    case SIGHUP:
+    case SIGTERM:
+    case SIGQUIT:
+    case SIGINT:
+        return ResultType::Exit;
+    default:
+        throw runtime_error( "NamespacePool: unknown signal" );
+    }
+
+    return ResultType::Continue;
+}
+
+int NamespacePool::loop( UnixDomainSocket & listener )
+{
+    SignalFD signal_fd( signals_ );
+
+    poller_.add_action( Poller::Action( signal_fd.fd(), Direction::In,
+                                        [&] () { return handle_signal( signal_fd.read_signal() ); } ) );
+
+    poller_.add_action( Poller::Action( listener, Direction::In,
+                                        [&] () {
+                                            hand_out( listener.accept() );
+                                            return ResultType::Continue;
+                                        } ) );
+
+    cerr << "mm-pool: preparing " << size_ << " namespaces" << endl;
+
+    while ( true ) {
+        const auto poll_result = poller_.poll( housekeeping() );
+        if ( poll_result.result == Poller::Result::Type::Exit ) {
+            return poll_result.exit_status;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef NAMESPACE_POOL_HH
+#define NAMESPACE_POOL_HH
+
+#include <list>
+#include <memory>
+#include <string>
+
+#include "address.hh"
+#include "address_lease.hh"
+#include "child_process.hh"
+#include "dns_proxy.hh"
+#include "file_descriptor.hh"
+#include "nat.hh"
+#include "netdevice.hh"
+#include "poller.hh"
+#include "signalfd.hh"
+#include "socketpair.hh"
+
+/* a network namespace that is set up ahead of time (veth pair to the host,
+   NAT, default route and DNS) and waits to be handed to a shell */
+class PooledNamespace
+{
+private:
+    AddressLease address_lease_;
+    Address egress_addr_, ingress_addr_;
+    std::string egress_name_, ingress_name_;
+
+    VirtualEthernetPair veth_devices_;
+    NAT nat_rule_;
+
+    /* go/ready signals between the pool and the container */
+    std::pair<UnixDomainSocket, UnixDomainSocket> pipe_;
+
+    /* these need the egress device to be up, so are set up in order
+       in the constructor (and torn down in reverse) */
+    std::unique_ptr<DNSProxy> dns_outside_;
+
+    /* serves dns_outside_ in the host's namespace */
+    std::unique_ptr<ChildProcess> dns_process_;
+
+    /* lives in (and keeps alive) the new namespace */
+    std::unique_ptr<ChildProcess> container_process_;
+
+public:
+    PooledNamespace( const unsigned int id, const Address & nameserver );
+
+    const Address & egress_addr( void ) const { return egress_addr_; }
+    const Address & ingress_addr( void ) const { return ingress_addr_; }
+
+    /* handle on the namespace, to pass to a shell with send_fd. This
+       is opened on demand, since every process the pool forks later
+       would inherit it and keep the namespace from being destroyed. */
+    FileDescriptor netns( void ) const;
+
+    /* are the namespace's helper processes still running? */
+    bool alive( void );
+
+    /* forbid copying */
+    PooledNamespace( const PooledNamespace & other ) = delete;
+    PooledNamespace & operator=( const PooledNamespace & other ) = delete;
+};
+
+/* keeps a number of namespaces ready and hands them out, one per
+   connection, over a Unix-domain socket. When the connection closes
+   the namespace is torn down and the pool is refilled. */
+class NamespacePool
+{
+private:
+    struct Lease
+    {
+        UnixDomainSocket connection;
+        std::unique_ptr<PooledNamespace> name_space;
+        bool finished;
+
+        Lease( UnixDomainSocket && s_connection, std::unique_ptr<PooledNamespace> && s_name_space )
+            : connection( std::move( s_connection ) ), name_space( std::move( s_name_space ) ),
+              finished( false ) {}
+    };
+
+    const unsigned int size_;
+    const Address nameserver_;
+    unsigned int next_id_;
+
+    std::list<std::unique_ptr<PooledNamespace>> ready_;
+    std::list<Lease> leases_;
+
+    SignalMask signals_;
+    Poller poller_;
+
+    std::unique_ptr<PooledNamespace> make_namespace( void );
+
+    void hand_out( UnixDomainSocket && connection );
+
+    /* reap finished leases and dead namespaces, then top up the pool;
+       returns the poll timeout */
+    int housekeeping( void );
+
+    PollerShortNames::Result handle_signal( const signalfd_siginfo & sig );
+
+public:
+    NamespacePool( const unsigned int size );
+
+    int loop( UnixDomainSocket & listener );
+
+    /* forbid copying */
+    NamespacePool( const NamespacePool & other ) = delete;
+    NamespacePool & operator=( const NamespacePool & other ) = delete;
+};
+
+#endif /* NAMESPACE_POOL_HH */
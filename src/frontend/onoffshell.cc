@@ -15,7 +15,8 @@ using namespace std;
 
 void usage( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " uplink|downlink MEAN-ON-TIME MEAN-OFF-TIME [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " uplink|downlink MEAN-ON-TIME MEAN-OFF-TIME [COMMAND...]\n"
+                         + "   or: " + program_name + " uplink|downlink --schedule=FILE [COMMAND...]" );
 }
 
 int main( int argc, char *argv[] )
@@ -27,6 +28,41 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
+        if ( argc < 3 ) {
+            usage( argv[ 0 ] );
+        }
+
+        const string link = argv[ 1 ];
+        if ( link != "uplink" and link != "downlink" ) {
+            usage( argv[ 0 ] );
+        }
+
+        /* recorded outages, one "MS 0|1" line per change of state */
+        const string schedule_option = "--schedule=";
+        if ( string( argv[ 2 ] ).compare( 0, schedule_option.size(), schedule_option ) == 0 ) {
+            const string schedule = string( argv[ 2 ] ).substr( schedule_option.size() );
+            const string uplink_schedule = link == "uplink" ? schedule : "";
+            const string downlink_schedule = link == "downlink" ? schedule : "";
+
+            vector<string> command;
+
+            if ( argc == 3 ) {
+                command.push_back( shell_path() );
+            } else {
+                for ( int i = 3; i < argc; i++ ) {
+                    command.push_back( argv[ i ] );
+                }
+            }
+
+            PacketShell<ScheduledSwitchingLink> onoff_app( "onoff", user_environment );
+
+            onoff_app.start_uplink( "[onoff (" + string( link == "uplink" ? "up" : "down" ) + ") " + schedule + "] ",
+                                    command,
+                                    uplink_schedule );
+            onoff_app.start_downlink( downlink_schedule );
+            return onoff_app.wait_for_exit();
+        }
+
         if ( argc < 4 ) {
             usage( argv[ 0 ] );
         }
@@ -55,15 +91,12 @@ int main( int argc, char *argv[] )
         double uplink_on_time = numeric_limits<double>::max(), uplink_off_time = 0;
         double downlink_on_time = numeric_limits<double>::max(), downlink_off_time = 0;
 
-        const string link = argv[ 1 ];
         if ( link == "uplink" ) {
             uplink_on_time = on_time;
             uplink_off_time = off_time;
-        } else if ( link == "downlink" ) {
+        } else {
             downlink_on_time = on_time;
             downlink_off_time = off_time;
-        } else {
-            usage( argv[ 0 ] );
         }
 
         vector<string> command;
@@ -16,17 +16,15 @@
 #include "system_runner.hh"
 #include "socket.hh"
 #include "event_loop.hh"
-#include "temp_file.hh"
 #include "http_response.hh"
-#include "dns_server.hh"
+#include "dns_responder.hh"
 #include "exception.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "nat.hh"
 #include "socketpair.hh"
 #include "squid_proxy.hh"
 #include "reverse_proxy.hh"
 #include "pac_file.hh"
-#include "vpn.hh"
 
 #include "http_record.pb.h"
 
@@ -34,16 +32,6 @@
 
 using namespace std;
 
-void add_dummy_interface( const string & name, const Address & addr )
-{
-    run( { IP, "link", "add", name, "type", "dummy" } );
-
-    interface_ioctl( SIOCSIFFLAGS, name,
-                     [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
-    interface_ioctl( SIOCSIFADDR, name,
-                     [&] ( ifreq &ifr ) { ifr.ifr_addr = addr.to_sockaddr(); } );
-}
-
 int main( int argc, char *argv[] )
 {
     try {
@@ -82,7 +70,8 @@ int main( int argc, char *argv[] )
 
         /* set egress and ingress ip addresses */
         Address egress_addr, ingress_addr;
-        tie( egress_addr, ingress_addr ) = two_unassigned_addresses();
+        AddressLease address_lease;
+        tie( egress_addr, ingress_addr ) = address_lease.addresses();
 
         /* make pair of devices */
         string egress_name = "veth-" + to_string( getpid() ), ingress_name = "veth-i" + to_string( getpid() );
@@ -165,6 +154,7 @@ int main( int argc, char *argv[] )
               }
 
               /* set up dummy interfaces */
+              vector< pair< string, Address > > dummy_interfaces;
               unsigned int interface_counter = 0;
               unsigned int squid_proxy_base_port = 3128;
               vector< Address > reverse_proxy_addresses;
@@ -183,7 +173,7 @@ int main( int argc, char *argv[] )
 
                   // Setup the interface for each of the webserver.
                   if ( added_ip_addresses.count(address.ip()) == 0 ) {
-                    add_dummy_interface( "sharded" + to_string( interface_counter ), address );
+                    dummy_interfaces.emplace_back( "sharded" + to_string( interface_counter ), address );
                   }
                   added_ip_addresses.insert( address.ip() );
 
@@ -195,7 +185,7 @@ int main( int argc, char *argv[] )
                   string reverse_proxy_name = to_string( interface_counter ) + ".reverse.com";
                   string reverse_proxy_device_name = "reverse" + to_string( interface_counter );
                   Address reverse_proxy_address = Address::reverse_proxy(interface_counter + 1, address.port());
-                  add_dummy_interface( reverse_proxy_device_name, reverse_proxy_address);
+                  dummy_interfaces.emplace_back( reverse_proxy_device_name, reverse_proxy_address);
 
                   // Populuate name resolution pairs.
                   if (reverse_proxy_address.port() == 80) {
@@ -217,6 +207,8 @@ int main( int argc, char *argv[] )
                   interface_counter++;
               }
 
+              add_dummy_interfaces( dummy_interfaces );
+
               /* set up web servers */
               vector< WebServer > servers;
               for ( const auto ip_port : unique_ip_and_port ) {
@@ -261,30 +253,20 @@ int main( int argc, char *argv[] )
               pac_file.WriteProxies(hostname_to_reverse_proxy_addresses,
                                     hostname_to_reverse_proxy_names);
 
-              /* set up DNS server */
-              TempFile dnsmasq_hosts( "/tmp/replayshell_hosts" );
-              uint8_t counter = 0;
+              /* names the DNS server will answer for */
               cout << "name_resolution_pairs.size(): " << to_string(name_resolution_pairs.size()) << endl;
               for ( const auto mapping : name_resolution_pairs ) {
               // for ( const auto mapping : reverse_proxy_names_to_reverse_proxy_addresses ) {
               // for ( const auto mapping : hostname_to_reverse_proxy_addresses ) {
                 cout << "IP: " << mapping.second.ip() << " domain: " << mapping.first << endl;
-                // dnsmasq_hosts.write( mapping.second.ip() + " " + to_string(counter) + ".reverse.com\n" );
-                dnsmasq_hosts.write( mapping.second.ip() + " " + mapping.first + "\n" );
-                counter++;
               }
 
               /* initialize event loop */
               EventLoop event_loop;
 
-              /* create dummy interface for each nameserver */
+              /* answer for each nameserver */
               vector< Address > nameservers = all_nameservers();
-              vector< string > dnsmasq_args = { "-H", dnsmasq_hosts.name() };
-
-              for ( unsigned int server_num = 0; server_num < nameservers.size(); server_num++ ) {
-                  const string interface_name = "nameserver" + to_string( server_num );
-                  add_dummy_interface( interface_name, nameservers.at( server_num ) );
-              }
+              add_loopback_addresses( nameservers );
 
               // Create a NAT to the first nameserver.
               /* set up NAT between egress and eth0 */
@@ -293,8 +275,9 @@ int main( int argc, char *argv[] )
               /* set up DNAT between tunnel and the nameserver. */
               DNAT dnat( Address(nameservers[0].ip(), 53), "udp", 53 );
 
-              /* start dnsmasq */
-              event_loop.add_child_process( start_dnsmasq( dnsmasq_args ) );
+              /* set up DNS server */
+              DNSResponder dns_responder( Address( "0", "domain" ), name_resolution_pairs );
+              dns_responder.register_handlers( event_loop );
 
               // string path_to_security_files = "/etc/openvpn/";
               // VPN vpn(path_to_security_files, ingress_addr, nameservers);
@@ -318,7 +301,7 @@ int main( int argc, char *argv[] )
           }, true); /* new network namespace */
 
           /* give ingress to container */
-          run( { IP, "link", "set", "dev", ingress_name, "netns", to_string( container_process.pid() ) } );
+          move_to_namespace( ingress_name, container_process.pid() );
           veth_devices.set_kernel_will_destroy();
 
           /* tell ChildProcess it's ok to proceed */
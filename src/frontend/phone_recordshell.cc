@@ -6,8 +6,9 @@
 #include <net/route.h>
 
 #include "nat.hh"
+#include "system_runner.hh"
 #include "util.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "address.hh"
 #include "dns_proxy.hh"
 #include "http_proxy.hh"
@@ -61,7 +62,8 @@ int main( int argc, char *argv[] )
 
         /* set egress and ingress ip addresses */
         Address egress_addr, ingress_addr;
-        tie( egress_addr, ingress_addr ) = two_unassigned_addresses();
+        AddressLease address_lease;
+        tie( egress_addr, ingress_addr ) = address_lease.addresses();
 
         /* make pair of devices */
         string egress_name = "veth-" + to_string( getpid() ), ingress_name = "veth-i" + to_string( getpid() );
@@ -156,7 +158,7 @@ int main( int argc, char *argv[] )
                 }, true ); /* new network namespace */
 
             /* give ingress to container */
-            run( { IP, "link", "set", "dev", ingress_name, "netns", to_string( container_process.pid() ) } );
+            move_to_namespace( ingress_name, container_process.pid() );
             veth_devices.set_kernel_will_destroy();
 
             /* tell ChildProcess it's ok to proceed */
@@ -12,22 +12,20 @@
 #include "dns_proxy.hh"
 #include "event_loop.hh"
 #include "exception.hh"
-#include "forwarder.hh"
 #include "http_proxy.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "nat.hh"
 #include "netdevice.hh"
 #include "noop_store.hh"
 #include "socketpair.hh"
+#include "udp_tunnel.hh"
 #include "util.hh"
-#include "vpn.hh"
 
 using namespace std;
 
 int main(int argc, char *argv[]) {
   try {
     /* clear environment */
-    char **user_environment = environ;
     environ = nullptr;
 
     check_requirements(argc, argv);
@@ -54,7 +52,8 @@ int main(int argc, char *argv[]) {
 
     /* set egress and ingress ip addresses */
     Address egress_addr, ingress_addr;
-    tie(egress_addr, ingress_addr) = two_unassigned_addresses();
+    AddressLease address_lease;
+    tie(egress_addr, ingress_addr) = address_lease.addresses();
 
     /* make pair of devices */
     string egress_name = "veth-" + to_string(getpid()),
@@ -76,7 +75,8 @@ int main(int argc, char *argv[]) {
 
     /* set up dnat */
     DNAT dnat(http_proxy.tcp_listener().local_address(), egress_name);
-    DNAT openvpn(Address(ingress_addr.ip(), 1194), "udp", 1194);
+    DNAT tunnel(Address(ingress_addr.ip(), UDPTunnel::DEFAULT_PORT), "udp",
+               UDPTunnel::DEFAULT_PORT);
 
     /* prepare event loop */
     EventLoop outer_event_loop;
@@ -116,34 +116,25 @@ int main(int argc, char *argv[]) {
                 dns_outside.tcp_listener().local_address());
 
             cout << "DNS Inside Nameserver: " << nameserver.str() << endl;
-            string path_to_security_files = "/etc/openvpn/";
-            VPN vpn(path_to_security_files, ingress_addr);
-            vector<string> command = vpn.start_command();
-
-            // For debugging purposes.
-            // for (auto i = vpn_command.begin(); i != vpn_command.end(); i++) {
-            //   cout << *i << ' ';
-            // }
-            // cout << endl;
-            // vector<string> command = { "bash" };
-
-            /* forward all packets from tun0 (OpenVPN interface) to the ingress
-             * interface */
-            Forwarder forwarder("tun0", ingress_name);
+            /* the phone's end of the tunnel, with its connections going out
+             * of the ingress interface like ours */
+            NAT tunnel_nat(UDPTunnel::client_address());
+            UDPSocket tunnel_socket;
+            tunnel_socket.bind(
+                Address(ingress_addr.ip(), UDPTunnel::DEFAULT_PORT));
+            const string tunnel_token = UDPTunnel::make_token();
+            cout << "Tunnel token: " << tunnel_token << endl;
+            UDPTunnel tunnel(UDPTunnel::Role::Server, move(tunnel_socket),
+                             "tun0", tunnel_token);
 
             /* Fork again after dropping root privileges */
             drop_privileges();
 
-            /* prepare child's event loop */
+            /* prepare child's event loop (which runs the tunnel until we're
+             * interrupted) */
             EventLoop shell_event_loop;
 
-            shell_event_loop.add_child_process(join(command), [&]() {
-              /* restore environment and tweak prompt */
-              environ = user_environment;
-              prepend_shell_prefix("[record] ");
-
-              return ezexec(command, true);
-            });
+            tunnel.register_handlers(shell_event_loop);
 
             if (dns_inside) {
               cout << "DNS Inside not NULL" << endl;
@@ -155,8 +146,7 @@ int main(int argc, char *argv[]) {
           true); /* new network namespace */
 
       /* give ingress to container */
-      run({IP, "link", "set", "dev", ingress_name, "netns",
-           to_string(container_process.pid())});
+      move_to_namespace(ingress_name, container_process.pid());
       veth_devices.set_kernel_will_destroy();
 
       /* tell ChildProcess it's ok to proceed */
@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <string>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "namespace_pool.hh"
+#include "util.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* removes the socket file when the pool shuts down */
+class SocketPath
+{
+private:
+    string path_;
+
+public:
+    SocketPath( const string & path ) : path_( path ) {}
+
+    ~SocketPath()
+    {
+        TemporarilyUnprivileged tu;
+        if ( unlink( path_.c_str() ) < 0 ) {
+            perror( ( "unlink " + path_ ).c_str() );
+        }
+    }
+
+    /* forbid copying */
+    SocketPath( const SocketPath & other ) = delete;
+    SocketPath & operator=( const SocketPath & other ) = delete;
+};
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment while running as root */
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        if ( argc != 3 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " socket-path pool-size" );
+        }
+
+        const string socket_path( argv[ 1 ] );
+        const unsigned int pool_size = myatoi( argv[ 2 ] );
+
+        /* make sure the socket belongs to (and is only usable by) the user */
+        UnixDomainSocket listener = [&] () {
+            TemporarilyUnprivileged tu;
+            auto ret = UnixDomainSocket::listen_at( socket_path );
+            SystemCall( "chmod", chmod( socket_path.c_str(), 0600 ) );
+            return ret;
+        } ();
+        SocketPath socket_path_cleanup( socket_path );
+
+        NamespacePool pool( pool_size );
+        return pool.loop( listener );
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,76 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <vector>
+#include <string>
+
+#include <sched.h>
+
+#include "socketpair.hh"
+#include "event_loop.hh"
+#include "system_runner.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment while running as root */
+        char ** const user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        if ( argc < 2 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " socket-path [command...]" );
+        }
+
+        const string socket_path( argv[ 1 ] );
+
+        vector< string > command;
+
+        if ( argc == 2 ) {
+            command.push_back( shell_path() );
+        } else {
+            for ( int i = 2; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        }
+
+        /* the socket is only accessible to the user who started the pool */
+        UnixDomainSocket pool_connection = [&] () {
+            TemporarilyUnprivileged tu;
+            return UnixDomainSocket::connect_to( socket_path );
+        } ();
+
+        /* receive a ready namespace; the pool reclaims it when this connection closes */
+        FileDescriptor netns = pool_connection.recv_fd();
+        const string mahimahi_base = pool_connection.read();
+
+        SystemCall( "setns", setns( netns.fd_num(), CLONE_NEWNET ) );
+
+        drop_privileges();
+
+        EventLoop event_loop;
+
+        event_loop.add_child_process( join( command ), [&]() {
+                /* restore environment and tweak prompt */
+                environ = user_environment;
+
+                /* set MAHIMAHI_BASE if not set already to indicate outermost container */
+                SystemCall( "setenv", setenv( "MAHIMAHI_BASE",
+                                              mahimahi_base.c_str(),
+                                              false /* don't override */ ) );
+
+                prepend_shell_prefix( "[pool] " );
+
+                return ezexec( command, true );
+            } );
+
+        return event_loop.loop();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
@@ -1,13 +1,15 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <getopt.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <linux/if.h>
 #include <net/route.h>
 
 #include "nat.hh"
+#include "system_runner.hh"
 #include "util.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "address.hh"
 #include "dns_proxy.hh"
 #include "http_proxy.hh"
@@ -17,9 +19,21 @@
 #include "config.h"
 #include "backing_store.hh"
 #include "exception.hh"
+#include "message_body.hh"
+#include "ezio.hh"
 
 using namespace std;
 
+namespace {
+    /* bodies larger than this are recorded from a temporary file */
+    const size_t DEFAULT_SPILL_THRESHOLD = 1024 * 1024;
+}
+
+void usage_error( const string & program_name )
+{
+    throw runtime_error( "Usage: " + program_name + " [--spill-threshold=BYTES] directory [command...]" );
+}
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -29,12 +43,38 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " directory [command...]" );
+        const option command_line_options[] = {
+            { "spill-threshold", required_argument, nullptr, 's' },
+            { 0,                                 0, nullptr, 0 }
+        };
+
+        size_t spill_threshold = DEFAULT_SPILL_THRESHOLD;
+
+        while ( true ) {
+            /* (stop at the directory, leaving the command's options alone) */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 's':
+                spill_threshold = myatoi( optarg );
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind >= argc ) {
+            usage_error( argv[ 0 ] );
         }
 
         /* Make sure directory ends with '/' so we can prepend directory to file name for storage */
-        string directory( argv[ 1 ] );
+        string directory( argv[ optind ] );
 
         if ( directory.empty() ) {
             throw runtime_error( string( argv[ 0 ] ) + ": directory name must be non-empty" );
@@ -46,10 +86,10 @@ int main( int argc, char *argv[] )
 
         /* what command will we run inside the container? */
         vector < string > command;
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
@@ -58,7 +98,8 @@ int main( int argc, char *argv[] )
 
         /* set egress and ingress ip addresses */
         Address egress_addr, ingress_addr;
-        tie( egress_addr, ingress_addr ) = two_unassigned_addresses();
+        AddressLease address_lease;
+        tie( egress_addr, ingress_addr ) = address_lease.addresses();
 
         /* make pair of devices */
         string egress_name = "veth-" + to_string( getpid() ), ingress_name = "veth-i" + to_string( getpid() );
@@ -135,7 +176,7 @@ int main( int argc, char *argv[] )
                 }, true ); /* new network namespace */
 
             /* give ingress to container */
-            run( { IP, "link", "set", "dev", ingress_name, "netns", to_string( container_process.pid() ) } );
+            move_to_namespace( ingress_name, container_process.pid() );
             veth_devices.set_kernel_will_destroy();
 
             /* tell ChildProcess it's ok to proceed */
@@ -154,6 +195,9 @@ int main( int argc, char *argv[] )
                 /* set up backing store to save to disk */
                 HTTPDiskStore disk_backing_store( directory );
 
+                /* large bodies wait in the same directory (unlinked) until saved */
+                MessageBody::spill_bodies_over( spill_threshold, directory );
+
                 EventLoop recordr_event_loop;
                 dns_outside.register_handlers( recordr_event_loop );
                 http_proxy.register_handlers( recordr_event_loop, disk_backing_store );
@@ -17,17 +17,16 @@
 #include "system_runner.hh"
 #include "socket.hh"
 #include "event_loop.hh"
-#include "temp_file.hh"
 #include "http_response.hh"
-#include "dns_server.hh"
+#include "dns_responder.hh"
 #include "exception.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "nat.hh"
 #include "socketpair.hh"
 #include "squid_proxy.hh"
 #include "reverse_proxy.hh"
 #include "pac_file.hh"
-#include "vpn.hh"
+#include "udp_tunnel.hh"
 
 #include "http_record.pb.h"
 
@@ -35,16 +34,6 @@
 
 using namespace std;
 
-void add_dummy_interface( const string & name, const Address & addr )
-{
-    run( { IP, "link", "add", name, "type", "dummy" } );
-
-    interface_ioctl( SIOCSIFFLAGS, name,
-                     [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
-    interface_ioctl( SIOCSIFADDR, name,
-                     [&] ( ifreq &ifr ) { ifr.ifr_addr = addr.to_sockaddr(); } );
-}
-
 int main( int argc, char *argv[] )
 {
     try {
@@ -83,7 +72,8 @@ int main( int argc, char *argv[] )
 
         /* set egress and ingress ip addresses */
         Address egress_addr, ingress_addr;
-        tie( egress_addr, ingress_addr ) = two_unassigned_addresses();
+        AddressLease address_lease;
+        tie( egress_addr, ingress_addr ) = address_lease.addresses();
 
         /* make pair of devices */
         string egress_name = "veth-" + to_string( getpid() ), ingress_name = "veth-i" + to_string( getpid() );
@@ -166,6 +156,7 @@ int main( int argc, char *argv[] )
               }
 
               /* set up dummy interfaces */
+              vector< pair< string, Address > > dummy_interfaces;
               unsigned int interface_counter = 2;
               unsigned int squid_proxy_base_port = 3128;
               vector< Address > reverse_proxy_addresses;
@@ -180,24 +171,24 @@ int main( int argc, char *argv[] )
               string http_default_webserver_name = to_string( 1 ) + "default";
               string http_default_webserver_device_name = "default" + to_string( 1 );
               Address http_default_webserver_address = Address::reverse_proxy(1, 80);
-              add_dummy_interface( http_default_webserver_device_name, http_default_webserver_address);
+              dummy_interfaces.emplace_back( http_default_webserver_device_name, http_default_webserver_address);
               unique_ip_and_port.emplace(http_default_webserver_address);
 
               string http_default_reverse_proxy_name = to_string( 2 ) + "default";
               string http_default_reverse_proxy_device_name = "default" + to_string( 2 );
               Address http_default_reverse_proxy_address = Address::reverse_proxy(2, 80);
-              add_dummy_interface( http_default_reverse_proxy_device_name, http_default_reverse_proxy_address);
+              dummy_interfaces.emplace_back( http_default_reverse_proxy_device_name, http_default_reverse_proxy_address);
 
               string https_default_webserver_name = to_string( 3 ) + "default";
               string https_default_webserver_device_name = "default" + to_string( 3 );
               Address https_default_webserver_address = Address::reverse_proxy(3, 443);
-              add_dummy_interface( https_default_webserver_device_name, https_default_webserver_address);
+              dummy_interfaces.emplace_back( https_default_webserver_device_name, https_default_webserver_address);
               unique_ip_and_port.emplace(https_default_webserver_address);
 
               string https_default_reverse_proxy_name = to_string( 4 ) + "default";
               string https_default_reverse_proxy_device_name = "default" + to_string( 4 );
               Address https_default_reverse_proxy_address = Address::reverse_proxy(4, 443);
-              add_dummy_interface( https_default_reverse_proxy_device_name, https_default_reverse_proxy_address);
+              dummy_interfaces.emplace_back( https_default_reverse_proxy_device_name, https_default_reverse_proxy_address);
 
               name_resolution_pairs.push_back(make_pair(http_default_reverse_proxy_name, http_default_reverse_proxy_address));
               name_resolution_pairs.push_back(make_pair(https_default_reverse_proxy_name, https_default_reverse_proxy_address));
@@ -210,7 +201,7 @@ int main( int argc, char *argv[] )
 
                   // Setup the interface for each of the webserver.
                   if ( added_ip_addresses.count(address.ip()) == 0 ) {
-                    add_dummy_interface( "sharded" + to_string( interface_counter ), address );
+                    dummy_interfaces.emplace_back( "sharded" + to_string( interface_counter ), address );
                   }
                   added_ip_addresses.insert( address.ip() );
 
@@ -222,7 +213,7 @@ int main( int argc, char *argv[] )
                   string reverse_proxy_name = to_string( interface_counter ) + ".reverse.com";
                   string reverse_proxy_device_name = "reverse" + to_string( interface_counter );
                   Address reverse_proxy_address = Address::reverse_proxy(interface_counter + 1, address.port());
-                  add_dummy_interface( reverse_proxy_device_name, reverse_proxy_address);
+                  dummy_interfaces.emplace_back( reverse_proxy_device_name, reverse_proxy_address);
 
                   // Populuate name resolution pairs.
                   if (reverse_proxy_address.port() == 80) {
@@ -253,6 +244,8 @@ int main( int argc, char *argv[] )
 
               string escaped_page = argv[9];
 
+              add_dummy_interfaces( dummy_interfaces );
+
               /* set up web servers */
               vector< WebServer > servers;
               for ( const auto ip_port : unique_ip_and_port ) {
@@ -306,27 +299,18 @@ int main( int argc, char *argv[] )
                                     https_default_reverse_proxy_name,
                                     https_default_reverse_proxy_address);
 
-              /* set up DNS server */
-              TempFile dnsmasq_hosts( "/tmp/replayshell_hosts" );
-              uint8_t counter = 0;
+              /* names the DNS server will answer for */
               cout << "name_resolution_pairs.size(): " << to_string(name_resolution_pairs.size()) << endl;
               for ( const auto mapping : name_resolution_pairs ) {
                 cout << "IP: " << mapping.second.ip() << " domain: " << mapping.first << endl;
-                dnsmasq_hosts.write( mapping.second.ip() + " " + mapping.first + "\n" );
-                counter++;
               }
 
               /* initialize event loop */
               EventLoop event_loop;
 
-              /* create dummy interface for each nameserver */
+              /* answer for each nameserver */
               vector< Address > nameservers = all_nameservers();
-              vector< string > dnsmasq_args = { "-H", dnsmasq_hosts.name() };
-
-              for ( unsigned int server_num = 0; server_num < nameservers.size(); server_num++ ) {
-                  const string interface_name = "nameserver" + to_string( server_num );
-                  add_dummy_interface( interface_name, nameservers.at( server_num ) );
-              }
+              add_loopback_addresses( nameservers );
 
               /* set up DNAT between tunnel and the nameserver. */
               DNATWithPostrouting dnat( Address(nameservers[0].ip(), 53), "udp", 53 );
@@ -335,8 +319,9 @@ int main( int argc, char *argv[] )
               /* set up NAT between egress and eth0 */
               NAT nat_rule( nameservers[0] );
 
-              /* start dnsmasq */
-              event_loop.add_child_process( start_dnsmasq( dnsmasq_args ) );
+              /* set up DNS server */
+              DNSResponder dns_responder( Address( "0", "domain" ), name_resolution_pairs );
+              dns_responder.register_handlers( event_loop );
 
               string mode = argv[7];
 
@@ -345,15 +330,19 @@ int main( int argc, char *argv[] )
               vector< string > command;
 
               string path_prefix(PATH_PREFIX);
-              string path_to_security_files = "/etc/openvpn/";
-              VPN vpn(path_to_security_files, ingress_addr, nameservers);
+              unique_ptr< UDPTunnel > tunnel;
               string mapping_filename = path_prefix + "/bin/webserver_to_reverse_proxy.txt";
               ofstream webserver_ip_to_reverse_proxy_mapping_file;
               webserver_ip_to_reverse_proxy_mapping_file.open(mapping_filename);
               if (mode == "regular_replay") {
                 cout << "regular_replay" << endl;
-                vector< string > vpn_command = vpn.start_command();
-                command.insert(command.end(), vpn_command.begin(), vpn_command.end());
+                /* the phone connects straight to this namespace */
+                UDPSocket tunnel_socket;
+                tunnel_socket.bind( Address( ingress_addr.ip(), vpn_port ) );
+                const string tunnel_token = UDPTunnel::make_token();
+                cout << "Tunnel token: " << tunnel_token << endl;
+                tunnel.reset( new UDPTunnel( UDPTunnel::Role::Server, move( tunnel_socket ), "tun0", tunnel_token ) );
+                tunnel->register_handlers( event_loop );
               } else if (mode == "per_packet_delay") {
                 // Generate mapping between actual IP address and reverse proxy address.
                 for ( auto it = actual_ip_address_to_reverse_proxy_mapping.begin();
@@ -373,23 +362,25 @@ int main( int argc, char *argv[] )
                 command.push_back("bash");
               }
 
-              /* start shell */
-              event_loop.add_child_process( join( command ), [&]() {
-                      drop_privileges();
+              /* start shell (the tunnel needs none) */
+              if ( not command.empty() ) {
+                event_loop.add_child_process( join( command ), [&]() {
+                        drop_privileges();
 
-                      /* restore environment and tweak bash prompt */
-                      environ = user_environment;
-                      prepend_shell_prefix( "[proxy-replay] " );
+                        /* restore environment and tweak bash prompt */
+                        environ = user_environment;
+                        prepend_shell_prefix( "[proxy-replay] " );
 
-                      return ezexec( command, true );
-              } );
+                        return ezexec( command, true );
+                } );
+              }
 
             return event_loop.loop();
 
           }, true); /* new network namespace */
 
           /* give ingress to container */
-          run( { IP, "link", "set", "dev", ingress_name, "netns", to_string( container_process.pid() ) } );
+          move_to_namespace( ingress_name, container_process.pid() );
           veth_devices.set_kernel_will_destroy();
 
           /* tell ChildProcess it's ok to proceed */
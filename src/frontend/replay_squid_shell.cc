@@ -14,11 +14,10 @@
 #include "system_runner.hh"
 #include "socket.hh"
 #include "event_loop.hh"
-#include "temp_file.hh"
 #include "http_response.hh"
-#include "dns_server.hh"
+#include "dns_responder.hh"
 #include "exception.hh"
-#include "interfaces.hh"
+#include "address_lease.hh"
 #include "nat.hh"
 #include "socketpair.hh"
 #include "squid_proxy.hh"
@@ -29,16 +28,6 @@
 
 using namespace std;
 
-void add_dummy_interface( const string & name, const Address & addr )
-{
-    run( { IP, "link", "add", name, "type", "dummy" } );
-
-    interface_ioctl( SIOCSIFFLAGS, name,
-                     [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
-    interface_ioctl( SIOCSIFADDR, name,
-                     [&] ( ifreq &ifr ) { ifr.ifr_addr = addr.to_sockaddr(); } );
-}
-
 int main( int argc, char *argv[] )
 {
     try {
@@ -73,7 +62,8 @@ int main( int argc, char *argv[] )
 
         /* set egress and ingress ip addresses */
         Address egress_addr, ingress_addr;
-        tie( egress_addr, ingress_addr ) = two_unassigned_addresses();
+        AddressLease address_lease;
+        tie( egress_addr, ingress_addr ) = address_lease.addresses();
 
         /* make pair of devices */
         string egress_name = "veth-" + to_string( getpid() ), ingress_name = "veth-i" + to_string( getpid() );
@@ -156,12 +146,15 @@ int main( int argc, char *argv[] )
               }
 
               /* set up dummy interfaces */
+              vector< pair< string, Address > > dummy_interfaces;
               unsigned int interface_counter = 0;
               for ( const auto ip : unique_ip ) {
-                  add_dummy_interface( "sharded" + to_string( interface_counter ), ip );
+                  dummy_interfaces.emplace_back( "sharded" + to_string( interface_counter ), ip );
                   interface_counter++;
               }
 
+              add_dummy_interfaces( dummy_interfaces );
+
               /* set up web servers */
               vector< WebServer > servers;
               for ( const auto ip_port : unique_ip_and_port ) {
@@ -188,27 +181,16 @@ int main( int argc, char *argv[] )
 
               string path_prefix = PATH_PREFIX;
 
-              /* set up DNS server */
-              TempFile dnsmasq_hosts( "/tmp/replayshell_hosts" );
-              cout << "DNS Filename: " << dnsmasq_hosts.name() << endl;
-              for ( const auto mapping : hostname_to_ip ) {
-                dnsmasq_hosts.write( mapping.second.ip() + " " + mapping.first + "\n" );
-              }
-
               /* initialize event loop */
               EventLoop event_loop;
 
-              /* create dummy interface for each nameserver */
+              /* answer for each nameserver */
               vector< Address > nameservers = all_nameservers();
-              vector< string > dnsmasq_args = { "-H", dnsmasq_hosts.name() };
+              add_loopback_addresses( nameservers );
 
-              for ( unsigned int server_num = 0; server_num < nameservers.size(); server_num++ ) {
-                  const string interface_name = "nameserver" + to_string( server_num );
-                  add_dummy_interface( interface_name, nameservers.at( server_num ) );
-              }
-
-              /* start dnsmasq */
-              event_loop.add_child_process( start_dnsmasq( dnsmasq_args ) );
+              /* set up DNS server */
+              DNSResponder dns_responder( Address( "0", "domain" ), hostname_to_ip );
+              dns_responder.register_handlers( event_loop );
 
               Address squid_address("0.0.0.0", 3128);
               SquidProxy squid_proxy(squid_address, false);
@@ -230,7 +212,7 @@ int main( int argc, char *argv[] )
           }, true); /* new network namespace */
 
           /* give ingress to container */
-          run( { IP, "link", "set", "dev", ingress_name, "netns", to_string( container_process.pid() ) } );
+          move_to_namespace( ingress_name, container_process.pid() );
           veth_devices.set_kernel_will_destroy();
 
           /* tell ChildProcess it's ok to proceed */
@@ -6,14 +6,13 @@
 #include <set>
 #include <vector>
 
-#include "dns_server.hh"
+#include "dns_responder.hh"
 #include "event_loop.hh"
 #include "exception.hh"
 #include "http_response.hh"
 #include "netdevice.hh"
 #include "socket.hh"
 #include "system_runner.hh"
-#include "temp_file.hh"
 #include "util.hh"
 #include "web_server.hh"
 
@@ -23,15 +22,6 @@
 
 using namespace std;
 
-void add_dummy_interface(const string &name, const Address &addr) {
-  run({IP, "link", "add", name, "type", "dummy"});
-
-  interface_ioctl(SIOCSIFFLAGS, name,
-                  [](ifreq &ifr) { ifr.ifr_flags = IFF_UP; });
-  interface_ioctl(SIOCSIFADDR, name,
-                  [&](ifreq &ifr) { ifr.ifr_addr = addr.to_sockaddr(); });
-}
-
 int main(int argc, char *argv[]) {
   try {
     /* clear environment */
@@ -117,40 +107,35 @@ int main(int argc, char *argv[]) {
     }
 
     /* set up dummy interfaces */
+    vector<pair<string, Address>> dummy_interfaces;
     unsigned int interface_counter = 0;
     for (const auto ip : unique_ip) {
-      add_dummy_interface("sharded" + to_string(interface_counter), ip);
+      dummy_interfaces.emplace_back("sharded" + to_string(interface_counter),
+                                    ip);
       interface_counter++;
     }
 
+    add_dummy_interfaces(dummy_interfaces);
+
     /* set up web servers */
     vector<WebServer> servers;
     for (const auto ip_port : unique_ip_and_port) {
       servers.emplace_back(ip_port, working_directory, directory);
     }
 
-    /* set up DNS server */
-    TempFile dnsmasq_hosts("/tmp/replayshell_hosts");
-    for (const auto mapping : hostname_to_ip) {
-      dnsmasq_hosts.write(mapping.second.ip() + " " + mapping.first + "\n");
-    }
-
     /* initialize event loop */
     EventLoop event_loop;
 
-    /* create dummy interface for each nameserver */
+    /* answer for each nameserver */
     vector<Address> nameservers = all_nameservers();
-    vector<string> dnsmasq_args = {"-H", dnsmasq_hosts.name()};
-
-    for (unsigned int server_num = 0; server_num < nameservers.size();
-         server_num++) {
-      const string interface_name = "nameserver" + to_string(server_num);
-      cout << "Nameserver: " << nameservers.at(server_num).ip() << endl;
-      add_dummy_interface(interface_name, nameservers.at(server_num));
+    for (const auto &nameserver : nameservers) {
+      cout << "Nameserver: " << nameserver.ip() << endl;
     }
+    add_loopback_addresses(nameservers);
 
-    /* start dnsmasq */
-    event_loop.add_child_process(start_dnsmasq(dnsmasq_args));
+    /* set up DNS server */
+    DNSResponder dns_responder(Address("0", "domain"), hostname_to_ip);
+    dns_responder.register_handlers(event_loop);
 
     /* start shell */
     event_loop.add_child_process(join(command), [&]() {
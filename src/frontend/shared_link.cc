@@ -0,0 +1,303 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* mm-shared-link: one emulated link whose capacity is shared by
+   every mm-shared-link-shell connected to it. Each shell hands over
+   its two TUN devices; all of them are served from a single event loop. */
+
+#include <map>
+#include <memory>
+#include <iostream>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "infinite_packet_queue.hh"
+#include "drop_tail_packet_queue.hh"
+#include "drop_head_packet_queue.hh"
+#include "codel_packet_queue.hh"
+#include "pie_packet_queue.hh"
+#include "shared_link_queue.hh"
+#include "event_loop.hh"
+#include "socketpair.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " SOCKET-PATH UPLINK-TRACE DOWNLINK-TRACE [OPTION]..." << endl;
+    cerr << endl;
+    cerr << "Options = --scheduler=fair|fifo" << endl;
+    cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME" << endl;
+    cerr << "          --uplink-queue=QUEUE_TYPE --downlink-queue=QUEUE_TYPE" << endl;
+    cerr << "          --uplink-queue-args=QUEUE_ARGS --downlink-queue-args=QUEUE_ARGS" << endl;
+    cerr << endl;
+    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie (one queue per shell)" << endl;
+    cerr << "          QUEUE_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\"" << endl;
+    cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst)" << endl;
+    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+SharedLinkQueue::QueueMaker get_packet_queue_maker( const string & type, const string & args, const string & program_name )
+{
+    if ( type == "infinite" ) {
+        return [args] () { return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( args ) ); };
+    } else if ( type == "droptail" ) {
+        return [args] () { return unique_ptr<AbstractPacketQueue>( new DropTailPacketQueue( args ) ); };
+    } else if ( type == "drophead" ) {
+        return [args] () { return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) ); };
+    } else if ( type == "codel" ) {
+        return [args] () { return unique_ptr<AbstractPacketQueue>( new CODELPacketQueue( args ) ); };
+    } else if ( type == "pie" ) {
+        return [args] () { return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args ) ); };
+    } else {
+        cerr << "Unknown queue type: " << type << endl;
+    }
+
+    usage_error( program_name );
+
+    return nullptr;
+}
+
+class SharedLink : public EventLoop
+{
+private:
+    struct Client
+    {
+        UnixDomainSocket connection;
+
+        /* received from the shell, in this order */
+        unique_ptr<FileDescriptor> egress_tun {};
+        unique_ptr<FileDescriptor> ingress_tun {};
+
+        bool finished { false };
+
+        Client( UnixDomainSocket && s_connection ) : connection( move( s_connection ) ) {}
+    };
+
+    SharedLinkQueue & uplink_;
+    SharedLinkQueue & downlink_;
+
+    unsigned int next_client_id_ { 0 };
+    map<unsigned int, unique_ptr<Client>> clients_ {};
+
+    void add_client( UnixDomainSocket && connection );
+    void start_ferrying( const unsigned int id, Client & client );
+    void remove_finished_clients( void );
+
+public:
+    SharedLink( SharedLinkQueue & uplink, SharedLinkQueue & downlink )
+        : uplink_( uplink ), downlink_( downlink ) {}
+
+    int loop( UnixDomainSocket & listener );
+};
+
+void SharedLink::add_client( UnixDomainSocket && connection )
+{
+    const unsigned int id = next_client_id_++;
+    Client & client = *clients_.emplace( id, unique_ptr<Client>( new Client( move( connection ) ) ) ).first->second;
+
+    /* collect the shell's TUN devices; the shell closing the connection means it has exited */
+    add_action( Poller::Action( client.connection, Direction::In,
+                                [this, id, &client] () {
+                                    if ( not client.egress_tun ) {
+                                        client.egress_tun.reset( new FileDescriptor( client.connection.recv_fd() ) );
+                                    } else {
+                                        client.ingress_tun.reset( new FileDescriptor( client.connection.recv_fd() ) );
+                                        start_ferrying( id, client );
+                                    }
+                                    return ResultType::Continue;
+                                },
+                                [&client] () { return not client.ingress_tun; },
+                                [&client] () { client.finished = true; } ) );
+}
+
+void SharedLink::start_ferrying( const unsigned int id, Client & client )
+{
+    FileDescriptor & egress_tun = *client.egress_tun;
+    FileDescriptor & ingress_tun = *client.ingress_tun;
+
+    uplink_.add_client( id );
+    downlink_.add_client( id );
+
+    /* shell sends a datagram -> uplink; Internet sends a datagram -> downlink */
+    add_simple_input_handler( ingress_tun,
+                              [this, id, &ingress_tun] () {
+                                  uplink_.read_packet( id, ingress_tun.read() );
+                                  return ResultType::Continue;
+                              } );
+
+    add_simple_input_handler( egress_tun,
+                              [this, id, &egress_tun] () {
+                                  downlink_.read_packet( id, egress_tun.read() );
+                                  return ResultType::Continue;
+                              } );
+
+    /* departures from the shared link -> the other side of the client's shell */
+    add_action( Poller::Action( egress_tun, Direction::Out,
+                                [this, id, &egress_tun] () {
+                                    uplink_.write_packets( id, egress_tun );
+                                    return ResultType::Continue;
+                                },
+                                [this, id] () { return uplink_.pending_output( id ); } ) );
+
+    add_action( Poller::Action( ingress_tun, Direction::Out,
+                                [this, id, &ingress_tun] () {
+                                    downlink_.write_packets( id, ingress_tun );
+                                    return ResultType::Continue;
+                                },
+                                [this, id] () { return downlink_.pending_output( id ); } ) );
+}
+
+void SharedLink::remove_finished_clients( void )
+{
+    for ( auto it = clients_.begin(); it != clients_.end(); ) {
+        Client & client = *it->second;
+
+        if ( not client.finished ) {
+            it++;
+            continue;
+        }
+
+        remove_actions( client.connection );
+
+        if ( client.ingress_tun ) {
+            remove_actions( *client.egress_tun );
+            remove_actions( *client.ingress_tun );
+            uplink_.remove_client( it->first );
+            downlink_.remove_client( it->first );
+        }
+
+        it = clients_.erase( it );
+    }
+}
+
+int SharedLink::loop( UnixDomainSocket & listener )
+{
+    add_simple_input_handler( listener,
+                              [&] () {
+                                  add_client( listener.accept() );
+                                  return ResultType::Continue;
+                              } );
+
+    return internal_loop( [&] () {
+            remove_finished_clients();
+            return min( uplink_.wait_time(), downlink_.wait_time() );
+        } );
+}
+
+/* removes the socket file when the link shuts down */
+class SocketPath
+{
+private:
+    string path_;
+
+public:
+    SocketPath( const string & path ) : path_( path ) {}
+
+    ~SocketPath()
+    {
+        if ( unlink( path_.c_str() ) < 0 ) {
+            perror( ( "unlink " + path_ ).c_str() );
+        }
+    }
+
+    /* forbid copying */
+    SocketPath( const SocketPath & other ) = delete;
+    SocketPath & operator=( const SocketPath & other ) = delete;
+};
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* the link never needs privileges: the shells hand it their TUN devices */
+        assert_not_root();
+
+        const option command_line_options[] = {
+            { "scheduler",            required_argument, nullptr, 's' },
+            { "uplink-log",           required_argument, nullptr, 'u' },
+            { "downlink-log",         required_argument, nullptr, 'd' },
+            { "uplink-queue",         required_argument, nullptr, 'q' },
+            { "downlink-queue",       required_argument, nullptr, 'w' },
+            { "uplink-queue-args",    required_argument, nullptr, 'a' },
+            { "downlink-queue-args",  required_argument, nullptr, 'b' },
+            { 0,                                      0, nullptr, 0 }
+        };
+
+        SharedLinkQueue::Scheduler scheduler = SharedLinkQueue::Scheduler::Fair;
+        string uplink_logfile, downlink_logfile;
+        string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
+               uplink_queue_args, downlink_queue_args;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "u:d:", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 's':
+                if ( string( optarg ) == "fair" ) {
+                    scheduler = SharedLinkQueue::Scheduler::Fair;
+                } else if ( string( optarg ) == "fifo" ) {
+                    scheduler = SharedLinkQueue::Scheduler::FIFO;
+                } else {
+                    usage_error( argv[ 0 ] );
+                }
+                break;
+            case 'u':
+                uplink_logfile = optarg;
+                break;
+            case 'd':
+                downlink_logfile = optarg;
+                break;
+            case 'q':
+                uplink_queue_type = optarg;
+                break;
+            case 'w':
+                downlink_queue_type = optarg;
+                break;
+            case 'a':
+                uplink_queue_args = optarg;
+                break;
+            case 'b':
+                downlink_queue_args = optarg;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 3 != argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const string socket_path = argv[ optind ];
+        const string uplink_filename = argv[ optind + 1 ];
+        const string downlink_filename = argv[ optind + 2 ];
+
+        SharedLinkQueue uplink( "Uplink", uplink_filename, uplink_logfile, scheduler,
+                                get_packet_queue_maker( uplink_queue_type, uplink_queue_args, argv[ 0 ] ) );
+        SharedLinkQueue downlink( "Downlink", downlink_filename, downlink_logfile, scheduler,
+                                  get_packet_queue_maker( downlink_queue_type, downlink_queue_args, argv[ 0 ] ) );
+
+        /* only the user's own shells may join the link */
+        UnixDomainSocket listener = UnixDomainSocket::listen_at( socket_path );
+        SocketPath socket_path_cleanup( socket_path );
+        SystemCall( "chmod", chmod( socket_path.c_str(), 0600 ) );
+
+        SharedLink shared_link( uplink, downlink );
+        return shared_link.loop( listener );
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
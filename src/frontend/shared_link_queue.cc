@@ -0,0 +1,300 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <limits>
+#include <cassert>
+#include <iostream>
+
+#include "shared_link_queue.hh"
+#include "timestamp.hh"
+#include "util.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+SharedLinkQueue::SharedLinkQueue( const string & link_name, const string & filename, const string & logfile,
+                                  const Scheduler scheduler, const QueueMaker & make_packet_queue )
+    : next_delivery_( 0 ),
+      schedule_(),
+      base_timestamp_( timestamp() ),
+      scheduler_( scheduler ),
+      make_packet_queue_( make_packet_queue ),
+      clients_(),
+      current_client_( 0 ),
+      packet_in_transit_client_( 0 ),
+      packet_in_transit_( "", 0 ),
+      packet_in_transit_bytes_left_( 0 ),
+      log_()
+{
+    assert_not_root();
+
+    /* open filename and load schedule */
+    ifstream trace_file( filename );
+
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename + ": invalid empty line" );
+        }
+
+        const uint64_t ms = myatoi( line );
+
+        if ( not schedule_.empty() ) {
+            if ( ms < schedule_.back() ) {
+                throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
+            }
+        }
+
+        schedule_.emplace_back( ms );
+    }
+
+    if ( schedule_.empty() ) {
+        throw runtime_error( filename + ": no valid timestamps found" );
+    }
+
+    if ( schedule_.back() == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+
+    /* open logfile if called for (same format as mm-link, for all clients together) */
+    if ( not logfile.empty() ) {
+        log_.reset( new ofstream( logfile ) );
+        if ( not log_->good() ) {
+            throw runtime_error( logfile + ": error opening for writing" );
+        }
+
+        *log_ << "# mahimahi mm-shared-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
+        *log_ << "# scheduler: " << ( scheduler_ == Scheduler::Fair ? "fair" : "fifo" ) << endl;
+        *log_ << "# init timestamp: " << initial_timestamp() << endl;
+        *log_ << "# base timestamp: " << base_timestamp_ << endl;
+    }
+}
+
+void SharedLinkQueue::add_client( const unsigned int id )
+{
+    rationalize( timestamp() );
+
+    if ( not clients_.emplace( id, Client( make_packet_queue_() ) ).second ) {
+        throw runtime_error( "SharedLinkQueue: duplicate client " + to_string( id ) );
+    }
+}
+
+void SharedLinkQueue::remove_client( const unsigned int id )
+{
+    rationalize( timestamp() );
+
+    /* a half-sent packet of this client's is lost */
+    if ( packet_in_transit_bytes_left_ and packet_in_transit_client_ == id ) {
+        packet_in_transit_bytes_left_ = 0;
+    }
+
+    clients_.erase( id );
+}
+
+void SharedLinkQueue::read_packet( const unsigned int id, const string & contents )
+{
+    const uint64_t now = timestamp();
+
+    rationalize( now );
+
+    if ( log_ ) {
+        *log_ << now << " + " << contents.size() << endl;
+    }
+
+    Client & client = clients_.at( id );
+
+    /* one shell's oversized packet mustn't take down the link for everyone */
+    if ( contents.size() > PACKET_SIZE ) {
+        if ( not client.reported_oversized ) {
+            cerr << "mm-shared-link: dropping packets from shell " << id << " larger than "
+                 << PACKET_SIZE << " bytes" << endl;
+            client.reported_oversized = true;
+        }
+
+        if ( log_ ) {
+            *log_ << now << " d 1 " << contents.size() << endl;
+        }
+        return;
+    }
+
+    AbstractPacketQueue & packet_queue = *client.packet_queue;
+
+    const unsigned int bytes_before = packet_queue.size_bytes();
+    const unsigned int packets_before = packet_queue.size_packets();
+
+    packet_queue.enqueue( QueuedPacket( contents, now ) );
+
+    const unsigned int missing_packets = packets_before + 1 - packet_queue.size_packets();
+    const unsigned int missing_bytes = bytes_before + contents.size() - packet_queue.size_bytes();
+    if ( log_ and ( missing_packets > 0 or missing_bytes > 0 ) ) {
+        *log_ << now << " d " << missing_packets << " " << missing_bytes << endl;
+    }
+}
+
+uint64_t SharedLinkQueue::next_delivery_time( void ) const
+{
+    return schedule_.at( next_delivery_ ) + base_timestamp_;
+}
+
+void SharedLinkQueue::use_a_delivery_opportunity( void )
+{
+    if ( log_ ) {
+        *log_ << next_delivery_time() << " # " << PACKET_SIZE << endl;
+    }
+
+    next_delivery_ = (next_delivery_ + 1) % schedule_.size();
+
+    /* wraparound (the shared link always repeats its trace) */
+    if ( next_delivery_ == 0 ) {
+        base_timestamp_ += schedule_.back();
+    }
+}
+
+bool SharedLinkQueue::fill_head( Client & client )
+{
+    if ( not client.head and not client.packet_queue->empty() ) {
+        client.head.reset( new QueuedPacket( client.packet_queue->dequeue() ) );
+    }
+
+    return bool( client.head );
+}
+
+/* deficit round robin: on its turn, each client may send up to
+   PACKET_SIZE bytes more than it has sent, so clients get equal
+   shares of the bytes whatever their packet sizes */
+bool SharedLinkQueue::next_packet_fair( void )
+{
+    for ( unsigned int visits = 0; visits <= 2 * clients_.size(); visits++ ) {
+        auto it = clients_.lower_bound( current_client_ );
+        if ( it == clients_.end() ) {
+            it = clients_.begin();
+        }
+        current_client_ = it->first;
+
+        Client & client = it->second;
+        if ( not fill_head( client ) ) {
+            /* idle clients don't save up credit */
+            client.deficit = 0;
+        } else if ( client.deficit >= client.head->contents.size() ) {
+            client.deficit -= client.head->contents.size();
+            packet_in_transit_client_ = it->first;
+            packet_in_transit_ = move( *client.head );
+            client.head.reset();
+            return true;
+        }
+
+        /* next client's turn */
+        if ( ++it == clients_.end() ) {
+            it = clients_.begin();
+        }
+        current_client_ = it->first;
+        it->second.deficit += PACKET_SIZE;
+    }
+
+    return false;
+}
+
+/* one queue for everyone, in order of arrival */
+bool SharedLinkQueue::next_packet_fifo( void )
+{
+    auto earliest = clients_.end();
+
+    for ( auto it = clients_.begin(); it != clients_.end(); it++ ) {
+        if ( fill_head( it->second )
+             and ( earliest == clients_.end()
+                   or it->second.head->arrival_time < earliest->second.head->arrival_time ) ) {
+            earliest = it;
+        }
+    }
+
+    if ( earliest == clients_.end() ) {
+        return false;
+    }
+
+    packet_in_transit_client_ = earliest->first;
+    packet_in_transit_ = move( *earliest->second.head );
+    earliest->second.head.reset();
+    return true;
+}
+
+bool SharedLinkQueue::next_packet( void )
+{
+    if ( clients_.empty() ) {
+        return false;
+    }
+
+    return scheduler_ == Scheduler::Fair ? next_packet_fair() : next_packet_fifo();
+}
+
+/* emulate the link up to the given timestamp */
+void SharedLinkQueue::rationalize( const uint64_t now )
+{
+    while ( next_delivery_time() <= now ) {
+        const uint64_t this_delivery_time = next_delivery_time();
+
+        /* burn a delivery opportunity */
+        unsigned int bytes_left_in_this_delivery = PACKET_SIZE;
+        use_a_delivery_opportunity();
+
+        while ( bytes_left_in_this_delivery > 0 ) {
+            if ( not packet_in_transit_bytes_left_ ) {
+                if ( not next_packet() ) {
+                    break;
+                }
+                packet_in_transit_bytes_left_ = packet_in_transit_.contents.size();
+            }
+
+            assert( packet_in_transit_bytes_left_ <= PACKET_SIZE );
+
+            /* how many bytes of the delivery opportunity can we use? */
+            const unsigned int amount_to_send = min( bytes_left_in_this_delivery,
+                                                     packet_in_transit_bytes_left_ );
+
+            packet_in_transit_bytes_left_ -= amount_to_send;
+            bytes_left_in_this_delivery -= amount_to_send;
+
+            /* has the packet been fully sent? */
+            if ( packet_in_transit_bytes_left_ == 0 ) {
+                if ( log_ ) {
+                    *log_ << this_delivery_time << " - " << packet_in_transit_.contents.size()
+                          << " " << this_delivery_time - packet_in_transit_.arrival_time << endl;
+                }
+
+                /* this packet is ready to go */
+                clients_.at( packet_in_transit_client_ ).output_queue.push( move( packet_in_transit_.contents ) );
+            }
+        }
+    }
+}
+
+void SharedLinkQueue::write_packets( const unsigned int id, FileDescriptor & fd )
+{
+    auto & output_queue = clients_.at( id ).output_queue;
+
+    while ( not output_queue.empty() ) {
+        fd.write( output_queue.front() );
+        output_queue.pop();
+    }
+}
+
+unsigned int SharedLinkQueue::wait_time( void )
+{
+    const auto now = timestamp();
+
+    rationalize( now );
+
+    if ( next_delivery_time() <= now ) {
+        return 0;
+    } else {
+        return next_delivery_time() - now;
+    }
+}
+
+bool SharedLinkQueue::pending_output( const unsigned int id ) const
+{
+    return not clients_.at( id ).output_queue.empty();
+}
@@ -0,0 +1,96 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef SHARED_LINK_QUEUE_HH
+#define SHARED_LINK_QUEUE_HH
+
+#include <queue>
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <functional>
+
+#include "file_descriptor.hh"
+#include "abstract_packet_queue.hh"
+
+/* one direction of a link whose capacity (given by a trace, as in
+   LinkQueue) is shared by several clients, each with its own queue */
+class SharedLinkQueue
+{
+public:
+    enum class Scheduler { Fair, FIFO };
+
+    typedef std::function<std::unique_ptr<AbstractPacketQueue>( void )> QueueMaker;
+
+private:
+    const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
+
+    struct Client
+    {
+        std::unique_ptr<AbstractPacketQueue> packet_queue;
+
+        /* packet taken from packet_queue but not yet scheduled */
+        std::unique_ptr<QueuedPacket> head;
+
+        /* deficit round robin: bytes this client may still send this round */
+        unsigned int deficit;
+
+        std::queue<std::string> output_queue;
+
+        /* has this client's first oversized packet been reported? */
+        bool reported_oversized;
+
+        Client( std::unique_ptr<AbstractPacketQueue> && s_packet_queue )
+            : packet_queue( std::move( s_packet_queue ) ), head(), deficit( 0 ), output_queue(),
+              reported_oversized( false ) {}
+    };
+
+    unsigned int next_delivery_;
+    std::vector<uint64_t> schedule_;
+    uint64_t base_timestamp_;
+
+    Scheduler scheduler_;
+    QueueMaker make_packet_queue_;
+
+    std::map<unsigned int, Client> clients_;
+
+    /* fair scheduler's position in the round */
+    unsigned int current_client_;
+
+    unsigned int packet_in_transit_client_;
+    QueuedPacket packet_in_transit_;
+    unsigned int packet_in_transit_bytes_left_;
+
+    std::unique_ptr<std::ofstream> log_;
+
+    uint64_t next_delivery_time( void ) const;
+
+    void use_a_delivery_opportunity( void );
+
+    /* pick the client whose packet goes on the link next */
+    bool next_packet( void );
+    bool next_packet_fair( void );
+    bool next_packet_fifo( void );
+    bool fill_head( Client & client );
+
+    void rationalize( const uint64_t now );
+
+public:
+    SharedLinkQueue( const std::string & link_name, const std::string & filename, const std::string & logfile,
+                     const Scheduler scheduler, const QueueMaker & make_packet_queue );
+
+    void add_client( const unsigned int id );
+    void remove_client( const unsigned int id );
+
+    void read_packet( const unsigned int id, const std::string & contents );
+
+    void write_packets( const unsigned int id, FileDescriptor & fd );
+
+    unsigned int wait_time( void );
+
+    bool pending_output( const unsigned int id ) const;
+};
+
+#endif /* SHARED_LINK_QUEUE_HH */
@@ -0,0 +1,46 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <vector>
+#include <string>
+
+#include "shared_link_queue.hh"
+#include "packetshell.cc"
+
+using namespace std;
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment while running as root */
+        char ** const user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        if ( argc < 2 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " socket-path [command...]" );
+        }
+
+        const string socket_path( argv[ 1 ] );
+
+        vector< string > command;
+
+        if ( argc == 2 ) {
+            command.push_back( shell_path() );
+        } else {
+            for ( int i = 2; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        }
+
+        /* the packets are ferried by mm-shared-link, not by this process */
+        PacketShell<SharedLinkQueue> shared_link_shell_app( "shared", user_environment );
+
+        shared_link_shell_app.start_shared_link( "[shared link] ", command, socket_path );
+
+        return shared_link_shell_app.wait_for_exit();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,96 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <net/route.h>
+
+#include "udp_tunnel.hh"
+#include "util.hh"
+#include "ezio.hh"
+#include "netdevice.hh"
+#include "event_loop.hh"
+#include "exception.hh"
+#include "system_runner.hh"
+
+using namespace std;
+
+/* the phone's end of a shell's UDPTunnel, for use without a phone: runs
+   a command in a namespace whose only route is through the tunnel */
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment */
+        char **user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        if ( argc < 3 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " server-ip token [port [command...]]" );
+        }
+
+        /* (the token the shell printed when it started) */
+        const string token = argv[ 2 ];
+
+        const uint16_t port = argc > 3 ? myatoi( argv[ 3 ] ) : UDPTunnel::DEFAULT_PORT;
+
+        vector< string > command;
+
+        if ( argc <= 4 ) {
+            command.push_back( shell_path() );
+        } else {
+            for ( int i = 4; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        }
+
+        /* the tunnel's own datagrams go over the network we're in now */
+        UDPSocket tunnel_socket;
+        tunnel_socket.connect( Address( argv[ 1 ], port ) );
+
+        EventLoop outer_event_loop;
+
+        outer_event_loop.add_child_process( "tunnel-client", [&]() {
+                /* bring up localhost */
+                interface_ioctl( SIOCSIFFLAGS, "lo",
+                                 [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
+
+                UDPTunnel tunnel( UDPTunnel::Role::Client, move( tunnel_socket ), "tun0", token );
+
+                /* create default route */
+                rtentry route;
+                zero( route );
+
+                route.rt_gateway = UDPTunnel::server_address().to_sockaddr();
+                route.rt_dst = route.rt_genmask = Address().to_sockaddr();
+                route.rt_flags = RTF_UP | RTF_GATEWAY;
+
+                SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
+
+                /* Fork again after dropping root privileges */
+                drop_privileges();
+
+                /* prepare child's event loop */
+                EventLoop shell_event_loop;
+
+                tunnel.register_handlers( shell_event_loop );
+
+                shell_event_loop.add_child_process( join( command ), [&]() {
+                        /* restore environment and tweak prompt */
+                        environ = user_environment;
+                        prepend_shell_prefix( "[tunnel] " );
+
+                        return ezexec( command, true );
+                    } );
+
+                return shell_event_loop.loop();
+            }, true ); /* new network namespace */
+
+        return outer_event_loop.loop();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
@@ -1,24 +1,42 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <iostream>
+#include <limits>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
 
 #include "backing_store.hh"
 #include "http_record.pb.h"
 #include "temp_file.hh"
 
 using namespace std;
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+/* the encoded size of one of the request/response's message fields */
+size_t message_field_size(const int field_number, const HTTPMessage &message) {
+  return WireFormatLite::TagSize(field_number, WireFormatLite::TYPE_MESSAGE) +
+         WireFormatLite::LengthDelimitedSize(message.protobuf_size());
+}
+
+/* one of the request/response's message fields (whose size save() has
+   checked will fit) */
+void write_message_field(google::protobuf::io::CodedOutputStream &output,
+                         const int field_number, const HTTPMessage &message) {
+  WireFormatLite::WriteTag(field_number,
+                           WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+  output.WriteVarint32(message.protobuf_size());
+  message.write_protobuf(output);
+}
+}
 
 HTTPDiskStore::HTTPDiskStore(const string &record_folder)
-    : record_folder_(record_folder), mutex_() {}
+    : record_folder_(record_folder) {}
 
 void HTTPDiskStore::save(const HTTPResponse &response,
                          const Address &server_address) {
-  unique_lock<mutex> ul(mutex_);
-
-  /* output file to write current request/response pair protobuf (user has all
-   * permissions) */
-  UniqueFile file(record_folder_ + "save");
-
   /* construct protocol buffer */
   MahimahiProtobufs::RequestResponse output;
 
@@ -27,10 +45,47 @@ void HTTPDiskStore::save(const HTTPResponse &response,
   output.set_scheme(server_address.port() == 443
                         ? MahimahiProtobufs::RequestResponse_Scheme_HTTPS
                         : MahimahiProtobufs::RequestResponse_Scheme_HTTP);
-  output.mutable_request()->CopyFrom(response.request().toprotobuf());
-  output.mutable_response()->CopyFrom(response.toprotobuf());
 
-  if (not output.SerializeToFileDescriptor(file.fd().fd_num())) {
+  /* a spilled body can be larger than a protobuf can hold (and than a
+     32-bit length can describe), so refuse before writing anything */
+  const size_t record_size =
+      output.ByteSizeLong() +
+      message_field_size(
+          MahimahiProtobufs::RequestResponse::kRequestFieldNumber,
+          response.request()) +
+      message_field_size(
+          MahimahiProtobufs::RequestResponse::kResponseFieldNumber, response);
+  if (record_size > size_t(numeric_limits<int>::max())) {
+    throw runtime_error("save_to_disk: " + response.request().first_line() +
+                        ": too large to record (" + to_string(record_size) +
+                        " bytes)");
+  }
+
+  /* output file to write current request/response pair protobuf (user has all
+   * permissions); each save gets a file of its own, so saves from different
+   * connections don't need to wait for each other */
+  UniqueFile file(record_folder_ + "save");
+
+  /* the request and response are written after the other fields straight
+     from the messages, rather than copied into the protobuf */
+  google::protobuf::io::FileOutputStream file_stream(file.fd().fd_num());
+  {
+    google::protobuf::io::CodedOutputStream coded_stream(&file_stream);
+    output.SerializeToCodedStream(&coded_stream);
+    write_message_field(coded_stream,
+                        MahimahiProtobufs::RequestResponse::kRequestFieldNumber,
+                        response.request());
+    write_message_field(
+        coded_stream, MahimahiProtobufs::RequestResponse::kResponseFieldNumber,
+        response);
+
+    if (coded_stream.HadError()) {
+      throw runtime_error(
+          "save_to_disk: failure to serialize HTTP request/response pair");
+    }
+  }
+
+  if (not file_stream.Flush()) {
     throw runtime_error(
         "save_to_disk: failure to serialize HTTP request/response pair");
   }
@@ -3,7 +3,6 @@
 #ifndef BACKING_STORE_HH
 #define BACKING_STORE_HH
 
-#include <mutex>
 #include <string>
 
 #include "address.hh"
@@ -22,7 +21,6 @@ public:
 class HTTPDiskStore : public HTTPBackingStore {
 private:
   std::string record_folder_;
-  std::mutex mutex_;
 
 public:
   HTTPDiskStore(const std::string &record_folder);
@@ -1,123 +1,120 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <cassert>
+#include <cstring>
 
 #include "ezio.hh"
 #include "chunked_parser.hh"
 
 using namespace std;
 
-/* Take a chunk header and parse it assuming no folding */
-uint32_t ChunkedBodyParser::get_chunk_size( const string & chunk_hdr ) const
+namespace {
+    /* longest chunk-size or trailer line we will hold on to */
+    const size_t MAX_LINE_LENGTH = 16384;
+}
+
+bool ChunkedBodyParser::read_line( const string & input, size_t & pos )
 {
-    /* Check that the chunk header ends with a CRLF */
-    assert(chunk_hdr.substr( chunk_hdr.length() - 2, 2 ) == "\r\n" );
+    const void * newline = memchr( input.data() + pos, '\n', input.size() - pos );
+    const size_t end = newline ? static_cast<const char *>( newline ) - input.data() : input.size();
 
-    /* If there are chunk extensions, ';' terminates chunk size */
-    auto pos = chunk_hdr.find( ";" );
+    line_.append( input, pos, end - pos );
+    if ( line_.size() > MAX_LINE_LENGTH ) {
+        throw runtime_error( "ChunkedBodyParser: line too long" );
+    }
 
-    /* There are no ';'s, and hence no chunk externsions, CRLF terminates chunk size */
-    if ( pos == string::npos ) {
-        pos = chunk_hdr.find( "\r\n" );
+    if ( not newline ) {
+        pos = input.size();
+        return false;
     }
 
-    /* Can't be npos even now */
-    assert( pos != string::npos );
+    pos = end + 1;
 
-    /* Parse hex string, after removing trailing spaces (RFC 2616 Section 2.1) */
-    auto hex_string = chunk_hdr.substr( 0, pos );
-    auto space_loc = hex_string.find( " " );
-    if ( space_loc != string::npos ) hex_string.erase( space_loc, hex_string.length() - space_loc );
-    return myatoi( hex_string, 16 );
+    /* lines end in CRLF, but a bare LF is tolerated (RFC 7230 section 3.5) */
+    if ( not line_.empty() and line_.back() == '\r' ) {
+        line_.pop_back();
+    }
+
+    return true;
+}
+
+void ChunkedBodyParser::finish_chunk_size_line( void )
+{
+    /* chunk-size, then optional whitespace and chunk extensions, which are ignored */
+    const size_t digits = line_.find_first_not_of( "0123456789abcdefABCDEF" );
+    const size_t length = digits == string::npos ? line_.size() : digits;
+
+    if ( length == 0 ) {
+        throw runtime_error( "ChunkedBodyParser: invalid chunk header: " + line_ );
+    } else if ( length > 15 ) {
+        throw runtime_error( "ChunkedBodyParser: chunk too large: " + line_ );
+    }
+
+    chunk_remaining_ = myatoi( line_.substr( 0, length ), 16 );
+    state_ = ( chunk_remaining_ == 0 ) ? TRAILER : CHUNK_DATA;
 }
 
 string::size_type ChunkedBodyParser::read( const std::string & input_buffer )
 {
-    parser_buffer_ += input_buffer;
-
-    while ( !parser_buffer_.empty() ) {
-        switch (state_) {
-        case CHUNK_HDR: {
-            auto it = parser_buffer_.find( "\r\n" );
-            if (it != string::npos) {
-                /* if you have CRLF, get chunk size & transition to CHUNK/TRAILER */
-                current_chunk_size_ = get_chunk_size( parser_buffer_.substr( 0, it + 2 ) );
-
-                /* Transition appropriately */
-                state_ = ( current_chunk_size_ == 0 ) ? TRAILER : CHUNK;
-
-                /* shrink parser_buffer_ */
-                parsed_so_far_ += ( it + 2 );
-                parser_buffer_ = parser_buffer_.substr( it + 2 );
-                break;
-            } else {
-                /* if you haven't seen a CRLF so far, do nothing */
-                acked_so_far_ += input_buffer.length();
-                return string::npos;
-            }
-        }
+    assert( state_ != DONE );
 
-        case CHUNK: {
-            if ( parser_buffer_.length() >= current_chunk_size_ + 2 ) {
-                /* accumulated enough bytes, check CRLF at the end of the chunk */
-                assert( parser_buffer_.substr( current_chunk_size_, 2 ) == "\r\n" );
+    size_t pos = 0;
 
-                /* Transition to next state */
-                state_ = CHUNK_HDR;
+    while ( pos < input_buffer.size() ) {
+        switch ( state_ ) {
+        case CHUNK_SIZE:
+            if ( read_line( input_buffer, pos ) ) {
+                finish_chunk_size_line();
+                line_.clear();
+            }
+            break;
+
+        case CHUNK_DATA: {
+            const size_t amount = min( chunk_remaining_, uint64_t( input_buffer.size() - pos ) );
+            const size_t offset = body_offset_ + pos;
 
-                /* shrink parser_buffer_ */
-                parsed_so_far_ += current_chunk_size_ + 2;
-                parser_buffer_ = parser_buffer_.substr( current_chunk_size_ + 2 );
-                break;
+            if ( not payload_.empty() and payload_.back().first + payload_.back().second == offset ) {
+                payload_.back().second += amount;
             } else {
-                /* Haven't seen enough bytes so far, do nothing */
-                acked_so_far_ += input_buffer.length();
-                return string::npos;
+                payload_.emplace_back( offset, amount );
             }
-        }
 
-        case TRAILER: {
-            if ( trailers_enabled_) {
-                /* We need two consecutive CRLFs */
-                return compute_ack_size( parser_buffer_,
-                                         "\r\n\r\n",
-                                         input_buffer.length() );
-            } else {
-                /* We need only one CRLF now */
-                return compute_ack_size( parser_buffer_,
-                                         "\r\n",
-                                         input_buffer.length() );
+            pos += amount;
+            chunk_remaining_ -= amount;
+            if ( chunk_remaining_ == 0 ) {
+                state_ = CHUNK_DATA_END;
             }
+            break;
         }
 
-        default: {
+        case CHUNK_DATA_END:
+            if ( read_line( input_buffer, pos ) ) {
+                if ( not line_.empty() ) {
+                    throw runtime_error( "ChunkedBodyParser: chunk data not followed by CRLF" );
+                }
+                state_ = CHUNK_SIZE;
+            }
+            break;
+
+        case TRAILER:
+            /* trailer fields are skipped; a blank line ends the body */
+            if ( read_line( input_buffer, pos ) ) {
+                if ( line_.empty() ) {
+                    state_ = DONE;
+                    body_offset_ += pos;
+                    return pos;
+                }
+                line_.clear();
+            }
+            break;
+
+        case DONE:
             assert( false );
-            return false;
-        }
+            break;
         }
     }
-    acked_so_far_ += input_buffer.length();
-    return string::npos;
-}
 
-/*
-   Computes the acknowledgement from the BodyParser to its caller,
-   telling it how much of the current input_buffer has been
-   successfully parsed.
-*/
-string::size_type ChunkedBodyParser::compute_ack_size( const string & haystack,
-                                                       const string & needle,
-                                                       const string::size_type input_size )
-{
-    auto loc = haystack.find( needle );
-    if ( loc != string::npos ) {
-        /* Found it, eat up the whole buffer */
-        parsed_so_far_ += loc + needle.length();
-        assert( parsed_so_far_ > acked_so_far_ );
-        return ( parsed_so_far_ - acked_so_far_ );
-    } else {
-        /* Find unacknowledged buffer so far, ack it, and be done */
-        acked_so_far_ += input_size;
-        return loc;
-    }
+    /* all of it belongs to the body */
+    body_offset_ += input_buffer.size();
+    return string::npos;
 }
@@ -3,22 +3,38 @@
 #ifndef CHUNKED_BODY_PARSER_HH
 #define CHUNKED_BODY_PARSER_HH
 
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
 #include "body_parser.hh"
 #include "exception.hh"
 
+/* decodes a chunked body (RFC 7230 section 4.1) as it arrives. Each input
+   is walked once in place: chunk data is only counted off, and the only
+   bytes kept between inputs are those of an unfinished chunk-size or
+   trailer line. */
 class ChunkedBodyParser : public BodyParser
 {
+public:
+    /* where some decoded payload lies in the body as received:
+       offset from the start of the body, and length */
+    typedef std::pair<size_t, size_t> Span;
+
 private:
-    std::string::size_type compute_ack_size(const std::string & haystack,
-                                            const std::string & needle,
-                                            std::string::size_type input_size);
-    uint32_t get_chunk_size(const std::string & chunk_hdr) const;
-    std::string parser_buffer_ {""};
-    uint32_t current_chunk_size_ {0};
-    std::string::size_type acked_so_far_ {0};
-    std::string::size_type parsed_so_far_ {0};
-    enum {CHUNK_HDR, CHUNK, TRAILER} state_ {CHUNK_HDR};
-    const bool trailers_enabled_ {false};
+    enum { CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, TRAILER, DONE } state_ {CHUNK_SIZE};
+
+    std::string line_ {};          /* unfinished line, without its LF */
+    uint64_t chunk_remaining_ {0}; /* bytes of the current chunk still to come */
+    size_t body_offset_ {0};       /* bytes of the body before the current input */
+
+    std::vector<Span> payload_ {};
+
+    /* takes bytes up to the next LF into line_; returns whether the line is complete */
+    bool read_line( const std::string & input, size_t & pos );
+
+    void finish_chunk_size_line( void );
 
 public:
     std::string::size_type read( const std::string & ) override;
@@ -26,7 +42,9 @@ public:
     /* Follow item 2, Section 4.4 of RFC 2616 */
     bool eof( void ) const override { return true; }
 
-    ChunkedBodyParser(bool t_trailers_enabled) : trailers_enabled_( t_trailers_enabled ) {}
+    /* the decoded payload, as spans of the body read so far
+       (adjacent spans are merged) */
+    const std::vector<Span> & payload_spans( void ) const { return payload_; }
 };
 
 #endif /* CHUNKED_BODY_PARSER_HH */
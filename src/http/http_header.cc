@@ -3,12 +3,22 @@
 #include <string>
 #include <assert.h>
 
+#include <google/protobuf/wire_format_lite.h>
+
 #include "http_header.hh"
+#include "http_message.hh"
 #include "exception.hh"
 #include "ezio.hh"
 
 using namespace std;
 
+namespace {
+    /* indexed by HTTPHeader::Field */
+    const string KNOWN_FIELD_NAMES[ HTTPHeader::NUM_KNOWN_FIELDS ] = {
+        "host", "content-length", "transfer-encoding", "content-encoding"
+    };
+}
+
 /* parse a header line into a key and a value */
 HTTPHeader::HTTPHeader( const string & buf )
   : key_(), value_()
@@ -38,6 +48,46 @@ HTTPHeader::HTTPHeader( const string & buf )
     fprintf( stderr, "Got header. key=[[%s]] value = [[%s]]\n",
              key_.c_str(), value_.c_str() );
     */
+
+    normalize_key();
+}
+
+void HTTPHeader::normalize_key( void )
+{
+    const size_t first_nonspace = key_.find_first_not_of( " " );
+    if ( first_nonspace != string::npos ) {
+        normalized_key_.assign( key_, first_nonspace, string::npos );
+    }
+
+    for ( auto & c : normalized_key_ ) {
+        if ( c >= 'A' and c <= 'Z' ) {
+            c += 'a' - 'A';
+        }
+    }
+
+    field_ = OTHER;
+    for ( int i = 0; i < NUM_KNOWN_FIELDS; i++ ) {
+        if ( normalized_key_ == KNOWN_FIELD_NAMES[ i ] ) {
+            field_ = Field( i );
+            break;
+        }
+    }
+}
+
+bool HTTPHeader::key_matches( const string & header_name ) const
+{
+    return HTTPMessage::equivalent_strings( normalized_key_, header_name );
+}
+
+HTTPHeader::Field HTTPHeader::field_of( const string & header_name )
+{
+    for ( int i = 0; i < NUM_KNOWN_FIELDS; i++ ) {
+        if ( HTTPMessage::equivalent_strings( KNOWN_FIELD_NAMES[ i ], header_name ) ) {
+            return Field( i );
+        }
+    }
+
+    return OTHER;
 }
 
 void HTTPHeader::set_value( const string & value ) {
@@ -47,6 +97,7 @@ void HTTPHeader::set_value( const string & value ) {
 HTTPHeader::HTTPHeader( const MahimahiProtobufs::HTTPHeader & proto )
     : key_( proto.key() ), value_( proto.value() )
 {
+    normalize_key();
 }
 
 MahimahiProtobufs::HTTPHeader HTTPHeader::toprotobuf( void ) const
@@ -58,3 +109,21 @@ MahimahiProtobufs::HTTPHeader HTTPHeader::toprotobuf( void ) const
 
     return ret;
 }
+
+size_t HTTPHeader::protobuf_size( void ) const
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    return WireFormatLite::TagSize( MahimahiProtobufs::HTTPHeader::kKeyFieldNumber, WireFormatLite::TYPE_BYTES )
+        + WireFormatLite::BytesSize( key_ )
+        + WireFormatLite::TagSize( MahimahiProtobufs::HTTPHeader::kValueFieldNumber, WireFormatLite::TYPE_BYTES )
+        + WireFormatLite::BytesSize( value_ );
+}
+
+void HTTPHeader::write_protobuf( google::protobuf::io::CodedOutputStream & output ) const
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    WireFormatLite::WriteBytes( MahimahiProtobufs::HTTPHeader::kKeyFieldNumber, key_, &output );
+    WireFormatLite::WriteBytes( MahimahiProtobufs::HTTPHeader::kValueFieldNumber, value_, &output );
+}
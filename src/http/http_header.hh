@@ -5,17 +5,32 @@
 
 #include <string>
 
+#include <google/protobuf/io/coded_stream.h>
+
 #include "http_record.pb.h"
 
 class HTTPHeader
 {
+public:
+    /* headers the parsers and proxies look up on every message */
+    enum Field { HOST, CONTENT_LENGTH, TRANSFER_ENCODING, CONTENT_ENCODING,
+                 NUM_KNOWN_FIELDS, OTHER = NUM_KNOWN_FIELDS };
+
 private:
     std::string key_, value_;
 
+    /* key without leading spaces, lower-cased, for comparisons */
+    std::string normalized_key_ {};
+    Field field_ { OTHER };
+
+    void normalize_key( void );
+
 public:
     HTTPHeader( const std::string & buf );
 
     const std::string & key( void ) const { return key_; }
+    const std::string & normalized_key( void ) const { return normalized_key_; }
+    Field field( void ) const { return field_; }
     const std::string & value( void ) const { return value_; }
 
     void set_value( const std::string & value );
@@ -24,6 +39,16 @@ public:
 
     HTTPHeader( const MahimahiProtobufs::HTTPHeader & proto );
     MahimahiProtobufs::HTTPHeader toprotobuf( void ) const;
+
+    /* the encoding of toprotobuf(), written without building it */
+    size_t protobuf_size( void ) const;
+    void write_protobuf( google::protobuf::io::CodedOutputStream & output ) const;
+
+    /* does the key match a header name (case-insensitively)? */
+    bool key_matches( const std::string & header_name ) const;
+
+    /* which well-known header a name refers to, if any */
+    static Field field_of( const std::string & header_name );
 };
 
 #endif /* HTTP_HEADER_HH */
@@ -1,16 +1,21 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <google/protobuf/wire_format_lite.h>
+
 #include "http_message.hh"
 #include "exception.hh"
 #include "http_record.pb.h"
 
 using namespace std;
 
+const size_t HTTPMessage::NO_HEADER;
+
 /* methods called by an external parser */
 void HTTPMessage::set_first_line( const string & str )
 {
     assert( state_ == FIRST_LINE_PENDING );
     first_line_ = str;
+    parse_first_line();
     state_ = HEADERS_PENDING;
 }
 
@@ -18,22 +23,40 @@ void HTTPMessage::add_header( const std::string & str )
 {
     assert( state_ == HEADERS_PENDING );
     headers_.emplace_back( str );
+    index_header( headers_.size() - 1 );
 }
 
 void HTTPMessage::add_header_after_parsing( const std::string & str )
 {
     headers_.emplace_back( str );
+    index_header( headers_.size() - 1 );
 }
 
 void HTTPMessage::remove_header( const std::string & str )
 {
     auto it = std::remove_if (headers_.begin(), headers_.end(),
-        [str] ( HTTPHeader header ) -> bool
+        [&str] ( const HTTPHeader & header ) -> bool
         {
-          auto header_key = header.key();
-          return equivalent_strings(str, header_key);
+          return header.key_matches(str);
         });
     headers_.erase(it, headers_.end());
+    index_headers();
+}
+
+void HTTPMessage::index_header( const size_t position )
+{
+    const HTTPHeader::Field field = headers_.at( position ).field();
+    if ( field != HTTPHeader::OTHER and known_headers_[ field ] == NO_HEADER ) {
+        known_headers_[ field ] = position;
+    }
+}
+
+void HTTPMessage::index_headers( void )
+{
+    known_headers_.fill( NO_HEADER );
+    for ( size_t i = 0; i < headers_.size(); i++ ) {
+        index_header( i );
+    }
 }
 
 void HTTPMessage::done_with_headers( void )
@@ -62,7 +85,7 @@ size_t HTTPMessage::read_in_body( const std::string & str )
         const size_t amount_to_append = min( expected_body_size() - body_.size(),
                                              str.size() );
 
-        body_.append( str.substr( 0, amount_to_append ) );
+        body_.append( str, 0, amount_to_append );
         if ( body_.size() == expected_body_size() ) {
             state_ = COMPLETE;
         }
@@ -74,6 +97,20 @@ size_t HTTPMessage::read_in_body( const std::string & str )
     }
 }
 
+void HTTPMessage::splice_in_body( FileDescriptor & pipe, const size_t length )
+{
+    assert( state_ == BODY_PENDING );
+
+    if ( length > body_bytes_remaining() ) {
+        throw runtime_error( "HTTPMessage: spliced bytes run past the end of the body" );
+    }
+
+    body_.splice_from( pipe, length );
+    if ( body_.size() == expected_body_size() ) {
+        state_ = COMPLETE;
+    }
+}
+
 void HTTPMessage::eof( void )
 {
     switch ( state() ) {
@@ -104,6 +141,15 @@ size_t HTTPMessage::expected_body_size( void ) const
     return expected_body_size_.second;
 }
 
+size_t HTTPMessage::body_bytes_remaining( void ) const
+{
+    if ( state_ != BODY_PENDING or not body_size_is_known() ) {
+        return 0;
+    }
+
+    return expected_body_size() - body_.size();
+}
+
 /* locale-insensitive ASCII conversion */
 static char http_to_lower( char c )
 {
@@ -114,27 +160,18 @@ static char http_to_lower( char c )
     return c;
 }
 
-static string strip_initial_whitespace( const string & str )
-{
-    size_t first_nonspace = str.find_first_not_of( " " );
-    if ( first_nonspace == std::string::npos ) {
-        return "";
-    } else {
-        return str.substr( first_nonspace );
-    }
-}
-
-/* check if two strings are equivalent per HTTP 1.1 comparison (case-insensitive) */
+/* check if two strings are equivalent per HTTP 1.1 comparison (case-insensitive),
+   ignoring initial spaces */
 bool HTTPMessage::equivalent_strings( const string & a, const string & b )
 {
-    const string new_a = strip_initial_whitespace( a ),
-        new_b = strip_initial_whitespace( b );
+    const size_t a_start = min( a.find_first_not_of( ' ' ), a.size() ),
+        b_start = min( b.find_first_not_of( ' ' ), b.size() );
 
-    if ( new_a.size() != new_b.size() ) {
+    if ( a.size() - a_start != b.size() - b_start ) {
         return false;
     }
 
-    for ( auto it_a = new_a.begin(), it_b = new_b.begin(); it_a < new_a.end(); it_a++, it_b++ ) {
+    for ( auto it_a = a.begin() + a_start, it_b = b.begin() + b_start; it_a < a.end(); it_a++, it_b++ ) {
         if ( http_to_lower( *it_a ) != http_to_lower( *it_b ) ) {
             return false;
         }
@@ -143,34 +180,44 @@ bool HTTPMessage::equivalent_strings( const string & a, const string & b )
     return true;
 }
 
-bool HTTPMessage::has_header( const string & header_name ) const
+const HTTPHeader * HTTPMessage::find_header( const string & header_name ) const
 {
+    /* well-known headers are indexed */
+    const HTTPHeader::Field field = HTTPHeader::field_of( header_name );
+    if ( field != HTTPHeader::OTHER ) {
+        const size_t position = known_headers_[ field ];
+        return position == NO_HEADER ? nullptr : &headers_[ position ];
+    }
+
     for ( const auto & header : headers_ ) {
         /* canonicalize header name per RFC 2616 section 2.1 */
-        if ( equivalent_strings( header.key(), header_name ) ) {
-            return true;
+        if ( header.key_matches( header_name ) ) {
+            return &header;
         }
     }
 
-    return false;
+    return nullptr;
+}
+
+bool HTTPMessage::has_header( const string & header_name ) const
+{
+    return find_header( header_name ) != nullptr;
 }
 
 const string & HTTPMessage::get_header_value( const std::string & header_name ) const
 {
-    for ( const auto & header : headers_ ) {
-        /* canonicalize header name per RFC 2616 section 2.1 */
-        if ( equivalent_strings( header.key(), header_name ) ) {
-            return header.value();
-        }
+    const HTTPHeader * header = find_header( header_name );
+    if ( not header ) {
+        throw runtime_error( "HTTPMessage header not found: " + header_name );
     }
 
-    throw runtime_error( "HTTPMessage header not found: " + header_name );
+    return header->value();
 }
 
 void HTTPMessage::set_header_value( const std::string & header_name, const std::string & value )
 {
     for ( auto & header : headers_ ) {
-        if ( equivalent_strings( header.key(), header_name ) ) {
+        if ( header.key_matches( header_name ) ) {
             header.set_value(value);
         }
     }
@@ -193,7 +240,7 @@ std::string HTTPMessage::str( void ) const
     ret.append( CRLF );
 
     /* add body to request */
-    ret.append( body_ );
+    ret.append( body_.str() );
 
     return ret;
 }
@@ -210,11 +257,51 @@ MahimahiProtobufs::HTTPMessage HTTPMessage::toprotobuf( void ) const
         ret.add_header()->CopyFrom( header.toprotobuf() );
     }
 
-    ret.set_body( body_ );
+    ret.set_body( body_.str() );
 
     return ret;
 }
 
+size_t HTTPMessage::protobuf_size( void ) const
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    size_t size = WireFormatLite::TagSize( MahimahiProtobufs::HTTPMessage::kFirstLineFieldNumber, WireFormatLite::TYPE_BYTES )
+        + WireFormatLite::BytesSize( first_line_ );
+
+    for ( const auto & header : headers_ ) {
+        size += WireFormatLite::TagSize( MahimahiProtobufs::HTTPMessage::kHeaderFieldNumber, WireFormatLite::TYPE_MESSAGE )
+            + WireFormatLite::LengthDelimitedSize( header.protobuf_size() );
+    }
+
+    return size + WireFormatLite::TagSize( MahimahiProtobufs::HTTPMessage::kBodyFieldNumber, WireFormatLite::TYPE_BYTES )
+        + WireFormatLite::LengthDelimitedSize( body_.size() );
+}
+
+void HTTPMessage::write_protobuf( google::protobuf::io::CodedOutputStream & output ) const
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    assert( state_ == COMPLETE );
+
+    WireFormatLite::WriteBytes( MahimahiProtobufs::HTTPMessage::kFirstLineFieldNumber, first_line_, &output );
+
+    for ( const auto & header : headers_ ) {
+        WireFormatLite::WriteTag( MahimahiProtobufs::HTTPMessage::kHeaderFieldNumber,
+                                  WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output );
+        output.WriteVarint32( header.protobuf_size() );
+        header.write_protobuf( output );
+    }
+
+    /* (a spilled body is streamed from its file) */
+    WireFormatLite::WriteTag( MahimahiProtobufs::HTTPMessage::kBodyFieldNumber,
+                              WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output );
+    output.WriteVarint32( body_.size() );
+    body_.for_each_piece( [&output] ( const char * data, const size_t length ) {
+            output.WriteRaw( data, length );
+        } );
+}
+
 HTTPMessage::HTTPMessage( const MahimahiProtobufs::HTTPMessage & proto )
     : first_line_( proto.first_line() ),
       body_( proto.body() ),
@@ -223,4 +310,6 @@ HTTPMessage::HTTPMessage( const MahimahiProtobufs::HTTPMessage & proto )
     for ( const auto header : proto.header() ) {
         headers_.emplace_back( header );
     }
+
+    index_headers();
 }
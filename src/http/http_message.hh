@@ -5,8 +5,12 @@
 
 #include <string>
 #include <vector>
+#include <array>
+
+#include <google/protobuf/io/coded_stream.h>
 
 #include "http_header.hh"
+#include "message_body.hh"
 #include "http_record.pb.h"
 
 enum HTTPMessageState {
@@ -35,6 +39,13 @@ private:
   /* does message become complete upon EOF in body? */
   virtual bool eof_in_body(void) const = 0;
 
+  /* position in headers_ of the first of each well-known header */
+  static const size_t NO_HEADER = -1;
+  std::array<size_t, HTTPHeader::NUM_KNOWN_FIELDS> known_headers_{};
+
+  void index_header(const size_t position);
+  void index_headers(void);
+
 protected:
   /* request line or status line */
   std::string first_line_{};
@@ -43,7 +54,7 @@ protected:
   std::vector<HTTPHeader> headers_{};
 
   /* body may be empty */
-  std::string body_{};
+  MessageBody body_{};
 
   /* state of an in-progress request or response */
   HTTPMessageState state_{FIRST_LINE_PENDING};
@@ -51,16 +62,33 @@ protected:
   /* used by subclasses to set the expected body size */
   void set_expected_body_size(const bool is_known, const size_t value = -1);
 
+  /* first header with a given name, or nullptr */
+  const HTTPHeader *find_header(const std::string &header_name) const;
+
+  /* pick apart first_line_ (request or response must implement) */
+  virtual void parse_first_line(void) = 0;
+
 public:
-  HTTPMessage() {}
+  HTTPMessage() { index_headers(); }
   virtual ~HTTPMessage() {}
 
+  /* (declared so that moving a message moves its body rather than
+     copying it) */
+  HTTPMessage(const HTTPMessage &other) = default;
+  HTTPMessage(HTTPMessage &&other) = default;
+  HTTPMessage &operator=(const HTTPMessage &other) = default;
+  HTTPMessage &operator=(HTTPMessage &&other) = default;
+
   /* methods called by an external parser */
   void set_first_line(const std::string &str);
   void add_header(const std::string &str);
   void add_header_after_parsing(const std::string &str);
   void done_with_headers(void);
   size_t read_in_body(const std::string &str);
+
+  /* the same for length bytes of a body of known size that are waiting in
+     a pipe (see MessageBody::splice_from) */
+  void splice_in_body(FileDescriptor &pipe, const size_t length);
   void eof(void);
 
   void remove_header(const std::string &str);
@@ -68,6 +96,9 @@ public:
   /* getters */
   bool body_size_is_known(void) const;
   size_t expected_body_size(void) const;
+
+  /* bytes still to come of a body of known size (0 unless one is pending) */
+  size_t body_bytes_remaining(void) const;
   const HTTPMessageState &state(void) const { return state_; }
   const std::string &first_line(void) const { return first_line_; }
 
@@ -83,6 +114,11 @@ public:
   /* return complete request or response as http_message protobuf */
   MahimahiProtobufs::HTTPMessage toprotobuf(void) const;
 
+  /* the encoding of toprotobuf(), written straight from the message (so a
+     recorded body isn't first copied into a protobuf) */
+  size_t protobuf_size(void) const;
+  void write_protobuf(google::protobuf::io::CodedOutputStream &output) const;
+
   /* compare two strings for (case-insensitive) equality,
      in ASCII without sensitivity to locale */
   static bool equivalent_strings(const std::string &a, const std::string &b);
@@ -7,29 +7,12 @@
 #include <string>
 
 #include "http_message.hh"
+#include "parse_buffer.hh"
 
 template <class MessageType> class HTTPMessageSequence {
 private:
-  class InternalBuffer {
-  private:
-    std::string buffer_{};
-
-  public:
-    bool have_complete_line(void) const;
-
-    std::string get_and_pop_line(void);
-
-    void pop_bytes(const size_t n);
-
-    bool empty(void) const { return buffer_.empty(); }
-
-    void append(const std::string &str) { buffer_.append(str); }
-
-    const std::string &str(void) const { return buffer_; }
-  };
-
   /* bytes that haven't been parsed yet */
-  InternalBuffer buffer_{};
+  ParseBuffer buffer_{};
 
   /* complete messages ready to go */
   std::queue<MessageType> complete_messages_{};
@@ -42,6 +25,9 @@ private:
      must be implemented by subclass */
   virtual void initialize_new_message(void) = 0;
 
+  /* what to do when a message is complete, before it is queued */
+  virtual void finish_message(void) {}
+
 protected:
   /* the current message we're working on */
   MessageType message_in_progress_{};
@@ -53,6 +39,17 @@ public:
   /* must accept all of buf */
   void parse(const std::string &buf);
 
+  /* bytes still to come of the body of the message in progress, when its
+     size is known and nothing past what was parsed has been buffered (so
+     a relay knows how much of what follows is body) */
+  size_t body_bytes_remaining(void) const {
+    return buffer_.empty() ? message_in_progress_.body_bytes_remaining() : 0;
+  }
+
+  /* parse length bytes of that body from a pipe, without reading them
+     into user space */
+  void splice_body(FileDescriptor &pipe, const size_t length);
+
   /* getters */
   bool empty(void) const { return complete_messages_.empty(); }
   MessageType &front(void) { return complete_messages_.front(); }
@@ -61,32 +58,6 @@ public:
   void pop(void) { complete_messages_.pop(); }
 };
 
-template <class MessageType>
-bool HTTPMessageSequence<MessageType>::InternalBuffer::have_complete_line(
-    void) const {
-  size_t first_line_ending = buffer_.find(CRLF);
-  return first_line_ending != std::string::npos;
-}
-
-template <class MessageType>
-std::string
-HTTPMessageSequence<MessageType>::InternalBuffer::get_and_pop_line(void) {
-  size_t first_line_ending = buffer_.find(CRLF);
-  assert(first_line_ending != std::string::npos);
-
-  std::string first_line(buffer_.substr(0, first_line_ending));
-  pop_bytes(first_line_ending + CRLF.size());
-
-  return first_line;
-}
-
-template <class MessageType>
-void HTTPMessageSequence<MessageType>::InternalBuffer::pop_bytes(
-    const size_t num) {
-  assert(buffer_.size() >= num);
-  buffer_.replace(0, num, std::string());
-}
-
 template <class MessageType>
 bool HTTPMessageSequence<MessageType>::parsing_step(void) {
   switch (message_in_progress_.state()) {
@@ -121,13 +92,14 @@ bool HTTPMessageSequence<MessageType>::parsing_step(void) {
 
   case BODY_PENDING: {
     size_t bytes_read = message_in_progress_.read_in_body(buffer_.str());
-    assert(bytes_read == buffer_.str().size() or
+    assert(bytes_read == buffer_.size() or
            message_in_progress_.state() == COMPLETE);
     buffer_.pop_bytes(bytes_read);
   }
     return message_in_progress_.state() == COMPLETE;
 
   case COMPLETE:
+    finish_message();
     complete_messages_.emplace(std::move(message_in_progress_));
     message_in_progress_ = MessageType();
     return true;
@@ -151,4 +123,16 @@ void HTTPMessageSequence<MessageType>::parse(const std::string &buf) {
   }
 }
 
+template <class MessageType>
+void HTTPMessageSequence<MessageType>::splice_body(FileDescriptor &pipe,
+                                                   const size_t length) {
+  assert(buffer_.empty());
+
+  message_in_progress_.splice_in_body(pipe, length);
+
+  /* (queue the message if that completed it) */
+  while (parsing_step()) {
+  }
+}
+
 #endif /* HTTP_MESSAGE_SEQUENCE */
@@ -1,34 +1,75 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
-#include <sstream>
-#include <vector>
-
 #include "exception.hh"
 #include "ezio.hh"
 #include "http_request.hh"
+#include "tokenize.hh"
 
 using namespace std;
 
+HTTPRequest::HTTPRequest(const MahimahiProtobufs::HTTPMessage &proto)
+    : HTTPMessage(proto) {
+  parse_first_line();
+}
+
+void HTTPRequest::parse_first_line(void) {
+  /* method SP request-target SP HTTP-version */
+  const size_t first_space = first_line_.find(' ');
+  method_ = first_line_.substr(0, first_space);
+
+  if (first_space == string::npos) {
+    target_.clear();
+  } else {
+    const size_t second_space = first_line_.find(' ', first_space + 1);
+    target_ = first_line_.substr(first_space + 1, second_space == string::npos
+                                                      ? string::npos
+                                                      : second_space - first_space - 1);
+  }
+}
+
 void HTTPRequest::calculate_expected_body_size(void) {
   assert(state_ == BODY_PENDING);
 
-  if (first_line_.substr(0, 4) == "GET " or
-      first_line_.substr(0, 5) == "HEAD ") {
-    set_expected_body_size(true, 0);
-  } else if (first_line_.substr(0, 5) == "POST ") {
-    if (!has_header("Content-Length")) {
-      throw runtime_error("HTTPRequest: does not support chunked requests");
+  /* RFC 7230 section 3.3.3 ("Message Body Length"): a request has a body
+     only if it says so, with Transfer-Encoding or Content-Length */
+  if (has_header("Transfer-Encoding")) {
+    /* the length of anything but a chunked body can't be known (rule 3) */
+    const string &codings = get_header_value("Transfer-Encoding");
+    if (not equivalent_strings(split(codings, ",").back(), "chunked")) {
+      throw runtime_error("HTTPRequest: unsupported Transfer-Encoding: " +
+                          codings);
     }
 
-    set_expected_body_size(true, myatoi(get_header_value("Content-Length")));
+    set_expected_body_size(false);
+    body_parser_ = make_shared<ChunkedBodyParser>();
+  } else if (has_header("Content-Length")) {
+    const string &length = get_header_value("Content-Length");
+    if (length.empty() or
+        length.find_first_not_of("0123456789") != string::npos) {
+      throw runtime_error("HTTPRequest: invalid Content-Length: " + length);
+    }
+
+    set_expected_body_size(true, myatoi(length));
   } else {
-    throw runtime_error("Cannot handle HTTP method: " + first_line_);
+    set_expected_body_size(true, 0);
   }
 }
 
-size_t HTTPRequest::read_in_complex_body(const std::string &) {
-  /* we don't support complex bodies */
-  throw runtime_error("HTTPRequest: does not support chunked requests");
+size_t HTTPRequest::read_in_complex_body(const std::string &str) {
+  assert(state_ == BODY_PENDING);
+  assert(body_parser_);
+
+  const size_t amount_parsed = body_parser_->read(str);
+  if (amount_parsed == string::npos) {
+    /* all of it belongs to the body */
+    body_.append(str);
+    return str.size();
+  } else {
+    /* body is now complete */
+    body_.append(str, 0, amount_parsed);
+    state_ = COMPLETE;
+    return amount_parsed;
+  }
 }
 
 bool HTTPRequest::eof_in_body(void) const {
@@ -38,31 +79,16 @@ bool HTTPRequest::eof_in_body(void) const {
 bool HTTPRequest::is_head(void) const {
   assert(state_ > FIRST_LINE_PENDING);
   /* RFC 2616 5.1.1 says "The method is case-sensitive." */
-  return first_line_.substr(0, 5) == "HEAD ";
+  return method_ == "HEAD";
 }
 
 string HTTPRequest::get_url(void) const {
-  string host = "";
-  for (auto it = headers_.begin(); it != headers_.end(); it++) {
-    auto header = *it;
-    auto key = header.key();
-    auto value = header.value();
-    if (key == "Host") {
-      host = value;
-      break;
-    }
-  }
+  const HTTPHeader *host = find_header("Host");
 
   // Cannot find the host of this request.
-  if (host.empty()) {
+  if (not host or host->value().empty()) {
     return "";
   }
 
-  stringstream ss(first_line_);
-  string item;
-  vector<string> tokens;
-  while (getline(ss, item, ' ')) {
-    tokens.push_back(item);
-  }
-  return host + tokens[1];
+  return host->value() + target_;
 }
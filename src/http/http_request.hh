@@ -3,25 +3,42 @@
 #ifndef HTTP_REQUEST_HH
 #define HTTP_REQUEST_HH
 
+#include <memory>
+
 #include "http_message.hh"
+#include "chunked_parser.hh"
 
 class HTTPRequest : public HTTPMessage {
 private:
-  /* for a request, will always be known */
+  /* framed as in RFC 7230 section 3.3.3, whatever the method */
   void calculate_expected_body_size(void) override;
 
-  /* we have no complex bodies */
+  /* chunked bodies */
   size_t read_in_complex_body(const std::string &str) override;
 
   /* connection closed while body was pending */
   bool eof_in_body(void) const override;
 
+  /* from the request line */
+  std::string method_{};
+  std::string target_{};
+
+  void parse_first_line(void) override;
+
+  /* for a chunked body (shared by copies, which are made of complete
+     requests) */
+  std::shared_ptr<ChunkedBodyParser> body_parser_{nullptr};
+
 public:
+  HTTPRequest() {}
+  HTTPRequest(const MahimahiProtobufs::HTTPMessage &proto);
+
   bool is_head(void) const;
 
-  std::string get_url(void) const;
+  const std::string &method(void) const { return method_; }
+  const std::string &target(void) const { return target_; }
 
-  using HTTPMessage::HTTPMessage;
+  std::string get_url(void) const;
 };
 
 #endif /* HTTP_REQUEST_HH */
@@ -10,15 +10,38 @@
 
 using namespace std;
 
-string HTTPResponse::status_code( void ) const
+HTTPResponse::HTTPResponse( const MahimahiProtobufs::HTTPMessage & proto )
+    : HTTPMessage( proto )
 {
-    assert( state_ > FIRST_LINE_PENDING );
+    parse_first_line();
+}
+
+void HTTPResponse::parse_first_line( void )
+{
+    /* HTTP-version SP status-code SP reason-phrase */
     auto tokens = split( first_line_, " " );
     if ( tokens.size() < 3 ) {
+        status_code_.clear();
+    } else {
+        status_code_ = tokens.at( 1 );
+    }
+}
+
+const string & HTTPResponse::status_code( void ) const
+{
+    assert( state_ > FIRST_LINE_PENDING );
+    if ( status_code_.empty() ) {
         throw runtime_error( "HTTPResponse: Invalid status line: " + first_line_ );
     }
 
-    return tokens.at( 1 );
+    return status_code_;
+}
+
+bool HTTPResponse::is_chunked( void ) const
+{
+    return has_header( "Transfer-Encoding" )
+        and equivalent_strings( split( get_header_value( "Transfer-Encoding" ), "," ).back(),
+                                "chunked" );
 }
 
 void HTTPResponse::calculate_expected_body_size( void )
@@ -30,21 +53,19 @@ void HTTPResponse::calculate_expected_body_size( void )
     if ( status_code().at( 0 ) == '1'
          or status_code() == "204"
          or status_code() == "304"
-         or request_.is_head() ) {
+         or request().is_head() ) {
 
         /* Rule 1: size known to be zero */
         set_expected_body_size( true, 0 );
-    } else if ( has_header( "Transfer-Encoding" )
-                and equivalent_strings( split( get_header_value( "Transfer-Encoding" ), "," ).back(),
-                                        "chunked" ) ) {
+    } else if ( is_chunked() ) {
 
         /* Rule 2: size dictated by chunked encoding */
         /* Rule 2 is a bit ambiguous, but we think section 3.6 makes this acceptable */
 
         set_expected_body_size( false );
 
-        /* Create body_parser_ with trailers_enabled if requied (RFC 2616 section 14.40) */
-        body_parser_ = unique_ptr< BodyParser >( new ChunkedBodyParser( has_header( "Trailer" ) ) );
+        /* trailer fields, if any, end with a blank line (RFC 7230 section 4.1.2) */
+        body_parser_ = unique_ptr< BodyParser >( new ChunkedBodyParser() );
     } else if ( (not has_header( "Transfer-Encoding" ) )
                 and has_header( "Content-Length" ) ) {
 
@@ -77,7 +98,7 @@ size_t HTTPResponse::read_in_complex_body( const std::string & str )
         return str.size();
     } else {
         /* body is now complete */
-        body_.append( str.substr( 0, amount_parsed ) );
+        body_.append( str, 0, amount_parsed );
         state_ = COMPLETE;
         return amount_parsed;
     }
@@ -93,9 +114,23 @@ bool HTTPResponse::eof_in_body( void ) const
     }
 }
 
-void HTTPResponse::set_request( const HTTPRequest & request )
+void HTTPResponse::set_request( const shared_ptr< const HTTPRequest > & request )
 {
     assert( state_ == FIRST_LINE_PENDING );
 
     request_ = request;
 }
+
+const HTTPRequest & HTTPResponse::request( void ) const
+{
+    if ( not request_ ) {
+        throw runtime_error( "HTTPResponse: response without matching request" );
+    }
+
+    return *request_;
+}
+
+bool HTTPResponse::is_interim( void ) const
+{
+    return status_code().at( 0 ) == '1' and status_code() != "101";
+}
@@ -12,9 +12,17 @@
 class HTTPResponse : public HTTPMessage
 {
 private:
-    std::string status_code( void ) const;
+    bool is_chunked( void ) const;
 
-    HTTPRequest request_ {};
+    /* from the status line */
+    std::string status_code_ {};
+
+    void parse_first_line( void ) override;
+
+    /* shared with the response parser and any copies of this response,
+       rather than copied into each (nullptr if built from a protobuf, or
+       for an interim response that arrived before its request was complete) */
+    std::shared_ptr< const HTTPRequest > request_ { nullptr };
 
     /* required methods */
     void calculate_expected_body_size( void ) override;
@@ -24,10 +32,17 @@ private:
     std::unique_ptr< BodyParser > body_parser_ { nullptr };
 
 public:
-    void set_request( const HTTPRequest & request );
-    const HTTPRequest & request( void ) const { return request_; }
+    HTTPResponse() {}
+    HTTPResponse( const MahimahiProtobufs::HTTPMessage & proto );
+
+    void set_request( const std::shared_ptr< const HTTPRequest > & request );
+    const HTTPRequest & request( void ) const;
+
+    const std::string & status_code( void ) const;
 
-    using HTTPMessage::HTTPMessage;
+    /* an interim (1xx) response, to be followed by the final response to
+       the same request (101 Switching Protocols counts as final) */
+    bool is_interim( void ) const;
 };
 
 #endif /* HTTP_RESPONSE_HH */
@@ -11,17 +11,28 @@ using namespace std;
 
 void HTTPResponseParser::initialize_new_message( void )
 {
-    /* do we have a request that we can match this response up with? */
+    /* match this response up with the oldest request. There might be none
+       yet for an interim response (e.g. 100 Continue to a request whose
+       body is still on its way); a final response without one fails when
+       it needs its request. */
+    message_in_progress_.set_request( requests_.empty() ? nullptr : requests_.front() );
+}
+
+void HTTPResponseParser::finish_message( void )
+{
+    /* only the final response answers the request */
+    if ( message_in_progress_.is_interim() ) {
+        return;
+    }
+
     if ( requests_.empty() ) {
         throw runtime_error( "HTTPResponseParser: response without matching request" );
     }
 
-    message_in_progress_.set_request( requests_.front() );
-
     requests_.pop();
 }
 
-void HTTPResponseParser::new_request_arrived( const HTTPRequest & request )
+void HTTPResponseParser::new_request_arrived( HTTPRequest request )
 {
-    requests_.push( request );
+    requests_.push( make_shared< const HTTPRequest >( move( request ) ) );
 }
@@ -3,6 +3,8 @@
 #ifndef HTTP_RESPONSE_PARSER_HH
 #define HTTP_RESPONSE_PARSER_HH
 
+#include <memory>
+
 #include "http_message_sequence.hh"
 #include "http_response.hh"
 #include "http_request.hh"
@@ -11,12 +13,15 @@ class HTTPResponseParser : public HTTPMessageSequence<HTTPResponse>
 {
 private:
     /* Need this to handle RFC 2616 section 4.4 rule 1 */
-    std::queue< HTTPRequest > requests_ {};
+    std::queue< std::shared_ptr< const HTTPRequest > > requests_ {};
 
     void initialize_new_message( void ) override;
+    void finish_message( void ) override;
 
 public:
-    void new_request_arrived( const HTTPRequest & request );
+    /* (pass a request that is no longer needed with std::move, to avoid
+       copying its body) */
+    void new_request_arrived( HTTPRequest request );
 };
 
 #endif /* HTTP_RESPONSE_PARSER_HH */
@@ -0,0 +1,122 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+#include <limits>
+
+#include <unistd.h>
+
+#include "message_body.hh"
+#include "temp_file.hh"
+#include "exception.hh"
+
+using namespace std;
+
+namespace {
+    /* how much of a spilled body is read back at once */
+    const size_t FILE_PIECE_SIZE = 1024 * 1024;
+}
+
+/* by default, bodies are never spilled */
+size_t MessageBody::spill_threshold_ = numeric_limits<size_t>::max();
+string MessageBody::spill_directory_ = "/tmp/";
+
+void MessageBody::spill_bodies_over( const size_t threshold, const string & directory )
+{
+    spill_threshold_ = threshold;
+    spill_directory_ = directory;
+}
+
+void MessageBody::spill( void )
+{
+    /* the file is unlinked straight away, so it goes when the last copy of
+       the body does (and doesn't outlive a crash) */
+    UniqueFile file( spill_directory_ + "body" );
+    SystemCall( "unlink " + file.name(), unlink( file.name().c_str() ) );
+
+    file_ = make_shared< FileDescriptor >( move( file.fd() ) );
+
+    if ( not memory_.empty() ) {
+        file_->write( memory_ );
+    }
+    string().swap( memory_ );
+}
+
+void MessageBody::append( const string & str, const size_t pos, const size_t n )
+{
+    assert( pos <= str.size() );
+    const size_t length = min( n, str.size() - pos );
+    if ( length == 0 ) {
+        return;
+    }
+
+    if ( not file_ and size_ + length > spill_threshold_ ) {
+        spill();
+    }
+
+    if ( file_ ) {
+        assert( file_.use_count() == 1 );
+
+        const auto end = str.begin() + pos + length;
+        for ( auto it = str.begin() + pos; it != end; ) {
+            it = file_->write( it, end );
+        }
+    } else {
+        memory_.append( str, pos, length );
+    }
+
+    size_ += length;
+}
+
+void MessageBody::splice_from( FileDescriptor & pipe, const size_t length )
+{
+    if ( not file_ ) {
+        spill();
+    }
+
+    assert( file_.use_count() == 1 );
+
+    for ( size_t moved = 0; moved < length; ) {
+        const size_t bytes_moved = file_->splice_from( pipe, length - moved );
+        if ( bytes_moved == 0 ) {
+            throw runtime_error( "MessageBody: pipe ran out before the end of the body" );
+        }
+
+        moved += bytes_moved;
+        size_ += bytes_moved;
+    }
+}
+
+void MessageBody::for_each_piece( const function<void( const char *, size_t )> & handler ) const
+{
+    if ( not file_ ) {
+        if ( not memory_.empty() ) {
+            handler( memory_.data(), memory_.size() );
+        }
+        return;
+    }
+
+    string buffer( min( size_, FILE_PIECE_SIZE ), 0 );
+    for ( size_t offset = 0; offset < size_; ) {
+        const ssize_t bytes_read = SystemCall( "pread", pread( file_->fd_num(), &buffer[ 0 ],
+                                                               min( size_ - offset, buffer.size() ),
+                                                               offset ) );
+        if ( bytes_read == 0 ) {
+            throw runtime_error( "MessageBody: spilled body is missing from its file" );
+        }
+
+        handler( buffer.data(), bytes_read );
+        offset += bytes_read;
+    }
+}
+
+string MessageBody::str( void ) const
+{
+    if ( not file_ ) {
+        return memory_;
+    }
+
+    string ret;
+    ret.reserve( size_ );
+    for_each_piece( [&ret] ( const char * data, const size_t length ) { ret.append( data, length ); } );
+    return ret;
+}
@@ -0,0 +1,60 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef MESSAGE_BODY_HH
+#define MESSAGE_BODY_HH
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "file_descriptor.hh"
+
+/* the body of an HTTP message. It is kept in memory until it grows past
+   the spill threshold (if one is set), after which it is appended to an
+   unlinked temporary file instead, so that a recording proxy's memory
+   doesn't grow with the sizes of the objects it records. Copies of a
+   spilled body share its file, so only the message being parsed may
+   still append to it. */
+class MessageBody
+{
+private:
+    std::string memory_ {};
+
+    /* once spilled */
+    std::shared_ptr< FileDescriptor > file_ { nullptr };
+
+    size_t size_ { 0 };
+
+    static size_t spill_threshold_;
+    static std::string spill_directory_;
+
+    void spill( void );
+
+public:
+    MessageBody() {}
+    MessageBody( const std::string & str ) { append( str ); }
+
+    void append( const std::string & str,
+                 const size_t pos = 0, const size_t n = std::string::npos );
+
+    /* move length bytes from a pipe (where they must already be) to the
+       end of the body without copying them through user space. The body
+       is spilled to its file first, whatever its size */
+    void splice_from( FileDescriptor & pipe, const size_t length );
+
+    size_t size( void ) const { return size_; }
+    bool empty( void ) const { return size_ == 0; }
+
+    /* hand the body over in pieces: the string itself if it's in memory,
+       or a buffer at a time if it has to be read back from its file */
+    void for_each_piece( const std::function<void( const char *, size_t )> & handler ) const;
+
+    /* the whole body as one string */
+    std::string str( void ) const;
+
+    /* bodies that grow past threshold bytes are moved to a file in the given
+       directory (not thread-safe: set it before parsing starts) */
+    static void spill_bodies_over( const size_t threshold, const std::string & directory );
+};
+
+#endif /* MESSAGE_BODY_HH */
@@ -0,0 +1,99 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+#include <cstring>
+
+#include "parse_buffer.hh"
+
+using namespace std;
+
+bool ParseBuffer::have_complete_line( void )
+{
+    if ( line_ending_ != string::npos ) {
+        return true;
+    }
+
+    /* a CRLF is found by its LF (with memchr), which is never the first
+       unconsumed byte */
+    const char * const data = buffer_.data();
+    size_t search_from = max( scanned_to_, offset_ + 1 );
+
+    while ( search_from < buffer_.size() ) {
+        const char * newline = static_cast<const char *>( memchr( data + search_from, '\n',
+                                                                  buffer_.size() - search_from ) );
+        if ( not newline ) {
+            break;
+        }
+
+        const size_t position = newline - data;
+        if ( data[ position - 1 ] == '\r' ) {
+            line_ending_ = position - 1;
+            return true;
+        }
+
+        search_from = position + 1;
+    }
+
+    scanned_to_ = buffer_.size();
+    return false;
+}
+
+string ParseBuffer::get_and_pop_line( void )
+{
+    const bool found = have_complete_line();
+    assert( found );
+    (void) found;
+
+    string line( buffer_, offset_, line_ending_ - offset_ );
+    pop_bytes( line_ending_ + 2 - offset_ );
+
+    return line;
+}
+
+void ParseBuffer::pop_bytes( const size_t n )
+{
+    assert( size() >= n );
+
+    offset_ += n;
+
+    if ( line_ending_ != string::npos and line_ending_ < offset_ ) {
+        line_ending_ = string::npos;
+    }
+
+    if ( empty() ) {
+        buffer_.clear();
+        offset_ = scanned_to_ = 0;
+    }
+}
+
+void ParseBuffer::append( const string & str )
+{
+    /* drop the consumed bytes when that would at least halve the buffer,
+       so each byte is moved at most once on average */
+    if ( offset_ > 0 and offset_ >= size() ) {
+        compact();
+    }
+
+    buffer_.append( str );
+}
+
+const string & ParseBuffer::str( void )
+{
+    compact();
+    return buffer_;
+}
+
+void ParseBuffer::compact( void )
+{
+    if ( offset_ == 0 ) {
+        return;
+    }
+
+    buffer_.erase( 0, offset_ );
+
+    scanned_to_ = scanned_to_ > offset_ ? scanned_to_ - offset_ : 0;
+    if ( line_ending_ != string::npos ) {
+        line_ending_ -= offset_;
+    }
+    offset_ = 0;
+}
@@ -0,0 +1,42 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PARSE_BUFFER_HH
+#define PARSE_BUFFER_HH
+
+#include <string>
+
+/* bytes received but not yet parsed, for the request and response
+   parsers. Consuming bytes only advances an offset, and the search for
+   the end of a line picks up where the last one stopped, so parsing a
+   message that arrives in many small pieces stays linear in its size.
+   The consumed bytes are dropped only once they outweigh the rest. */
+class ParseBuffer
+{
+private:
+    std::string buffer_ {};
+
+    size_t offset_ {0};       /* start of the unconsumed bytes */
+    size_t scanned_to_ {0};   /* no line ending starts before here (past offset_) */
+    size_t line_ending_ {std::string::npos}; /* of the first line, once found */
+
+    void compact( void );
+
+public:
+    bool have_complete_line( void );
+
+    /* the first line, without its CRLF */
+    std::string get_and_pop_line( void );
+
+    void pop_bytes( const size_t n );
+
+    bool empty( void ) const { return offset_ == buffer_.size(); }
+
+    size_t size( void ) const { return buffer_.size() - offset_; }
+
+    void append( const std::string & str );
+
+    /* the unconsumed bytes */
+    const std::string & str( void );
+};
+
+#endif /* PARSE_BUFFER_HH */
@@ -14,9 +14,9 @@
 #include "exception.hh"
 #include "file_descriptor.hh"
 #include "http_proxy.hh"
-#include "http_request_parser.hh"
-#include "http_response_parser.hh"
 #include "poller.hh"
+#include "proxy_connection.hh"
+#include "proxy_worker.hh"
 #include "secure_socket.hh"
 #include "socket.hh"
 #include "system_runner.hh"
@@ -26,105 +26,32 @@ using namespace std;
 using namespace PollerShortNames;
 
 HTTPProxy::HTTPProxy(const Address &listener_addr)
-    : listener_socket_(), server_context_(SERVER), client_context_(CLIENT) {
+    : workers_(), next_worker_(0), listener_socket_(), server_context_(SERVER),
+      client_context_(CLIENT) {
   listener_socket_.bind(listener_addr);
   listener_socket_.listen();
 }
 
-template <class SocketType>
-void HTTPProxy::loop(SocketType &server, SocketType &client,
-                     HTTPBackingStore &backing_store) {
-  Poller poller;
+HTTPProxy::~HTTPProxy() {}
 
-  HTTPRequestParser request_parser;
-  HTTPResponseParser response_parser;
-
-  const Address server_addr = client.original_dest();
-
-  /* poll on original connect socket and new connection socket to ferry packets
-   */
-  /* responses from server go to response parser */
-  poller.add_action(Poller::Action(server, Direction::In,
-                                   [&]() {
-                                     string buffer = server.read();
-                                     response_parser.parse(buffer);
-                                     return ResultType::Continue;
-                                   },
-                                   [&]() { return not client.eof(); }));
-
-  /* requests from client go to request parser */
-  poller.add_action(Poller::Action(client, Direction::In,
-                                   [&]() {
-                                     string buffer = client.read();
-                                     request_parser.parse(buffer);
-                                     return ResultType::Continue;
-                                   },
-                                   [&]() { return not server.eof(); }));
-
-  /* completed requests from client are serialized and sent to server */
-  poller.add_action(Poller::Action(
-      server, Direction::Out,
-      [&]() {
-        server.write(request_parser.front().str());
-        response_parser.new_request_arrived(request_parser.front());
-        request_parser.pop();
-        return ResultType::Continue;
-      },
-      [&]() { return not request_parser.empty(); }));
-
-  /* completed responses from server are serialized and sent to client */
-  poller.add_action(
-      Poller::Action(client, Direction::Out,
-                     [&]() {
-                       client.write(response_parser.front().str());
-                       // complete()
-                       backing_store.save(response_parser.front(), server_addr);
-                       response_parser.pop();
-                       return ResultType::Continue;
-                     },
-                     [&]() { return not response_parser.empty(); }));
-
-  while (true) {
-    if (poller.poll(-1).result == Poller::Result::Type::Exit) {
-      return;
+/* accept a connection and hand it to a worker, round-robin */
+void HTTPProxy::handle_tcp(HTTPBackingStore &backing_store) {
+  if (workers_.empty()) {
+    const unsigned int worker_count = max(1u, thread::hardware_concurrency());
+    for (unsigned int i = 0; i < worker_count; i++) {
+      workers_.emplace_back(new ProxyWorker());
     }
   }
-}
 
-void HTTPProxy::handle_tcp(HTTPBackingStore &backing_store) {
-  thread newthread(
-      [&](TCPSocket client) {
-        try {
-          /* get original destination for connection request */
-          Address server_addr = client.original_dest();
-
-          /* create socket and connect to original destination and send original
-           * request */
-          TCPSocket server;
-          server.connect(server_addr);
-
-          if (server_addr.port() != 443) { /* normal HTTP */
-            return loop(server, client, backing_store);
-          }
-
-          /* handle TLS */
-          SecureSocket tls_server(
-              client_context_.new_secure_socket(move(server)));
-          tls_server.connect();
+  TCPSocket client = listener_socket_.accept();
 
-          SecureSocket tls_client(
-              server_context_.new_secure_socket(move(client)));
-          tls_client.accept();
-
-          loop(tls_server, tls_client, backing_store);
-        } catch (const exception &e) {
-          print_exception(e);
-        }
-      },
-      listener_socket_.accept());
-
-  /* don't wait around for the reply */
-  newthread.detach();
+  try {
+    workers_.at(next_worker_++ % workers_.size())
+        ->add(ProxyConnection::start(move(client), server_context_,
+                                     client_context_, backing_store));
+  } catch (const exception &e) {
+    print_exception(e);
+  }
 }
 
 /* register this HTTPProxy's TCP listener socket to handle events with
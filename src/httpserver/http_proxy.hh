@@ -3,7 +3,9 @@
 #ifndef HTTP_PROXY_HH
 #define HTTP_PROXY_HH
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "http_response.hh"
 #include "secure_socket.hh"
@@ -14,12 +16,14 @@ class EventLoop;
 class Poller;
 class HTTPRequestParser;
 class HTTPResponseParser;
+class ProxyWorker;
 
 class HTTPProxy {
 private:
-  template <class SocketType>
-  void loop(SocketType &server, SocketType &client,
-            HTTPBackingStore &backing_store);
+  /* connections are spread over one worker per core, started with the first
+     connection (so in the process that serves them) */
+  std::vector<std::unique_ptr<ProxyWorker>> workers_;
+  size_t next_worker_;
 
 protected:
   TCPSocket listener_socket_;
@@ -27,6 +31,7 @@ protected:
 
 public:
   HTTPProxy(const Address &listener_addr);
+  virtual ~HTTPProxy();
 
   TCPSocket &tcp_listener(void) { return listener_socket_; }
 
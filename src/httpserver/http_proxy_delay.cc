@@ -66,7 +66,7 @@ void HTTPProxyDelay::loop( SocketType & server, SocketType & client )
     poller.add_action( Poller::Action( server, Direction::Out,
                                        [&] () {
                                            server.write( request_parser.front().str() );
-                                           response_parser.new_request_arrived( request_parser.front() );
+                                           response_parser.new_request_arrived( move( request_parser.front() ) );
                                            request_parser.pop();
                                            return ResultType::Continue;
                                        },
@@ -0,0 +1,469 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+#include <type_traits>
+
+#include <fcntl.h>
+
+#include "proxy_connection.hh"
+#include "backing_store.hh"
+#include "exception.hh"
+#include "http_request_parser.hh"
+#include "http_response_parser.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+namespace {
+/* bytes held for one side of a connection before reading from the other
+   side pauses */
+const size_t MAX_PENDING_BYTES = 1024 * 1024;
+
+/* plain-HTTP response bodies at least this long are spliced */
+const size_t MIN_SPLICED_BODY_LENGTH = 64 * 1024;
+
+/* a response body on its way from a plain server socket to the client
+   through a pipe, so that it never enters user space, with tee() copying
+   it into a second pipe from which it is spliced into the recording */
+class BodySplice {
+private:
+  pair<FileDescriptor, FileDescriptor> relay_, tap_;
+  size_t capacity_;
+
+  size_t remaining_{0}; /* of the body, still to come from the server */
+  size_t queued_{0};    /* in the relay pipe, not yet passed to the client */
+
+public:
+  BodySplice()
+      : relay_(FileDescriptor::make_pipe()), tap_(FileDescriptor::make_pipe()),
+        capacity_(0) {
+    /* the tap has to hold whatever the relay pipe does */
+    const int size = MAX_PENDING_BYTES;
+    fcntl(relay_.second.fd_num(), F_SETPIPE_SZ, size);
+    fcntl(tap_.second.fd_num(), F_SETPIPE_SZ, size);
+    capacity_ = min(SystemCall("fcntl F_GETPIPE_SZ",
+                               fcntl(relay_.second.fd_num(), F_GETPIPE_SZ)),
+                    SystemCall("fcntl F_GETPIPE_SZ",
+                               fcntl(tap_.second.fd_num(), F_GETPIPE_SZ)));
+  }
+
+  void start(const size_t body_length) { remaining_ = body_length; }
+
+  bool active(void) const { return remaining_ > 0; }
+  bool empty(void) const { return queued_ == 0; }
+
+  /* move the next part of the body from the server into the empty relay
+     pipe, and return how much was moved */
+  size_t pull(FileDescriptor &server) {
+    assert(active() and empty());
+
+    const size_t moved =
+        relay_.second.splice_from(server, min(remaining_, capacity_));
+    remaining_ -= moved;
+    queued_ += moved;
+    return moved;
+  }
+
+  /* copy what pull() just moved (from the front of the relay pipe) into
+     the empty tap. Returns false if the copy fell short */
+  bool tee(const size_t length) {
+    return length == 0 or tap_.second.tee_from(relay_.first, length) == length;
+  }
+
+  /* where the copy is to be spliced from */
+  FileDescriptor &tap(void) { return tap_.first; }
+
+  void push(FileDescriptor &client) {
+    queued_ -= client.splice_from(relay_.first, queued_);
+  }
+};
+
+/* bytes on their way to one side of a connection */
+class Outbox {
+private:
+  string buffer_{};
+  size_t offset_{0};
+
+public:
+  void append(const string &str) { buffer_.append(str); }
+
+  size_t size(void) const { return buffer_.size() - offset_; }
+  bool empty(void) const { return size() == 0; }
+
+  /* write what the socket will take without blocking */
+  template <class SocketType> void write_to(SocketType &socket) {
+    offset_ = socket.write(buffer_.cbegin() + offset_, buffer_.cend()) -
+              buffer_.cbegin();
+    if (offset_ == buffer_.size()) {
+      buffer_.clear();
+      offset_ = 0;
+    }
+  }
+};
+
+/* bytes are passed between the client and the server as they arrive (so
+   an upload is streamed to the server, not held until it is complete).
+   The request and response parsers tap the same bytes, and each complete
+   response is saved with its request. From a plain server, long bodies of
+   known length are spliced */
+template <class SocketType> class Relay : public ProxyConnection {
+private:
+  SocketType server_, client_;
+  const Address server_addr_;
+  HTTPBackingStore &backing_store_;
+
+  HTTPRequestParser request_parser_{};
+  HTTPResponseParser response_parser_{};
+
+  /* whether the requests and responses are still being recorded */
+  bool recording_{true};
+
+  Outbox to_server_{}, to_client_{};
+
+  /* (created with the first spliced body) */
+  unique_ptr<BodySplice> splice_{};
+
+  bool splicing(void) const { return splice_ and splice_->active(); }
+
+  /* has everything spliced been passed to the client? */
+  bool splice_empty(void) const { return not splice_ or splice_->empty(); }
+
+  bool reading_server(void) const {
+    if (server_.eof() or client_.eof() or not splice_empty()) {
+      return false;
+    }
+
+    return splicing() or to_client_.size() < MAX_PENDING_BYTES;
+  }
+
+  bool reading_client(void) const {
+    return not client_.eof() and not server_.eof() and
+           to_server_.size() < MAX_PENDING_BYTES;
+  }
+
+  void maybe_start_splice(void) {
+    if (not is_same<SocketType, TCPSocket>::value or not recording_) {
+      return;
+    }
+
+    const size_t body_length = response_parser_.body_bytes_remaining();
+    if (body_length >= MIN_SPLICED_BODY_LENGTH) {
+      if (not splice_) {
+        splice_.reset(new BodySplice());
+      }
+      splice_->start(body_length);
+    }
+  }
+
+  void splice_body(void) {
+    const size_t moved = splice_->pull(server_);
+    if (not recording_) {
+      return;
+    }
+
+    if (not splice_->tee(moved)) {
+      print_exception(
+          runtime_error("HTTPProxy: could not copy a spliced body to record"));
+      recording_ = false;
+      return;
+    }
+
+    if (moved == 0) {
+      if (server_.eof()) {
+        record_responses(string());
+      }
+      return;
+    }
+
+    /* the copy goes from the tap to the body's file, again by splice() */
+    try {
+      response_parser_.splice_body(splice_->tap(), moved);
+      save_responses();
+    } catch (const exception &e) {
+      print_exception(e);
+      recording_ = false;
+    }
+  }
+
+  void record_requests(const string &buffer) {
+    if (not recording_) {
+      return;
+    }
+
+    try {
+      request_parser_.parse(buffer);
+      while (not request_parser_.empty()) {
+        response_parser_.new_request_arrived(move(request_parser_.front()));
+        request_parser_.pop();
+      }
+    } catch (const exception &e) {
+      /* a request we can't parse is still passed along, just not recorded */
+      print_exception(e);
+      recording_ = false;
+    }
+  }
+
+  void record_responses(const string &buffer) {
+    if (not recording_) {
+      return;
+    }
+
+    try {
+      response_parser_.parse(buffer);
+      save_responses();
+    } catch (const exception &e) {
+      /* a response we can't parse is still passed along, just not recorded */
+      print_exception(e);
+      recording_ = false;
+    }
+  }
+
+  void save_responses(void) {
+    while (not response_parser_.empty()) {
+      /* (an interim response isn't what a replay should answer with) */
+      if (not response_parser_.front().is_interim()) {
+        backing_store_.save(response_parser_.front(), server_addr_);
+      }
+      response_parser_.pop();
+    }
+  }
+
+public:
+  Relay(SocketType &&server, SocketType &&client, const Address &server_addr,
+        HTTPBackingStore &backing_store)
+      : server_(move(server)), client_(move(client)),
+        server_addr_(server_addr), backing_store_(backing_store) {}
+
+  void add_actions(Poller &poller) override {
+    poller.add_action(Poller::Action(
+        server_, Direction::In, guard([&]() {
+          if (splicing()) {
+            splice_body();
+            return ResultType::Continue;
+          }
+
+          string buffer = server_.read();
+          if (buffer.empty() and not server_.eof()) {
+            return ResultType::Continue; /* only part of a TLS record */
+          }
+
+          to_client_.append(buffer);
+          record_responses(buffer);
+          maybe_start_splice();
+          return ResultType::Continue;
+        }),
+        [&]() { return reading_server(); }, error_handler()));
+
+    poller.add_action(Poller::Action(
+        client_, Direction::In, guard([&]() {
+          string buffer = client_.read();
+          if (buffer.empty() and not client_.eof()) {
+            return ResultType::Continue; /* only part of a TLS record */
+          }
+
+          to_server_.append(buffer);
+          record_requests(buffer);
+          return ResultType::Continue;
+        }),
+        [&]() { return reading_client(); }, error_handler()));
+
+    poller.add_action(Poller::Action(server_, Direction::Out, guard([&]() {
+                                       to_server_.write_to(server_);
+                                       return ResultType::Continue;
+                                     }),
+                                     [&]() { return not to_server_.empty(); },
+                                     error_handler()));
+
+    /* (what was read before a spliced body goes first) */
+    poller.add_action(Poller::Action(
+        client_, Direction::Out, guard([&]() {
+          if (not to_client_.empty()) {
+            to_client_.write_to(client_);
+          } else {
+            splice_->push(client_);
+          }
+          return ResultType::Continue;
+        }),
+        [&]() { return not to_client_.empty() or not splice_empty(); },
+        error_handler()));
+  }
+
+  void remove_actions(Poller &poller) override {
+    poller.remove_actions(server_);
+    poller.remove_actions(client_);
+  }
+
+  /* done once neither side is being read and everything read has been
+     passed on */
+  bool finished(void) const override {
+    return failed_ or not(reading_server() or reading_client() or
+                          not to_server_.empty() or not to_client_.empty() or
+                          not splice_empty());
+  }
+
+  unique_ptr<ProxyConnection> next(void) override { return nullptr; }
+};
+
+/* the TLS handshakes with the server and with the client, side by side.
+   The server's starts as soon as its socket is writable, i.e. once the
+   (non-blocking) connection to it is made, and the client's doesn't wait
+   for it, so the client isn't kept waiting on the server's round trips */
+class TLSHandshake : public ProxyConnection {
+private:
+  SecureSocket server_, client_;
+  const Address server_addr_;
+  HTTPBackingStore &backing_store_;
+
+  /* what each handshake is waiting for (a client's starts with its hello) */
+  SecureSocket::Handshake server_state_{SecureSocket::Handshake::WantWrite};
+  SecureSocket::Handshake client_state_{SecureSocket::Handshake::WantRead};
+
+public:
+  TLSHandshake(SecureSocket &&server, SecureSocket &&client,
+               const Address &server_addr, HTTPBackingStore &backing_store)
+      : server_(move(server)), client_(move(client)),
+        server_addr_(server_addr), backing_store_(backing_store) {}
+
+  void add_actions(Poller &poller) override {
+    const auto continue_server = guard([&]() {
+      server_state_ = server_.continue_connect();
+      return ResultType::Continue;
+    });
+
+    const auto continue_client = guard([&]() {
+      client_state_ = client_.continue_accept();
+      return ResultType::Continue;
+    });
+
+    poller.add_action(Poller::Action(
+        server_, Direction::In, continue_server,
+        [&]() { return server_state_ == SecureSocket::Handshake::WantRead; },
+        error_handler()));
+
+    poller.add_action(Poller::Action(
+        server_, Direction::Out, continue_server,
+        [&]() { return server_state_ == SecureSocket::Handshake::WantWrite; },
+        error_handler()));
+
+    poller.add_action(Poller::Action(
+        client_, Direction::In, continue_client,
+        [&]() { return client_state_ == SecureSocket::Handshake::WantRead; },
+        error_handler()));
+
+    poller.add_action(Poller::Action(
+        client_, Direction::Out, continue_client,
+        [&]() { return client_state_ == SecureSocket::Handshake::WantWrite; },
+        error_handler()));
+  }
+
+  void remove_actions(Poller &poller) override {
+    poller.remove_actions(server_);
+    poller.remove_actions(client_);
+  }
+
+  bool finished(void) const override {
+    return failed_ or (server_state_ == SecureSocket::Handshake::Done and
+                       client_state_ == SecureSocket::Handshake::Done);
+  }
+
+  unique_ptr<ProxyConnection> next(void) override {
+    if (failed_) {
+      return nullptr;
+    }
+
+    return unique_ptr<ProxyConnection>(new Relay<SecureSocket>(
+        move(server_), move(client_), server_addr_, backing_store_));
+  }
+};
+
+/* waiting for the connection to a plain HTTP server to be made */
+class Connect : public ProxyConnection {
+private:
+  TCPSocket server_, client_;
+  const Address server_addr_;
+  HTTPBackingStore &backing_store_;
+
+  bool connected_{false};
+
+public:
+  Connect(TCPSocket &&server, TCPSocket &&client, const Address &server_addr,
+          HTTPBackingStore &backing_store)
+      : server_(move(server)), client_(move(client)),
+        server_addr_(server_addr), backing_store_(backing_store) {}
+
+  void add_actions(Poller &poller) override {
+    /* a non-blocking connect is done when the socket becomes writable
+       (or fails with POLLERR) */
+    poller.add_action(Poller::Action(server_, Direction::Out,
+                                     [&]() {
+                                       connected_ = true;
+                                       return ResultType::Cancel;
+                                     },
+                                     [&]() { return not connected_; },
+                                     error_handler()));
+  }
+
+  void remove_actions(Poller &poller) override {
+    poller.remove_actions(server_);
+  }
+
+  bool finished(void) const override { return failed_ or connected_; }
+
+  unique_ptr<ProxyConnection> next(void) override {
+    if (failed_) {
+      return nullptr;
+    }
+
+    return unique_ptr<ProxyConnection>(new Relay<TCPSocket>(
+        move(server_), move(client_), server_addr_, backing_store_));
+  }
+};
+} // namespace
+
+Poller::Action::CallbackType
+ProxyConnection::guard(const Poller::Action::CallbackType &callback) {
+  return [this, callback]() {
+    /* another callback may have failed this round */
+    if (failed_) {
+      return Result(ResultType::Cancel);
+    }
+
+    try {
+      return callback();
+    } catch (const exception &e) {
+      print_exception(e);
+      failed_ = true;
+      return Result(ResultType::Cancel);
+    }
+  };
+}
+
+function<void(void)> ProxyConnection::error_handler(void) {
+  return [this]() { failed_ = true; };
+}
+
+unique_ptr<ProxyConnection>
+ProxyConnection::start(TCPSocket &&client, SSLContext &server_context,
+                       SSLContext &client_context,
+                       HTTPBackingStore &backing_store) {
+  /* get original destination for connection request */
+  const Address server_addr = client.original_dest();
+
+  TCPSocket server;
+  server.set_blocking(false);
+  server.connect(server_addr);
+
+  client.set_blocking(false);
+
+  if (server_addr.port() != 443) { /* normal HTTP */
+    return unique_ptr<ProxyConnection>(
+        new Connect(move(server), move(client), server_addr, backing_store));
+  }
+
+  /* handle TLS: the handshakes begin while the connection is being made */
+  return unique_ptr<ProxyConnection>(
+      new TLSHandshake(client_context.new_secure_socket(move(server),
+                                                        server_addr),
+                       server_context.new_secure_socket(move(client)),
+                       server_addr, backing_store));
+}
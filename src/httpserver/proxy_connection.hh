@@ -0,0 +1,50 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PROXY_CONNECTION_HH
+#define PROXY_CONNECTION_HH
+
+#include <functional>
+#include <memory>
+
+#include "poller.hh"
+#include "secure_socket.hh"
+#include "socket.hh"
+
+class HTTPBackingStore;
+
+/* one stage in the life of a connection through the HTTPProxy (connecting
+   to the server, the TLS handshakes, relaying), driven without blocking
+   by the poller of the ProxyWorker it was given to */
+class ProxyConnection {
+protected:
+  /* set when a callback fails; the connection is then dropped */
+  bool failed_{false};
+
+  /* run a callback, ending the connection if it throws */
+  Poller::Action::CallbackType
+  guard(const Poller::Action::CallbackType &callback);
+
+  /* for POLLERR/POLLHUP on one of the sockets */
+  std::function<void(void)> error_handler(void);
+
+public:
+  virtual void add_actions(Poller &poller) = 0;
+  virtual void remove_actions(Poller &poller) = 0;
+
+  /* is this stage over? */
+  virtual bool finished(void) const = 0;
+
+  /* the stage that follows a finished one (nullptr when the connection is
+     over) */
+  virtual std::unique_ptr<ProxyConnection> next(void) = 0;
+
+  virtual ~ProxyConnection() {}
+
+  /* start connecting to the original destination of a client's connection,
+     and return the first stage */
+  static std::unique_ptr<ProxyConnection>
+  start(TCPSocket &&client, SSLContext &server_context,
+        SSLContext &client_context, HTTPBackingStore &backing_store);
+};
+
+#endif /* PROXY_CONNECTION_HH */
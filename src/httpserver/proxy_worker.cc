@@ -0,0 +1,86 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "proxy_worker.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+ProxyWorker::ProxyWorker()
+    : wakeup_(UnixDomainSocket::make_pair()), thread_([this]() { loop(); }) {}
+
+ProxyWorker::~ProxyWorker() {
+  {
+    unique_lock<mutex> ul(mutex_);
+    stopping_ = true;
+  }
+
+  wakeup_.first.write("x");
+  thread_.join();
+}
+
+void ProxyWorker::add(unique_ptr<ProxyConnection> &&connection) {
+  {
+    unique_lock<mutex> ul(mutex_);
+    arrivals_.emplace_back(move(connection));
+  }
+
+  wakeup_.first.write("x");
+}
+
+bool ProxyWorker::take_arrivals(void) {
+  unique_lock<mutex> ul(mutex_);
+
+  for (auto &connection : arrivals_) {
+    connection->add_actions(poller_);
+    connections_.emplace_back(move(connection));
+  }
+  arrivals_.clear();
+
+  return stopping_;
+}
+
+void ProxyWorker::advance_connections(void) {
+  auto it = connections_.begin();
+  while (it != connections_.end()) {
+    if (not(*it)->finished()) {
+      it++;
+      continue;
+    }
+
+    (*it)->remove_actions(poller_);
+
+    try {
+      unique_ptr<ProxyConnection> next = (*it)->next();
+      if (next) {
+        next->add_actions(poller_);
+        *it = move(next);
+        it++;
+        continue;
+      }
+    } catch (const exception &e) {
+      print_exception(e);
+    }
+
+    it = connections_.erase(it);
+  }
+}
+
+void ProxyWorker::loop(void) {
+  poller_.add_action(Poller::Action(wakeup_.second, Direction::In, [&]() {
+    wakeup_.second.read();
+    return take_arrivals() ? ResultType::Exit : ResultType::Continue;
+  }));
+
+  while (true) {
+    try {
+      if (poller_.poll(-1).result == Poller::Result::Type::Exit) {
+        return;
+      }
+    } catch (const exception &e) {
+      print_exception(e);
+    }
+
+    advance_connections();
+  }
+}
@@ -0,0 +1,55 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PROXY_WORKER_HH
+#define PROXY_WORKER_HH
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "poller.hh"
+#include "proxy_connection.hh"
+#include "socketpair.hh"
+
+/* a thread that serves many proxied connections with one poller */
+class ProxyWorker {
+private:
+  /* handed over by the dispatcher */
+  std::mutex mutex_{};
+  std::vector<std::unique_ptr<ProxyConnection>> arrivals_{};
+  bool stopping_{false};
+
+  /* the dispatcher writes to the first to wake up the worker */
+  std::pair<UnixDomainSocket, UnixDomainSocket> wakeup_;
+
+  /* only touched by the worker thread */
+  Poller poller_{};
+  std::list<std::unique_ptr<ProxyConnection>> connections_{};
+
+  /* (started last, once the rest is ready) */
+  std::thread thread_;
+
+  void loop(void);
+
+  /* move arrivals to connections_; returns whether to stop */
+  bool take_arrivals(void);
+
+  /* move finished connections on to their next stage, or drop them */
+  void advance_connections(void);
+
+public:
+  ProxyWorker();
+  ~ProxyWorker();
+
+  /* give the worker a connection to serve (from any thread) */
+  void add(std::unique_ptr<ProxyConnection> &&connection);
+
+  /* forbid copying */
+  ProxyWorker(const ProxyWorker &other) = delete;
+  ProxyWorker &operator=(const ProxyWorker &other) = delete;
+};
+
+#endif /* PROXY_WORKER_HH */
@@ -71,9 +71,42 @@ SSL_CTX *initialize_new_context(const SSL_MODE type) {
   return ret;
 }
 
+/* where a client SSL keeps the key of its server in SSLContext::sessions_
+   (OpenSSL deletes it along with the SSL) */
+void free_server_key(void *, void *key, CRYPTO_EX_DATA *, int, long, void *) {
+  delete static_cast<string *>(key);
+}
+
+int server_key_index(void) {
+  static const int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_server_key);
+  return index;
+}
+
+/* (anything unique to the proxy, so it only resumes its own sessions) */
+const unsigned char SESSION_ID_CONTEXT[] = "mahimahi";
+
 SSLContext::SSLContext(const SSL_MODE type)
     : ctx_(initialize_new_context(type)) {
+  if (type == CLIENT) {
+    /* sessions are kept per server in sessions_, not in OpenSSL's cache
+       (which a client never looks up) */
+    SSL_CTX_set_session_cache_mode(ctx_.get(),
+                                   SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_set_app_data(ctx_.get(), this);
+    SSL_CTX_sess_set_new_cb(ctx_.get(), new_session);
+  }
+
   if (type == SERVER) {
+    /* clients may resume with a session ID (from the context's cache,
+       which is shared by the proxy's threads) or a session ticket */
+    SSL_CTX_set_session_cache_mode(ctx_.get(), SSL_SESS_CACHE_SERVER);
+    if (not SSL_CTX_set_session_id_context(ctx_.get(), SESSION_ID_CONTEXT,
+                                           sizeof(SESSION_ID_CONTEXT) - 1)) {
+      throw ssl_error("SSL_CTX_set_session_id_context");
+    }
+
     if (not SSL_CTX_use_certificate_ASN1(ctx_.get(), 678, certificate)) {
       throw ssl_error("SSL_CTX_use_certificate_ASN1");
     }
@@ -101,14 +134,59 @@ SecureSocket::SecureSocket(TCPSocket &&sock, SSL *ssl)
   }
 
   /* enable read/write to return only after handshake/renegotiation and
-   * successful completion */
-  SSL_set_mode(ssl_.get(), SSL_MODE_AUTO_RETRY);
+   * successful completion; a write that would block may be retried from a
+   * buffer that has since moved */
+  SSL_set_mode(ssl_.get(),
+               SSL_MODE_AUTO_RETRY | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 }
 
 SecureSocket SSLContext::new_secure_socket(TCPSocket &&sock) {
   return SecureSocket(move(sock), SSL_new(ctx_.get()));
 }
 
+SecureSocket SSLContext::new_secure_socket(TCPSocket &&sock,
+                                           const Address &server) {
+  SecureSocket ret(move(sock), SSL_new(ctx_.get()));
+
+  const string key = server.str();
+  if (not SSL_set_ex_data(ret.ssl_.get(), server_key_index(),
+                          new string(key))) {
+    throw ssl_error("SSL_set_ex_data");
+  }
+
+  unique_lock<mutex> lock(sessions_mutex_);
+  const auto session = sessions_.find(key);
+  if (session != sessions_.end()) {
+    if (not SSL_set_session(ret.ssl_.get(), session->second.get())) {
+      throw ssl_error("SSL_set_session");
+    }
+  }
+
+  return ret;
+}
+
+int SSLContext::new_session(SSL *ssl, SSL_SESSION *session) {
+  const string *key =
+      static_cast<const string *>(SSL_get_ex_data(ssl, server_key_index()));
+  if (not key or not SSL_SESSION_is_resumable(session)) {
+    return 0;
+  }
+
+  /* a copy, since OpenSSL marks the connection's own session as not
+     resumable if the connection isn't shut down cleanly */
+  SESSION_handle copy(SSL_SESSION_dup(session));
+  if (not copy) {
+    return 0;
+  }
+
+  SSLContext &context =
+      *static_cast<SSLContext *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+  unique_lock<mutex> lock(context.sessions_mutex_);
+  context.sessions_[*key] = move(copy);
+  return 0; /* (OpenSSL keeps its reference to the original) */
+}
+
 void SecureSocket::connect(void) {
   if (not SSL_connect(ssl_.get())) {
     throw ssl_error("SSL_connect");
@@ -126,6 +204,38 @@ void SecureSocket::accept(void) {
   register_read();
 }
 
+/* what a step of a non-blocking handshake came to */
+static SecureSocket::Handshake handshake_status(SSL *ssl, const int ret,
+                                                const string &attempt) {
+  if (ret == 1) {
+    return SecureSocket::Handshake::Done;
+  }
+
+  switch (SSL_get_error(ssl, ret)) {
+  case SSL_ERROR_WANT_READ:
+    return SecureSocket::Handshake::WantRead;
+  case SSL_ERROR_WANT_WRITE:
+    return SecureSocket::Handshake::WantWrite;
+  default:
+    throw ssl_error(attempt);
+  }
+}
+
+SecureSocket::Handshake SecureSocket::continue_connect(void) {
+  const auto ret = SSL_connect(ssl_.get());
+  /* (the handshake both reads and writes) */
+  register_read();
+  register_write();
+  return handshake_status(ssl_.get(), ret, "SSL_connect");
+}
+
+SecureSocket::Handshake SecureSocket::continue_accept(void) {
+  const auto ret = SSL_accept(ssl_.get());
+  register_read();
+  register_write();
+  return handshake_status(ssl_.get(), ret, "SSL_accept");
+}
+
 string SecureSocket::read(void) {
   /* SSL record max size is 16kB */
   const size_t SSL_max_record_length = 16384;
@@ -150,6 +260,12 @@ string SecureSocket::read(void) {
     register_read();
     return string(); /* EOF */
   } else if (bytes_read < 0) {
+    const int error_return = SSL_get_error(ssl_.get(), bytes_read);
+    if (error_return == SSL_ERROR_WANT_READ or
+        error_return == SSL_ERROR_WANT_WRITE) { /* non-blocking, try later */
+      register_read();
+      return string();
+    }
     throw ssl_error("SSL_read");
   } else {
     /* success */
@@ -170,3 +286,38 @@ void SecureSocket::write(const string &message) {
 
   register_write();
 }
+
+string::const_iterator
+SecureSocket::write(const string::const_iterator &begin,
+                    const string::const_iterator &end) {
+  /* SSL record max size is 16kB */
+  const size_t SSL_max_record_length = 16384;
+
+  auto it = begin;
+
+  while (it < end) {
+    /* a write that would have blocked must be retried with the same length */
+    const size_t length =
+        retry_length_ ? retry_length_
+                      : min(size_t(end - it), SSL_max_record_length);
+    assert(length <= size_t(end - it));
+
+    const int bytes_written = SSL_write(ssl_.get(), &*it, length);
+    if (bytes_written <= 0) {
+      const int error_return = SSL_get_error(ssl_.get(), bytes_written);
+      if (error_return == SSL_ERROR_WANT_WRITE or
+          error_return == SSL_ERROR_WANT_READ) {
+        retry_length_ = length;
+        break;
+      }
+      throw ssl_error("SSL_write");
+    }
+
+    retry_length_ = 0;
+    it += bytes_written;
+  }
+
+  register_write();
+
+  return it;
+}
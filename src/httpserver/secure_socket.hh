@@ -5,10 +5,15 @@
 #ifndef SECURE_SOCKET_HH
 #define SECURE_SOCKET_HH
 
+#include <map>
+#include <mutex>
+#include <string>
+
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
 #include "socket.hh"
+#include "address.hh"
 
 enum SSL_MODE { CLIENT, SERVER };
 
@@ -21,14 +26,31 @@ private:
     typedef std::unique_ptr<SSL, SSL_deleter> SSL_handle;
     SSL_handle ssl_;
 
+    /* length of an SSL_write that has to be retried */
+    size_t retry_length_ {0};
+
     SecureSocket( TCPSocket && sock, SSL * ssl );
 
 public:
     void connect( void );
     void accept( void );
 
+    /* for a non-blocking socket: make what progress the handshake can
+       without blocking, and say whether it is done or which way the
+       socket must become ready before the next try */
+    enum class Handshake { Done, WantRead, WantWrite };
+    Handshake continue_connect( void );
+    Handshake continue_accept( void );
+
+    /* (on a non-blocking socket, returns nothing without setting eof
+       if only part of a record has arrived) */
     std::string read( void );
     void write( const std::string & message );
+
+    /* for a non-blocking socket: write what can be written without
+       blocking, and return where to pick up */
+    std::string::const_iterator write( const std::string::const_iterator & begin,
+                                       const std::string::const_iterator & end );
 };
 
 class SSLContext
@@ -38,10 +60,25 @@ private:
     typedef std::unique_ptr<SSL_CTX, CTX_deleter> CTX_handle;
     CTX_handle ctx_;
 
+    /* (client) the latest session with each server ("ip:port"), to resume
+       on the next connection to it; shared by the proxy's threads */
+    struct SESSION_deleter { void operator()( SSL_SESSION * x ) const { SSL_SESSION_free( x ); } };
+    typedef std::unique_ptr<SSL_SESSION, SESSION_deleter> SESSION_handle;
+    std::map<std::string, SESSION_handle> sessions_ {};
+    std::mutex sessions_mutex_ {};
+
+    /* called by OpenSSL when a server hands over a session (for TLS 1.3,
+       possibly after the handshake) */
+    static int new_session( SSL * ssl, SSL_SESSION * session );
+
 public:
     SSLContext( const SSL_MODE type );
 
     SecureSocket new_secure_socket( TCPSocket && sock );
+
+    /* (client) for a connection to the given server, resuming the session
+       from the last connection to it if there is one */
+    SecureSocket new_secure_socket( TCPSocket && sock, const Address & server );
 };
 
 #endif
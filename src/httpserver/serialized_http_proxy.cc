@@ -77,7 +77,7 @@ void SerializedHTTPProxy::serialized_loop(SocketType &server,
       server, Direction::Out,
       [&]() {
         server.write(request_parser.front().str());
-        response_parser.new_request_arrived(request_parser.front());
+        response_parser.new_request_arrived(move(request_parser.front()));
         request_parser.pop();
         return ResultType::Continue;
       },
@@ -150,7 +150,9 @@ void SerializedHTTPProxy::serialized_loop(SocketType &server,
         cout << "URL: " << url << " End: " << to_string(end_seconds.count())
              << endl;
 
-        backing_store.save(response_parser.front(), server_addr);
+        if (not response_parser.front().is_interim()) {
+          backing_store.save(response_parser.front(), server_addr);
+        }
         response_parser.pop();
 
         // We are done with this response, unlock the lock and notify the
@@ -0,0 +1,160 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "packet_info.hh"
+#include "exception.hh"
+
+using namespace std;
+
+namespace {
+    /* struct tun_pi, which precedes each packet */
+    const size_t TUN_HEADER_LENGTH = 4;
+
+    /* header fields might not be aligned in the string */
+    template <typename T>
+    bool read_header( const string & contents, const size_t offset, T & header )
+    {
+        if ( contents.size() < offset + sizeof( T ) ) {
+            return false;
+        }
+
+        memcpy( &header, contents.data() + offset, sizeof( T ) );
+        return true;
+    }
+
+    /* FNV-1a */
+    uint32_t hash_bytes( uint32_t hash, const void * data, const size_t length )
+    {
+        const uint8_t * bytes = static_cast<const uint8_t *>( data );
+        for ( size_t i = 0; i < length; i++ ) {
+            hash = ( hash ^ bytes[ i ] ) * 16777619;
+        }
+        return hash;
+    }
+
+    string address_string( const int family, const array<uint8_t, 16> & address )
+    {
+        char buffer[ INET6_ADDRSTRLEN ];
+        if ( not inet_ntop( family, address.data(), buffer, sizeof( buffer ) ) ) {
+            throw unix_error( "inet_ntop" );
+        }
+        return buffer;
+    }
+}
+
+PacketInfo::PacketInfo( const string & contents )
+{
+    const size_t network_start = TUN_HEADER_LENGTH;
+    size_t transport_start;
+    uint8_t next_header;
+    bool first_fragment = true;
+
+    uint8_t version_byte;
+    if ( not read_header( contents, network_start, version_byte ) ) {
+        return;
+    }
+
+    if ( version_byte >> 4 == 4 ) {
+        iphdr ip;
+        if ( not read_header( contents, network_start, ip ) or ip.ihl < 5 ) {
+            return;
+        }
+
+        memcpy( source_address.data(), &ip.saddr, sizeof( ip.saddr ) );
+        memcpy( destination_address.data(), &ip.daddr, sizeof( ip.daddr ) );
+        next_header = ip.protocol;
+        transport_start = network_start + 4 * ip.ihl;
+        first_fragment = ( ntohs( ip.frag_off ) & IP_OFFMASK ) == 0;
+        ip_version = 4;
+    } else if ( version_byte >> 4 == 6 ) {
+        ip6_hdr ip;
+        if ( not read_header( contents, network_start, ip ) ) {
+            return;
+        }
+
+        memcpy( source_address.data(), &ip.ip6_src, sizeof( ip.ip6_src ) );
+        memcpy( destination_address.data(), &ip.ip6_dst, sizeof( ip.ip6_dst ) );
+        next_header = ip.ip6_nxt;
+        transport_start = network_start + sizeof( ip );
+
+        /* skip extension headers to find the transport header */
+        while ( true ) {
+            ip6_ext extension;
+            if ( next_header == IPPROTO_HOPOPTS or next_header == IPPROTO_ROUTING
+                 or next_header == IPPROTO_DSTOPTS ) {
+                if ( not read_header( contents, transport_start, extension ) ) {
+                    return;
+                }
+                next_header = extension.ip6e_nxt;
+                transport_start += 8 * ( extension.ip6e_len + 1 );
+            } else if ( next_header == IPPROTO_FRAGMENT ) {
+                ip6_frag fragment;
+                if ( not read_header( contents, transport_start, fragment ) ) {
+                    return;
+                }
+                next_header = fragment.ip6f_nxt;
+                transport_start += sizeof( fragment );
+                first_fragment = ( fragment.ip6f_offlg & IP6F_OFF_MASK ) == 0;
+            } else {
+                break;
+            }
+        }
+
+        ip_version = 6;
+    } else {
+        return;
+    }
+
+    protocol = next_header;
+    network_offset = network_start;
+    transport_offset = transport_start;
+    payload_offset = transport_start;
+
+    /* later fragments have no transport header */
+    if ( first_fragment ) {
+        if ( protocol == IPPROTO_TCP ) {
+            tcphdr tcp;
+            if ( read_header( contents, transport_start, tcp ) ) {
+                source_port = ntohs( tcp.th_sport );
+                destination_port = ntohs( tcp.th_dport );
+                tcp_flags = tcp.th_flags;
+                payload_offset = transport_start + 4 * tcp.th_off;
+            }
+        } else if ( protocol == IPPROTO_UDP ) {
+            udphdr udp;
+            if ( read_header( contents, transport_start, udp ) ) {
+                source_port = ntohs( udp.uh_sport );
+                destination_port = ntohs( udp.uh_dport );
+                payload_offset = transport_start + sizeof( udp );
+            }
+        }
+    }
+
+    payload_length = contents.size() > payload_offset ? contents.size() - payload_offset : 0;
+
+    const size_t address_length = ip_version == 4 ? 4 : 16;
+    flow_hash = 2166136261;
+    flow_hash = hash_bytes( flow_hash, &protocol, sizeof( protocol ) );
+    flow_hash = hash_bytes( flow_hash, source_address.data(), address_length );
+    flow_hash = hash_bytes( flow_hash, destination_address.data(), address_length );
+    flow_hash = hash_bytes( flow_hash, &source_port, sizeof( source_port ) );
+    flow_hash = hash_bytes( flow_hash, &destination_port, sizeof( destination_port ) );
+}
+
+string PacketInfo::source_ip( void ) const
+{
+    return address_string( ip_version == 6 ? AF_INET6 : AF_INET, source_address );
+}
+
+string PacketInfo::destination_ip( void ) const
+{
+    return address_string( ip_version == 6 ? AF_INET6 : AF_INET, destination_address );
+}
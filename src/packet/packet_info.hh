@@ -0,0 +1,48 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_INFO_HH
+#define PACKET_INFO_HH
+
+#include <string>
+#include <array>
+#include <cstdint>
+
+/* what a stage might want to know about a packet, parsed once from its
+   bytes as read from the TUN device (starting with the 4-byte tun_pi
+   header) so that queues, meters and classifiers don't each reparse or
+   copy them. Anything that isn't a well-formed IPv4 or IPv6 packet has
+   ip_version 0; fields past what could be parsed are left 0. */
+struct PacketInfo
+{
+    uint8_t ip_version { 0 };
+    uint8_t protocol { 0 };  /* of the transport header, e.g. IPPROTO_TCP */
+    uint8_t tcp_flags { 0 }; /* TH_SYN etc., for TCP */
+
+    /* into the contents (which include tun_pi) */
+    uint16_t network_offset { 0 };
+    uint16_t transport_offset { 0 };
+    uint16_t payload_offset { 0 };
+
+    uint32_t payload_length { 0 }; /* bytes after the transport header */
+
+    /* network byte order; an IPv4 address fills the first 4 bytes */
+    std::array<uint8_t, 16> source_address {};
+    std::array<uint8_t, 16> destination_address {};
+
+    /* host byte order, for TCP and UDP */
+    uint16_t source_port { 0 };
+    uint16_t destination_port { 0 };
+
+    /* of the 5-tuple, for spreading flows over queues */
+    uint32_t flow_hash { 0 };
+
+    PacketInfo() {}
+    PacketInfo( const std::string & contents );
+
+    bool is_ip( void ) const { return ip_version != 0; }
+
+    std::string source_ip( void ) const;
+    std::string destination_ip( void ) const;
+};
+
+#endif /* PACKET_INFO_HH */
@@ -10,25 +10,28 @@
 #include "packetshell.hh"
 #include "netdevice.hh"
 #include "nat.hh"
+#include "system_runner.hh"
 #include "util.hh"
-#include "interfaces.hh"
 #include "address.hh"
-#include "dns_server.hh"
 #include "timestamp.hh"
 #include "exception.hh"
 #include "bindworkaround.hh"
 #include "config.h"
-#include "vpn.hh"
+#include "udp_tunnel.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
 template <class FerryQueueType>
-PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment )
+PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment,
+                                          const Device device )
     : user_environment_( user_environment ),
-      egress_ingress( two_unassigned_addresses( get_mahimahi_base() ) ),
+      address_lease_( get_mahimahi_base() ),
       nameserver_( first_nameserver() ),
-      egress_tun_( device_prefix + "-" + to_string( getpid() ) , egress_addr(), ingress_addr() ),
+      egress_name_( ( device == Device::Veth ? string( "veth" ) : device_prefix ) + "-" + to_string( getpid() ) ),
+      veth_ingress_name_( "veth-i" + to_string( getpid() ) ),
+      egress_tun_( device == Device::Tun ? new TunDevice( egress_name_, egress_addr(), ingress_addr() ) : nullptr ),
+      veth_devices_( device == Device::Veth ? make_veth_devices() : nullptr ),
       dns_outside_( egress_addr(), nameserver_, nameserver_ ),
       nat_rule_( ingress_addr() ),
       dnat_rule_(),
@@ -47,9 +50,12 @@ PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, cha
 template <class FerryQueueType>
 PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment, int destination_port )
     : user_environment_( user_environment ),
-      egress_ingress( two_unassigned_addresses( get_mahimahi_base() ) ),
+      address_lease_( get_mahimahi_base() ),
       nameserver_( first_nameserver() ),
-      egress_tun_( device_prefix + "-" + to_string( getpid() ) , egress_addr(), ingress_addr() ),
+      egress_name_( device_prefix + "-" + to_string( getpid() ) ),
+      veth_ingress_name_(),
+      egress_tun_( new TunDevice( egress_name_, egress_addr(), ingress_addr() ) ),
+      veth_devices_(),
       dns_outside_( egress_addr(), nameserver_, nameserver_ ),
       nat_rule_(),
       dnat_rule_( Address(ingress_addr().ip(), destination_port), "udp", destination_port ),
@@ -112,16 +118,8 @@ void PacketShell<FerryQueueType>::start_uplink_and_forward_packets_with_nameserv
 
             Ferry inner_ferry;
 
-            /* dnsmasq doesn't distinguish between UDP and TCP forwarding nameservers,
-               so use a DNSProxy that listens on the same UDP and TCP port */
-
-            UDPSocket dns_udp_listener;
-            dns_udp_listener.bind( ingress_addr() );
-
-            TCPSocket dns_tcp_listener;
-            dns_tcp_listener.bind( dns_udp_listener.local_address() );
-
-            DNSProxy dns_inside_ { move( dns_udp_listener ), move( dns_tcp_listener ),
+            /* caching nameserver for the namespace, on the DNS port of all its addresses */
+            DNSProxy dns_inside_ { Address( "0", "domain" ),
                     dns_outside_.udp_listener().local_address(),
                     dns_outside_.tcp_listener().local_address() };
 
@@ -129,52 +127,43 @@ void PacketShell<FerryQueueType>::start_uplink_and_forward_packets_with_nameserv
 
             dns_inside_.register_handlers( inner_ferry );
 
-            /* run dnsmasq as local caching nameserver */
-            inner_ferry.add_child_process( start_dnsmasq( {
-                        "-S", dns_inside_.udp_listener().local_address().str( "#" ) } ) );
-
-            /* For debugging purposes */
-            // vector< string > vpn_command;
-            // vpn_command.push_back("bash");
-
             /* Setup proper port forwarding to the nameserver. */
-            nameserver_address.str();
-            // if ( ( geteuid() == 0 ) or ( getegid() == 0 ) ) {
-            //   cout << "Packetshell: not root" << endl;
-            // }
-            // nameserver_address.str();
             DNATWithPostrouting dnat_with_postrouting( nameserver_address, "udp", 53 );
 
+            /* the phone's tunnel ends here, and its packets go out the ingress TUN */
+            UDPSocket tunnel_socket;
+            tunnel_socket.bind( Address( ingress_addr().ip(), destination_port ) );
+            const string tunnel_token = UDPTunnel::make_token();
+            cout << "Tunnel token: " << tunnel_token << endl;
+            UDPTunnel tunnel( UDPTunnel::Role::Server, move( tunnel_socket ), "tun0", tunnel_token );
+            tunnel.register_handlers( inner_ferry );
+
             /* Fork again after dropping root privileges */
             drop_privileges();
 
-            string path_to_security_files = "/etc/openvpn/";
-            const vector< Address > nameservers = { nameserver_address };
-            VPN vpn(path_to_security_files, ingress_addr(), nameservers);
-            vector< string > vpn_command = vpn.start_command();
-            command.empty(); // so that the compiler doesn't complain about unused variable.
-
             /* restore environment */
             environ = user_environment_;
 
-
             /* set MAHIMAHI_BASE if not set already to indicate outermost container */
             SystemCall( "setenv", setenv( "MAHIMAHI_BASE",
                                           egress_addr().ip().c_str(),
                                           false /* don't override */ ) );
 
-            inner_ferry.add_child_process( join( vpn_command ), [&]() {
-                    /* tweak bash prompt */
-                    prepend_shell_prefix( shell_prefix );
+            /* without a command, the tunnel runs until we're interrupted */
+            if ( not command.empty() ) {
+                inner_ferry.add_child_process( join( command ), [&]() {
+                        /* tweak bash prompt */
+                        prepend_shell_prefix( shell_prefix );
 
-                    return ezexec( vpn_command, true );
-                } );
+                        return ezexec( command, true );
+                    } );
+            }
 
             /* allow downlink to write directly to inner namespace's TUN device */
             pipe_.first.send_fd( ingress_tun );
 
             FerryQueueType uplink_queue { ferry_maker() };
-            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_ );
+            return inner_ferry.loop( uplink_queue, ingress_tun, *egress_tun_ );
         }, true );  /* new network namespace */
 
 }
@@ -223,16 +212,8 @@ void PacketShell<FerryQueueType>::start_uplink_and_forward_packets
 
             Ferry inner_ferry;
 
-            /* dnsmasq doesn't distinguish between UDP and TCP forwarding nameservers,
-               so use a DNSProxy that listens on the same UDP and TCP port */
-
-            UDPSocket dns_udp_listener;
-            dns_udp_listener.bind( ingress_addr() );
-
-            TCPSocket dns_tcp_listener;
-            dns_tcp_listener.bind( dns_udp_listener.local_address() );
-
-            DNSProxy dns_inside_ { move( dns_udp_listener ), move( dns_tcp_listener ),
+            /* caching nameserver for the namespace, on the DNS port of all its addresses */
+            DNSProxy dns_inside_ { Address( "0", "domain" ),
                     dns_outside_.udp_listener().local_address(),
                     dns_outside_.tcp_listener().local_address() };
 
@@ -240,10 +221,6 @@ void PacketShell<FerryQueueType>::start_uplink_and_forward_packets
 
             dns_inside_.register_handlers( inner_ferry );
 
-            /* run dnsmasq as local caching nameserver */
-            inner_ferry.add_child_process( start_dnsmasq( {
-                        "-S", dns_inside_.udp_listener().local_address().str( "#" ) } ) );
-
             /* Fork again after dropping root privileges */
             drop_privileges();
 
@@ -266,7 +243,7 @@ void PacketShell<FerryQueueType>::start_uplink_and_forward_packets
             pipe_.first.send_fd( ingress_tun );
 
             FerryQueueType uplink_queue { ferry_maker() };
-            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_ );
+            return inner_ferry.loop( uplink_queue, ingress_tun, *egress_tun_ );
         }, true );  /* new network namespace */
 
 }
@@ -310,26 +287,14 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
 
             Ferry inner_ferry;
 
-            /* dnsmasq doesn't distinguish between UDP and TCP forwarding nameservers,
-               so use a DNSProxy that listens on the same UDP and TCP port */
-
-            UDPSocket dns_udp_listener;
-            dns_udp_listener.bind( ingress_addr() );
-
-            TCPSocket dns_tcp_listener;
-            dns_tcp_listener.bind( dns_udp_listener.local_address() );
-
-            DNSProxy dns_inside_ { move( dns_udp_listener ), move( dns_tcp_listener ),
+            /* caching nameserver for the namespace, on the DNS port of all its addresses */
+            DNSProxy dns_inside_ { Address( "0", "domain" ),
                     dns_outside_.udp_listener().local_address(),
                     dns_outside_.tcp_listener().local_address() };
 
-            dns_inside_.register_handlers( inner_ferry );
-
             cout << "udp_listener.local_address(): " << dns_outside_.udp_listener().local_address().str() << endl;
 
-            /* run dnsmasq as local caching nameserver */
-            inner_ferry.add_child_process( start_dnsmasq( {
-                        "-S", dns_inside_.udp_listener().local_address().str( "#" ) } ) );
+            dns_inside_.register_handlers( inner_ferry );
 
             /* Fork again after dropping root privileges */
             drop_privileges();
@@ -353,7 +318,7 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
             pipe_.first.send_fd( ingress_tun );
 
             FerryQueueType uplink_queue { ferry_maker() };
-            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_ );
+            return inner_ferry.loop( uplink_queue, ingress_tun, *egress_tun_ );
         }, true );  /* new network namespace */
 }
 
@@ -387,10 +352,177 @@ void PacketShell<FerryQueueType>::start_downlink( Targs&&... Fargs )
             dns_outside_.register_handlers( outer_ferry );
 
             FerryQueueType downlink_queue { ferry_maker() };
-            return outer_ferry.loop( downlink_queue, egress_tun_, ingress_tun );
+            return outer_ferry.loop( downlink_queue, *egress_tun_, ingress_tun );
         } );
 }
 
+/* like start_uplink() and start_downlink(), but the link is an mm-shared-link
+   process listening at shared_link_path, which is given both TUN devices */
+template <class FerryQueueType>
+void PacketShell<FerryQueueType>::start_shared_link( const string & shell_prefix,
+                                                     const vector< string > & command,
+                                                     const string & shared_link_path )
+{
+    cout << "ingress: " << ingress_addr().str() << " egress: " << egress_addr().str() << endl;
+
+    /* Fork */
+    event_loop_.add_special_child_process( 77, "packetshell", [&]() {
+            TunDevice ingress_tun( "ingress", ingress_addr(), egress_addr() );
+
+            /* bring up localhost */
+            interface_ioctl( SIOCSIFFLAGS, "lo",
+                             [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
+
+            /* create default route */
+            rtentry route;
+            zero( route );
+
+            route.rt_gateway = egress_addr().to_sockaddr();
+            route.rt_dst = route.rt_genmask = Address().to_sockaddr();
+            route.rt_flags = RTF_UP | RTF_GATEWAY;
+
+            SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
+
+            EventLoop inner_loop;
+
+            /* caching nameserver for the namespace, on the DNS port of all its addresses */
+            DNSProxy dns_inside_ { Address( "0", "domain" ),
+                    dns_outside_.udp_listener().local_address(),
+                    dns_outside_.tcp_listener().local_address() };
+
+            dns_inside_.register_handlers( inner_loop );
+
+            /* Fork again after dropping root privileges */
+            drop_privileges();
+
+            /* restore environment */
+            environ = user_environment_;
+
+            /* set MAHIMAHI_BASE if not set already to indicate outermost container */
+            SystemCall( "setenv", setenv( "MAHIMAHI_BASE",
+                                          egress_addr().ip().c_str(),
+                                          false /* don't override */ ) );
+
+            inner_loop.add_child_process( join( command ), [&]() {
+                    /* tweak bash prompt */
+                    prepend_shell_prefix( shell_prefix );
+
+                    return ezexec( command, true );
+                } );
+
+            /* the shared link writes directly to inner namespace's TUN device */
+            pipe_.first.send_fd( ingress_tun );
+
+            return inner_loop.loop();
+        }, true );  /* new network namespace */
+
+    event_loop_.add_special_child_process( 77, "shared link", [&] () {
+            drop_privileges();
+
+            /* restore environment */
+            environ = user_environment_;
+
+            FileDescriptor ingress_tun = pipe_.second.recv_fd();
+
+            /* the link serves this shell until the connection closes (when we exit) */
+            UnixDomainSocket shared_link = UnixDomainSocket::connect_to( shared_link_path );
+            shared_link.send_fd( *egress_tun_ );
+            shared_link.send_fd( ingress_tun );
+
+            EventLoop outer_loop;
+
+            dns_outside_.register_handlers( outer_loop );
+
+            /* quit (taking the shell with us) if the link goes away */
+            outer_loop.add_simple_input_handler( shared_link,
+                                                 [] () { return ResultType::Exit; } );
+
+            return outer_loop.loop();
+        } );
+}
+
+/* like start_shared_link(), but the link is in the kernel, between the ends
+   of the veth pair: the uplink on the ingress device inside the shell's
+   namespace, and the downlink on the egress device outside it. The
+   followers keep root, since changing a qdisc takes privileges */
+template <class FerryQueueType>
+void PacketShell<FerryQueueType>::start_veth_link( const string & shell_prefix,
+                                                   const vector< string > & command,
+                                                   const InstallHook & install_uplink,
+                                                   const FollowHook & follow_uplink,
+                                                   const InstallHook & install_downlink,
+                                                   const FollowHook & follow_downlink )
+{
+    install_downlink( egress_name_ );
+
+    cout << "ingress: " << ingress_addr().str() << " egress: " << egress_addr().str() << endl;
+
+    /* Fork */
+    ChildProcess container_process( "packetshell", [&]() {
+            /* wait until ingress has been moved into our namespace */
+            pipe_.second.read();
+
+            /* bring up localhost */
+            interface_ioctl( SIOCSIFFLAGS, "lo",
+                             [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_UP; } );
+
+            /* bring up ingress */
+            assign_address( veth_ingress_name_, ingress_addr(), egress_addr() );
+            install_uplink( veth_ingress_name_ );
+
+            /* create default route */
+            rtentry route;
+            zero( route );
+
+            route.rt_gateway = egress_addr().to_sockaddr();
+            route.rt_dst = route.rt_genmask = Address().to_sockaddr();
+            route.rt_flags = RTF_UP | RTF_GATEWAY;
+
+            SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
+
+            EventLoop inner_loop;
+
+            inner_loop.add_child_process( "uplink", [&]() { return follow_uplink(); } );
+
+            /* caching nameserver for the namespace, on the DNS port of all its addresses */
+            DNSProxy dns_inside_ { Address( "0", "domain" ),
+                    dns_outside_.udp_listener().local_address(),
+                    dns_outside_.tcp_listener().local_address() };
+
+            dns_inside_.register_handlers( inner_loop );
+
+            /* Fork again after dropping root privileges */
+            drop_privileges();
+
+            /* restore environment */
+            environ = user_environment_;
+
+            /* set MAHIMAHI_BASE if not set already to indicate outermost container */
+            SystemCall( "setenv", setenv( "MAHIMAHI_BASE",
+                                          egress_addr().ip().c_str(),
+                                          false /* don't override */ ) );
+
+            inner_loop.add_child_process( join( command ), [&]() {
+                    /* tweak bash prompt */
+                    prepend_shell_prefix( shell_prefix );
+
+                    return ezexec( command, true );
+                } );
+
+            return inner_loop.loop();
+        }, true );  /* new network namespace */
+
+    /* give ingress to the shell's namespace, which will destroy it */
+    move_to_namespace( veth_ingress_name_, container_process.pid() );
+    veth_devices_->set_kernel_will_destroy();
+
+    pipe_.first.write( "x" );
+
+    event_loop_.add_special_child_process( 77, move( container_process ) );
+
+    event_loop_.add_special_child_process( 77, "downlink", [&]() { return follow_downlink(); } );
+}
+
 template <class FerryQueueType>
 int PacketShell<FerryQueueType>::wait_for_exit( void )
 {
@@ -443,6 +575,16 @@ struct TemporaryEnvironment
     }
 };
 
+/* the egress end stays outside, already addressed, so that DNSProxy
+   and NAT can use it; the ingress end is given to the shell later */
+template <class FerryQueueType>
+unique_ptr<VirtualEthernetPair> PacketShell<FerryQueueType>::make_veth_devices( void ) const
+{
+    unique_ptr<VirtualEthernetPair> veth_devices( new VirtualEthernetPair( egress_name_, veth_ingress_name_ ) );
+    assign_address( egress_name_, address_lease_.egress(), address_lease_.ingress() );
+    return veth_devices;
+}
+
 template <class FerryQueueType>
 Address PacketShell<FerryQueueType>::get_mahimahi_base( void ) const
 {
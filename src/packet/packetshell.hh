@@ -4,11 +4,14 @@
 #define PACKETSHELL_HH
 
 #include <string>
+#include <memory>
+#include <functional>
 
 #include "netdevice.hh"
 #include "nat.hh"
 #include "util.hh"
 #include "address.hh"
+#include "address_lease.hh"
 #include "dns_proxy.hh"
 #include "event_loop.hh"
 #include "socketpair.hh"
@@ -16,11 +19,23 @@
 template <class FerryQueueType>
 class PacketShell
 {
+public:
+    /* what connects the shell to the outside: TUN devices with a link
+       in userspace between them, or a veth pair with one in the kernel */
+    enum class Device { Tun, Veth };
+
+    /* sets up one direction of a kernel link on a device in the current
+       network namespace, then keeps it up to date (without returning) */
+    typedef std::function<void( const std::string & device_name )> InstallHook;
+    typedef std::function<int( void )> FollowHook;
+
 private:
     char ** const user_environment_;
-    std::pair<Address, Address> egress_ingress;
+    AddressLease address_lease_;
     Address nameserver_;
-    TunDevice egress_tun_;
+    const std::string egress_name_, veth_ingress_name_;
+    std::unique_ptr<TunDevice> egress_tun_;
+    std::unique_ptr<VirtualEthernetPair> veth_devices_;
     DNSProxy dns_outside_;
     NAT nat_rule_ {};
     DNAT dnat_rule_ {}; // For forwarding packets properly.
@@ -37,8 +52,11 @@ private:
 
     Address get_mahimahi_base( void ) const;
 
+    std::unique_ptr<VirtualEthernetPair> make_veth_devices( void ) const;
+
 public:
-    PacketShell( const std::string & device_prefix, char ** const user_environment );
+    PacketShell( const std::string & device_prefix, char ** const user_environment,
+                 const Device device = Device::Tun );
 
     PacketShell( const std::string & device_prefix, char ** const user_environment, int destination_port );
 
@@ -65,10 +83,19 @@ public:
       template <typename... Targs>
     void start_downlink( Targs&&... Fargs );
 
+    void start_shared_link( const std::string & shell_prefix,
+                            const std::vector< std::string > & command,
+                            const std::string & shared_link_path );
+
+    void start_veth_link( const std::string & shell_prefix,
+                          const std::vector< std::string > & command,
+                          const InstallHook & install_uplink, const FollowHook & follow_uplink,
+                          const InstallHook & install_downlink, const FollowHook & follow_downlink );
+
     int wait_for_exit( void );
 
-    const Address & egress_addr( void ) { return egress_ingress.first; }
-    const Address & ingress_addr( void ) { return egress_ingress.second; }
+    const Address & egress_addr( void ) { return address_lease_.egress(); }
+    const Address & ingress_addr( void ) { return address_lease_.ingress(); }
 
     PacketShell( const PacketShell & other ) = delete;
     PacketShell & operator=( const PacketShell & other ) = delete;
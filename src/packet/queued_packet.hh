@@ -5,14 +5,37 @@
 
 #include <string>
 
+#include "packet_info.hh"
+
 struct QueuedPacket
 {
     uint64_t arrival_time;
     std::string contents;
 
-    QueuedPacket( const std::string & s_contents, uint64_t s_arrival_time )
-        : arrival_time( s_arrival_time ), contents( s_contents )
+    /* cross traffic, to be discarded when it leaves the queue */
+    bool synthetic;
+
+    QueuedPacket( const std::string & s_contents, uint64_t s_arrival_time, const bool s_synthetic = false )
+        : arrival_time( s_arrival_time ), contents( s_contents ), synthetic( s_synthetic )
     {}
+
+    /* for any stage that classifies packets: parsed the first time it's
+       asked for, so packets nobody looks at are never parsed */
+    const PacketInfo & info( void ) const
+    {
+        if ( not info_parsed_ ) {
+            if ( not synthetic ) {
+                info_ = PacketInfo( contents );
+            }
+            info_parsed_ = true;
+        }
+
+        return info_;
+    }
+
+private:
+    mutable PacketInfo info_ {};
+    mutable bool info_parsed_ { false };
 };
 
 #endif /* QUEUED_PACKET_HH */
@@ -7,6 +7,7 @@
 #include <functional>
 
 #include <netdb.h>
+#include <arpa/inet.h>
 
 #include "address.hh"
 #include "util.hh"
@@ -156,9 +157,13 @@ bool Address::operator<( const Address & other ) const
 }
 
 /* generate carrier-grade NAT address */
-Address Address::cgnat( const uint8_t last_octet )
+Address Address::cgnat( const uint32_t host_number )
 {
-    return Address( "100.64.0." + to_string( last_octet ), 0 );
+    sockaddr_in ip;
+    zero( ip );
+    ip.sin_family = AF_INET;
+    ip.sin_addr.s_addr = htonl( ( 100 << 24 ) + ( 64 << 16 ) + host_number );
+    return Address( ip );
 }
 
 Address Address::reverse_proxy( const uint8_t last_octet, const uint16_t port )
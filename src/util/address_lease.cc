@@ -0,0 +1,166 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "address_lease.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* one slot per /30 in 100.64.0.0/16 */
+static const uint32_t SLOT_COUNT = 16384;
+
+/* the lease file, mapped while its lock is held */
+struct LeaseTable
+{
+    uint32_t next_slot;             /* where the next search starts */
+    uint32_t owner[ SLOT_COUNT ];   /* pid of the leaseholder, or 0 if free */
+};
+
+static const char LEASE_FILE[] = "/var/run/mahimahi-address-leases";
+
+/* opens, locks and maps the lease file for the duration of one update */
+class LockedLeaseTable
+{
+private:
+    FileDescriptor fd_;
+    LeaseTable * table_;
+
+public:
+    LockedLeaseTable()
+        : fd_( SystemCall( string( "open " ) + LEASE_FILE,
+                           open( LEASE_FILE, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600 ) ) ),
+          table_( nullptr )
+    {
+        SystemCall( "flock", flock( fd_.fd_num(), LOCK_EX ) );
+
+        /* a new file is all zeros: every slot free */
+        struct stat file_info;
+        SystemCall( "fstat", fstat( fd_.fd_num(), &file_info ) );
+        if ( file_info.st_size < static_cast<off_t>( sizeof( LeaseTable ) ) ) {
+            SystemCall( "ftruncate", ftruncate( fd_.fd_num(), sizeof( LeaseTable ) ) );
+        }
+
+        void * mapping = mmap( nullptr, sizeof( LeaseTable ), PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd_.fd_num(), 0 );
+        if ( mapping == MAP_FAILED ) {
+            throw unix_error( "mmap " + string( LEASE_FILE ) );
+        }
+        table_ = static_cast<LeaseTable *>( mapping );
+    }
+
+    ~LockedLeaseTable()
+    {
+        /* the lock goes away with the file descriptor */
+        if ( munmap( table_, sizeof( LeaseTable ) ) < 0 ) {
+            print_exception( unix_error( "munmap" ) );
+        }
+    }
+
+    LeaseTable * operator->( void ) { return table_; }
+
+    /* forbid copying */
+    LockedLeaseTable( const LockedLeaseTable & other ) = delete;
+    LockedLeaseTable & operator=( const LockedLeaseTable & other ) = delete;
+};
+
+static bool process_exists( const pid_t pid )
+{
+    return kill( pid, 0 ) == 0 or errno != ESRCH;
+}
+
+static bool slot_contains( const uint32_t slot, const Address & addr )
+{
+    return addr.ip() == Address::cgnat( 4 * slot + 1 ).ip()
+        or addr.ip() == Address::cgnat( 4 * slot + 2 ).ip();
+}
+
+/* with net.ipv4.ip_nonlocal_bind set, bind() succeeds for any address,
+   so address_is_local() can't tell */
+static bool nonlocal_bind_allowed( void )
+{
+    FileDescriptor setting( SystemCall( "open /proc/sys/net/ipv4/ip_nonlocal_bind",
+                                        open( "/proc/sys/net/ipv4/ip_nonlocal_bind", O_RDONLY | O_CLOEXEC ) ) );
+    return setting.read() == "1\n";
+}
+
+/* is addr already configured on this host, by something that took no
+   lease (a VPN, a container, an older shell)? One bind() answers this
+   for a single address, without listing every interface */
+static bool address_is_local( const Address & addr )
+{
+    UDPSocket probe;
+    try {
+        probe.bind( addr );
+    } catch ( const unix_error & e ) {
+        if ( e.code().value() == EADDRNOTAVAIL ) {
+            return false;
+        }
+        throw;
+    }
+    return true;
+}
+
+AddressLease::AddressLease( const Address & avoid )
+    : slot_(),
+      egress_(),
+      ingress_()
+{
+    const bool probe_addresses = not nonlocal_bind_allowed();
+
+    LockedLeaseTable table;
+
+    /* usually the very next slot is free, so this is O(1) unless
+       leases are being held for a long time */
+    for ( uint32_t tries = 0; tries < SLOT_COUNT; tries++ ) {
+        const uint32_t slot = table->next_slot++ % SLOT_COUNT;
+        table->next_slot %= SLOT_COUNT;
+
+        const uint32_t owner = table->owner[ slot ];
+        if ( owner and process_exists( owner ) ) {
+            continue;
+        }
+
+        if ( slot_contains( slot, avoid ) ) {
+            continue;
+        }
+
+        const Address egress = Address::cgnat( 4 * slot + 1 ),
+            ingress = Address::cgnat( 4 * slot + 2 );
+        if ( probe_addresses and ( address_is_local( egress ) or address_is_local( ingress ) ) ) {
+            continue;
+        }
+
+        table->owner[ slot ] = getpid();
+
+        slot_ = slot;
+        egress_ = egress;
+        ingress_ = ingress;
+        return;
+    }
+
+    throw runtime_error( "AddressLease: all address ranges are in use" );
+}
+
+AddressLease::~AddressLease()
+{
+    try {
+        LockedLeaseTable table;
+
+        /* only the process that took the lease may give it back */
+        if ( table->owner[ slot_ ] == static_cast<uint32_t>( getpid() ) ) {
+            table->owner[ slot_ ] = 0;
+        }
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
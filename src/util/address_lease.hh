@@ -0,0 +1,36 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef ADDRESS_LEASE_HH
+#define ADDRESS_LEASE_HH
+
+#include <utility>
+#include <cstdint>
+
+#include "address.hh"
+
+/* RAII lease on a /30 of the carrier-grade NAT range, for one shell's
+   egress and ingress addresses. Leases are recorded in a file shared by
+   every shell on the host and taken under an exclusive lock, so shells
+   started at the same moment get disjoint subnets. A lease is released
+   when its owner destroys it or exits (stale entries are reclaimed). */
+class AddressLease
+{
+private:
+    uint32_t slot_;
+    Address egress_, ingress_;
+
+public:
+    /* avoid: an address that must not be handed out (e.g., MAHIMAHI_BASE) */
+    AddressLease( const Address & avoid = Address() );
+    ~AddressLease();
+
+    const Address & egress( void ) const { return egress_; }
+    const Address & ingress( void ) const { return ingress_; }
+    std::pair<Address, Address> addresses( void ) const { return std::make_pair( egress_, ingress_ ); }
+
+    /* forbid copying */
+    AddressLease( const AddressLease & other ) = delete;
+    AddressLease & operator=( const AddressLease & other ) = delete;
+};
+
+#endif /* ADDRESS_LEASE_HH */
@@ -0,0 +1,254 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+
+#include "dns_cache.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* just enough of a DNS message (RFC 1035) to cache it */
+namespace {
+    const size_t HEADER_LENGTH = 12;
+
+    const uint16_t FLAG_RESPONSE = 0x8000;
+    const uint16_t FLAG_TRUNCATED = 0x0200;
+
+    const uint16_t TYPE_SOA = 6;
+    const uint16_t TYPE_OPT = 41;
+
+    const uint16_t RCODE_NOERROR = 0;
+    const uint16_t RCODE_NXDOMAIN = 3;
+
+    const size_t MAX_ENTRIES = 10000;
+    const uint32_t MAX_TTL = 86400; /* s */
+    const uint32_t MAX_NEGATIVE_TTL = 3 * 3600; /* s (RFC 2308) */
+
+    uint16_t get_16( const string & message, const size_t offset )
+    {
+        return ( uint8_t( message.at( offset ) ) << 8 ) | uint8_t( message.at( offset + 1 ) );
+    }
+
+    uint32_t get_32( const string & message, const size_t offset )
+    {
+        return ( uint32_t( get_16( message, offset ) ) << 16 ) | get_16( message, offset + 2 );
+    }
+
+    void put_32( string & message, const size_t offset, const uint32_t value )
+    {
+        for ( unsigned int i = 0; i < 4; i++ ) {
+            message.at( offset + i ) = value >> ( 24 - 8 * i );
+        }
+    }
+
+    /* offset just past the (possibly compressed) name at offset */
+    size_t skip_name( const string & message, size_t offset )
+    {
+        while ( true ) {
+            const uint8_t length = message.at( offset );
+            if ( ( length & 0xc0 ) == 0xc0 ) { /* pointer ends the name */
+                return offset + 2;
+            } else if ( length & 0xc0 ) {
+                throw runtime_error( "DNS: unknown label type" );
+            } else if ( length == 0 ) {
+                return offset + 1;
+            }
+            offset += 1 + length;
+        }
+    }
+
+    struct MessageInfo
+    {
+        uint16_t flags { 0 };
+        uint16_t answer_count { 0 };
+        size_t question_end { 0 };
+
+        /* TTLs of the records other than OPT */
+        vector<size_t> ttl_offsets {};
+        uint32_t min_ttl { numeric_limits<uint32_t>::max() };
+
+        bool has_soa { false };
+        uint32_t soa_negative_ttl { 0 };
+
+        uint16_t udp_payload_size { 0 }; /* from OPT, if present */
+
+        uint16_t opcode( void ) const { return ( flags >> 11 ) & 0xf; }
+        uint16_t rcode( void ) const { return flags & 0xf; }
+    };
+
+    /* throws if the message is malformed or has other than one question */
+    MessageInfo parse( const string & message )
+    {
+        MessageInfo info;
+
+        if ( message.size() < HEADER_LENGTH ) {
+            throw runtime_error( "DNS: message too short" );
+        }
+
+        info.flags = get_16( message, 2 );
+
+        if ( get_16( message, 4 ) != 1 ) {
+            throw runtime_error( "DNS: expected one question" );
+        }
+
+        info.question_end = skip_name( message, HEADER_LENGTH ) + 4;
+
+        const unsigned int answer_count = get_16( message, 6 );
+        const unsigned int authority_count = get_16( message, 8 );
+        const unsigned int additional_count = get_16( message, 10 );
+
+        size_t offset = info.question_end;
+        for ( unsigned int i = 0; i < answer_count + authority_count + additional_count; i++ ) {
+            offset = skip_name( message, offset );
+
+            const uint16_t type = get_16( message, offset );
+            const uint32_t ttl = get_32( message, offset + 4 );
+            const size_t rdata = offset + 10;
+            const size_t rdata_end = rdata + get_16( message, offset + 8 );
+
+            if ( type == TYPE_OPT ) {
+                info.udp_payload_size = get_16( message, offset + 2 );
+            } else {
+                info.ttl_offsets.push_back( offset + 4 );
+                info.min_ttl = min( info.min_ttl, ttl );
+            }
+
+            /* negative answers are cached for min(SOA TTL, SOA MINIMUM) */
+            if ( type == TYPE_SOA and i >= answer_count and i < answer_count + authority_count ) {
+                const size_t minimum = skip_name( message, skip_name( message, rdata ) ) + 16;
+                info.has_soa = true;
+                info.soa_negative_ttl = min( ttl, get_32( message, minimum ) );
+            }
+
+            if ( rdata_end > message.size() ) {
+                throw runtime_error( "DNS: record runs past end of message" );
+            }
+
+            offset = rdata_end;
+        }
+
+        info.answer_count = answer_count;
+
+        return info;
+    }
+
+    /* question (name in lower case, then type and class) */
+    string cache_key( const string & message, const MessageInfo & info )
+    {
+        string key = message.substr( HEADER_LENGTH, info.question_end - HEADER_LENGTH );
+        transform( key.begin(), key.end() - 4, key.begin(),
+                   [] ( const char c ) { return ( c >= 'A' and c <= 'Z' ) ? c - 'A' + 'a' : c; } );
+        return key;
+    }
+}
+
+size_t DNSCache::max_udp_response_size( const string & query )
+{
+    try {
+        return max( size_t( 512 ), size_t( parse( query ).udp_payload_size ) );
+    } catch ( const exception & ) {
+        return 512;
+    }
+}
+
+string DNSCache::lookup( const string & query, const size_t max_response_size )
+{
+    MessageInfo info;
+    try {
+        info = parse( query );
+    } catch ( const exception & ) {
+        return string(); /* not for us to decide */
+    }
+
+    if ( ( info.flags & FLAG_RESPONSE ) or info.opcode() != 0 ) {
+        return string();
+    }
+
+    const auto entry = entries_.find( cache_key( query, info ) );
+    if ( entry == entries_.end() ) {
+        return string();
+    }
+
+    const uint64_t now = timestamp();
+    if ( now >= entry->second.expires ) {
+        entries_.erase( entry );
+        return string();
+    }
+
+    if ( entry->second.response.size() > max_response_size ) {
+        return string();
+    }
+
+    /* answer with the client's ID and question (which may differ in case) */
+    string response = entry->second.response;
+    response.replace( 0, 2, query, 0, 2 );
+    response.replace( HEADER_LENGTH, info.question_end - HEADER_LENGTH,
+                      query, HEADER_LENGTH, info.question_end - HEADER_LENGTH );
+
+    /* the records have aged */
+    const uint32_t age = ( now - entry->second.stored ) / 1000;
+    for ( const auto offset : entry->second.ttl_offsets ) {
+        put_32( response, offset, get_32( response, offset ) - age );
+    }
+
+    return response;
+}
+
+void DNSCache::insert( const string & response )
+{
+    MessageInfo info;
+    try {
+        info = parse( response );
+    } catch ( const exception & ) {
+        return;
+    }
+
+    if ( not ( info.flags & FLAG_RESPONSE ) or ( info.flags & FLAG_TRUNCATED ) or info.opcode() != 0 ) {
+        return;
+    }
+
+    uint32_t ttl;
+    if ( info.rcode() == RCODE_NOERROR and info.answer_count > 0 ) {
+        ttl = min( info.min_ttl, MAX_TTL );
+    } else if ( ( info.rcode() == RCODE_NOERROR or info.rcode() == RCODE_NXDOMAIN ) and info.has_soa ) {
+        /* (no longer than the shortest record in it, such as a CNAME,
+           or that record's TTL would wrap when lookup() ages it) */
+        ttl = min( { info.soa_negative_ttl, info.min_ttl, MAX_NEGATIVE_TTL } );
+    } else {
+        return; /* errors, referrals, and negative answers without an SOA aren't cached */
+    }
+
+    if ( ttl == 0 ) {
+        return;
+    }
+
+    const uint64_t now = timestamp();
+    make_room( now );
+
+    const string key = cache_key( response, info );
+    const Entry entry = { response, info.ttl_offsets, now, now + ttl * 1000 };
+    entries_.erase( key );
+    entries_.emplace( key, entry );
+}
+
+void DNSCache::make_room( const uint64_t now )
+{
+    if ( entries_.size() < MAX_ENTRIES ) {
+        return;
+    }
+
+    for ( auto it = entries_.begin(); it != entries_.end(); ) {
+        if ( now >= it->second.expires ) {
+            it = entries_.erase( it );
+        } else {
+            it++;
+        }
+    }
+
+    /* still full: forget something */
+    if ( entries_.size() >= MAX_ENTRIES ) {
+        entries_.erase( entries_.begin() );
+    }
+}
@@ -0,0 +1,42 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DNS_CACHE_HH
+#define DNS_CACHE_HH
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* cache of DNS responses, keyed by question (name, type and class),
+   that respects the records' TTLs and caches negative answers
+   (NXDOMAIN and NODATA) for as long as their SOA record allows */
+class DNSCache
+{
+private:
+    struct Entry
+    {
+        std::string response;
+        std::vector<size_t> ttl_offsets; /* where to age the TTLs when answering */
+        uint64_t stored; /* ms */
+        uint64_t expires; /* ms */
+    };
+
+    std::map<std::string, Entry> entries_ {};
+
+    void make_room( const uint64_t now );
+
+public:
+    DNSCache() {}
+
+    /* a cached response to the query (with its ID and question), or an
+       empty string if there is none that fits in max_response_size */
+    std::string lookup( const std::string & query, const size_t max_response_size );
+
+    /* UDP responses must fit in 512 bytes, unless the query says otherwise (EDNS) */
+    static size_t max_udp_response_size( const std::string & query );
+
+    void insert( const std::string & response );
+};
+
+#endif /* DNS_CACHE_HH */
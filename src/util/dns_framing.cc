@@ -0,0 +1,36 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "dns_framing.hh"
+
+using namespace std;
+
+string frame_dns_message( const string & message )
+{
+    if ( message.size() > UINT16_MAX ) {
+        throw runtime_error( "DNS message too long" );
+    }
+
+    return string( 1, message.size() >> 8 ) + string( 1, message.size() & 0xff ) + message;
+}
+
+vector<string> unframe_dns_messages( string & buffer )
+{
+    vector<string> messages;
+
+    size_t offset = 0;
+    while ( buffer.size() >= offset + 2 ) {
+        const size_t length = ( uint8_t( buffer.at( offset ) ) << 8 ) | uint8_t( buffer.at( offset + 1 ) );
+        if ( buffer.size() < offset + 2 + length ) {
+            break;
+        }
+
+        messages.emplace_back( buffer, offset + 2, length );
+        offset += 2 + length;
+    }
+
+    buffer.erase( 0, offset );
+    return messages;
+}
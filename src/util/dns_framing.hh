@@ -0,0 +1,15 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DNS_FRAMING_HH
+#define DNS_FRAMING_HH
+
+#include <string>
+#include <vector>
+
+/* DNS over TCP: each message is preceded by its length (RFC 1035 4.2.2) */
+std::string frame_dns_message( const std::string & message );
+
+/* remove the complete messages at the front of buffer */
+std::vector<std::string> unframe_dns_messages( std::string & buffer );
+
+#endif /* DNS_FRAMING_HH */
@@ -1,10 +1,10 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
-#include <thread>
+#include <sys/socket.h>
 
 #include "dns_proxy.hh"
+#include "dns_framing.hh"
 #include "poller.hh"
-#include "bytestream_queue.hh"
 #include "event_loop.hh"
 #include "exception.hh"
 
@@ -27,7 +27,8 @@ DNSProxy::DNSProxy( const Address & listen_address, const Address & s_udp_target
 
 DNSProxy::DNSProxy( UDPSocket && udp_listener, TCPSocket && tcp_listener, const Address & s_udp_target, const Address & s_tcp_target )
     : udp_listener_( move( udp_listener ) ), tcp_listener_( move( tcp_listener ) ),
-      udp_target_( s_udp_target ), tcp_target_( s_tcp_target )
+      udp_target_( s_udp_target ), tcp_target_( s_tcp_target ),
+      udp_upstream_()
 {
     /* make sure the sockets are bound to something */
     if ( udp_listener_.local_address() == Address() ) {
@@ -39,89 +40,284 @@ DNSProxy::DNSProxy( UDPSocket && udp_listener, TCPSocket && tcp_listener, const
     }
 
     tcp_listener_.listen();
+
+    /* answer from whichever of our addresses was asked */
+    udp_listener_.set_pktinfo();
+}
+
+/* DNS messages start with a 16-bit query ID (and a header of 12 bytes in all) */
+static const size_t DNS_HEADER_LENGTH = 12;
+
+static uint16_t query_id( const string & message )
+{
+    return ( uint8_t( message.at( 0 ) ) << 8 ) | uint8_t( message.at( 1 ) );
+}
+
+static void set_query_id( string & message, const uint16_t id )
+{
+    message.at( 0 ) = id >> 8;
+    message.at( 1 ) = id & 0xff;
+}
+
+/* returns the tick on which key's timeout will be checked */
+uint64_t DNSProxy::schedule_timeout( const TimeoutType type, const uint64_t key )
+{
+    static_assert( WHEEL_SLOTS > TIMEOUT_TICKS, "timer wheel too small for timeout" );
+
+    const uint64_t expiry_tick = current_tick_ + TIMEOUT_TICKS;
+    wheel_.at( expiry_tick % WHEEL_SLOTS ).emplace_back( type, key );
+
+    if ( not timer_.armed() ) {
+        timer_.arm( TICK_MS );
+    }
+
+    return expiry_tick;
+}
+
+void DNSProxy::handle_tick( void )
+{
+    for ( uint64_t ticks = timer_.read_ticks(); ticks > 0; ticks-- ) {
+        current_tick_++;
+
+        vector<pair<TimeoutType, uint64_t>> expiring;
+        expiring.swap( wheel_.at( current_tick_ % WHEEL_SLOTS ) );
+
+        /* entries are only live if they haven't been rescheduled or removed since */
+        for ( const auto & x : expiring ) {
+            if ( x.first == TimeoutType::UDPQuery ) {
+                const auto transaction = udp_transactions_.find( x.second );
+                if ( transaction != udp_transactions_.end()
+                     and transaction->second.expiry_tick == current_tick_ ) {
+                    forget_udp_transaction( x.second );
+                }
+            } else {
+                const auto connection = tcp_connections_.find( x.second );
+                if ( connection != tcp_connections_.end()
+                     and connection->second->expiry_tick == current_tick_ ) {
+                    close_tcp_connection( x.second );
+                }
+            }
+        }
+    }
+
+    destroy_closed_connections();
+
+    /* don't wake up the event loop when there's nothing to time out */
+    if ( udp_transactions_.empty() and tcp_connections_.empty() ) {
+        timer_.disarm();
+    }
 }
 
 void DNSProxy::handle_udp( void )
 {
     /* get a UDP request */
-    pair< Address, string > request = udp_listener_.recvfrom();
+    UDPSocket::ReceivedDatagram request = udp_listener_.recv_with_destination();
 
-    /* start a new thread to handle request/reply */
-    thread newthread( [&] ( pair< Address, string > request ) {
-            try {
-                /* send request to the DNS server */
-                UDPSocket dns_server;
-                dns_server.connect( udp_target_ );
-                dns_server.write( request.second );
-
-                /* wait up to 60 seconds for a reply */
-                Poller poller;
-
-                poller.add_action( Poller::Action( dns_server, Direction::In,
-                                                   [&] () {
-                                                       udp_listener_.sendto( request.first,
-                                                                             dns_server.read() );
-                                                       return ResultType::Continue;
-                                                   } ) );
-                poller.poll( 60000 );
-            } catch ( const exception & e ) {
-                print_exception( e );
-                return;
-            }
+    if ( request.payload.size() < DNS_HEADER_LENGTH ) {
+        return;
+    }
+
+    /* answer from the cache if possible */
+    const string cached_response = cache_.lookup( request.payload,
+                                                  DNSCache::max_udp_response_size( request.payload ) );
+    if ( not cached_response.empty() ) {
+        udp_listener_.sendto_from( request.destination, request.source, cached_response );
+        return;
+    }
+
+    const auto source_and_id = make_pair( request.source, query_id( request.payload ) );
 
+    /* a retransmission reuses the query's upstream ID */
+    auto existing = upstream_ids_.find( source_and_id );
+    if ( existing == upstream_ids_.end() ) {
+        if ( udp_transactions_.size() > UINT16_MAX ) {
+            cerr << "DNSProxy: too many queries in flight" << endl;
             return;
-        }, request );
+        }
 
-    /* don't wait around for the reply */
-    newthread.detach();
+        while ( udp_transactions_.count( next_upstream_id_ ) ) {
+            next_upstream_id_++;
+        }
+
+        existing = upstream_ids_.emplace( source_and_id, next_upstream_id_++ ).first;
+    }
+
+    const uint16_t upstream_id = existing->second;
+    const UDPTransaction transaction = { request.source, request.destination, source_and_id.second,
+                                         schedule_timeout( TimeoutType::UDPQuery, upstream_id ) };
+    udp_transactions_.erase( upstream_id );
+    udp_transactions_.emplace( upstream_id, transaction );
+
+    /* send request to the DNS server */
+    set_query_id( request.payload, upstream_id );
+    udp_upstream_.sendto( udp_target_, request.payload );
 }
 
-const static size_t BUFFER_SIZE = 1024 * 1024;
+void DNSProxy::handle_udp_reply( void )
+{
+    const pair< Address, string > reply_with_source = udp_upstream_.recvfrom();
+
+    if ( not ( reply_with_source.first == udp_target_ )
+         or reply_with_source.second.size() < DNS_HEADER_LENGTH ) {
+        return;
+    }
+
+    const auto transaction = udp_transactions_.find( query_id( reply_with_source.second ) );
+    if ( transaction == udp_transactions_.end() ) {
+        return; /* timed out, or a duplicate */
+    }
+
+    cache_.insert( reply_with_source.second );
+
+    /* send reply back to the client under its own query ID */
+    string reply = reply_with_source.second;
+    set_query_id( reply, transaction->second.client_id );
+    const Address client = transaction->second.client;
+    const Address server = transaction->second.server;
+
+    forget_udp_transaction( transaction->first );
+    udp_listener_.sendto_from( server, client, reply );
+}
+
+void DNSProxy::forget_udp_transaction( const uint16_t upstream_id )
+{
+    const UDPTransaction & transaction = udp_transactions_.at( upstream_id );
+    upstream_ids_.erase( make_pair( transaction.client, transaction.client_id ) );
+    udp_transactions_.erase( upstream_id );
+}
+
+/* write as much as the socket will take */
+static void write_some( FileDescriptor & fd, string & buffer )
+{
+    buffer.erase( buffer.cbegin(), fd.write( buffer, false ) );
+}
+
+/* don't read more from either side while the client is behind */
+const static size_t MAX_PENDING_TO_CLIENT = 64 * 1024;
 
 void DNSProxy::handle_tcp( void )
 {
-    /* start a new thread to handle request/reply */
-    thread newthread( [&] ( Socket client ) {
-            try {
-                /* connect to DNS server */
-                TCPSocket dns_server;
-                dns_server.connect( tcp_target_ );
+    destroy_closed_connections();
 
-                Poller poller;
+    const uint64_t id = next_connection_id_++;
 
-                /* Make bytestreams */
-                ByteStreamQueue from_client( BUFFER_SIZE ), from_server( BUFFER_SIZE );
+    TCPConnection & c = *tcp_connections_.emplace( id, unique_ptr<TCPConnection>(
+        new TCPConnection( tcp_listener_.accept(), 0 ) ) ).first->second;
+    c.client.set_blocking( false );
+    c.expiry_tick = schedule_timeout( TimeoutType::TCPConnection, id );
 
-                poller.add_action( Poller::Action( dns_server, Direction::In,
-                                                   [&] () { return eof( from_server.push( dns_server ) ) ? ResultType::Cancel : ResultType::Continue; },
-                                                   from_server.space_available ) );
+    auto close_connection = [this, id] () { close_tcp_connection( id ); };
 
-                poller.add_action( Poller::Action( client, Direction::In,
-                                                   [&] () { return eof( from_client.push( client ) ) ? ResultType::Cancel : ResultType::Continue; },
-                                                   from_client.space_available ) );
+    event_loop_->add_action( Poller::Action( c.client, Direction::In,
+                                             tcp_callback( id, c, [this, id, &c] () {
+                                                     const string data = c.client.read();
+                                                     c.from_client.append( data );
 
-                poller.add_action( Poller::Action( dns_server, Direction::Out,
-                                                   [&] () { from_client.pop( dns_server ); return ResultType::Continue; },
-                                                   from_client.non_empty ) );
+                                                     /* answer from the cache, or ask the server */
+                                                     for ( const auto & query : unframe_dns_messages( c.from_client ) ) {
+                                                         const string response = cache_.lookup( query, UINT16_MAX );
+                                                         if ( not response.empty() ) {
+                                                             c.to_client.append( frame_dns_message( response ) );
+                                                         } else {
+                                                             if ( not c.server ) {
+                                                                 connect_to_server( id, c );
+                                                             }
+                                                             c.to_server.append( frame_dns_message( query ) );
+                                                         }
+                                                     }
+                                                 } ),
+                                             [&c] () { return not c.client.eof() and c.to_client.size() < MAX_PENDING_TO_CLIENT; },
+                                             close_connection ) );
 
-                poller.add_action( Poller::Action( client, Direction::Out,
-                                                   [&] () { from_server.pop( client ); return ResultType::Continue; },
-                                                   from_server.non_empty ) );
+    event_loop_->add_action( Poller::Action( c.client, Direction::Out,
+                                             tcp_callback( id, c, [&c] () { write_some( c.client, c.to_client ); } ),
+                                             [&c] () { return not c.to_client.empty(); },
+                                             close_connection ) );
+}
 
-                while( true ) {
-                    if ( poller.poll( 60000 ).result == Poller::Result::Type::Exit ) {
-                        return;
-                    }
-                }
-            } catch ( const exception & e ) {
-                print_exception( e );
-                return;
+/* connect to DNS server (in the background) */
+void DNSProxy::connect_to_server( const uint64_t id, TCPConnection & c )
+{
+    c.server.reset( new TCPSocket );
+    c.server->set_blocking( false );
+    c.server->connect( tcp_target_ );
+
+    auto close_connection = [this, id] () { close_tcp_connection( id ); };
+
+    event_loop_->add_action( Poller::Action( *c.server, Direction::In,
+                                             tcp_callback( id, c, [this, &c] () {
+                                                     c.from_server.append( c.server->read() );
+
+                                                     for ( const auto & response : unframe_dns_messages( c.from_server ) ) {
+                                                         cache_.insert( response );
+                                                         c.to_client.append( frame_dns_message( response ) );
+                                                     }
+                                                 } ),
+                                             [&c] () { return not c.server->eof() and c.to_client.size() < MAX_PENDING_TO_CLIENT; },
+                                             close_connection ) );
+
+    event_loop_->add_action( Poller::Action( *c.server, Direction::Out,
+                                             tcp_callback( id, c, [&c] () { write_some( *c.server, c.to_server ); } ),
+                                             [&c] () { return not c.to_server.empty(); },
+                                             close_connection ) );
+}
+
+/* wraps each of a TCP connection's callbacks: postpones its idle timeout,
+   passes on the client's end of file, and notices when it's over */
+Poller::Action::CallbackType DNSProxy::tcp_callback( const uint64_t id, TCPConnection & c,
+                                                     const function<void(void)> & callback )
+{
+    return [this, id, &c, callback] () {
+        try {
+            if ( c.expiry_tick != current_tick_ + TIMEOUT_TICKS ) {
+                c.expiry_tick = schedule_timeout( TimeoutType::TCPConnection, id );
             }
-            return;
-        }, tcp_listener_.accept() );
 
-    /* don't wait around for the reply */
-    newthread.detach();
+            callback();
+
+            /* client has sent its last query */
+            if ( c.client.eof() and c.server and c.to_server.empty() and not c.server_shut_down ) {
+                SystemCall( "shutdown", shutdown( c.server->fd_num(), SHUT_WR ) );
+                c.server_shut_down = true;
+            }
+
+            /* no more responses will come */
+            const bool no_more_responses = c.server ? c.server->eof() : c.client.eof();
+            if ( no_more_responses and c.to_client.empty() ) {
+                close_tcp_connection( id );
+            }
+        } catch ( const exception & e ) {
+            print_exception( e );
+            close_tcp_connection( id );
+        }
+
+        return ResultType::Continue;
+    };
+}
+
+/* stop polling the connection's sockets (but they may only be closed
+   once the callback that got us here has returned) */
+void DNSProxy::close_tcp_connection( const uint64_t id )
+{
+    const auto connection = tcp_connections_.find( id );
+    if ( connection == tcp_connections_.end() ) {
+        return;
+    }
+
+    event_loop_->remove_actions( connection->second->client );
+    if ( connection->second->server ) {
+        event_loop_->remove_actions( *connection->second->server );
+    }
+    closed_connections_.push_back( id );
+}
+
+void DNSProxy::destroy_closed_connections( void )
+{
+    for ( const auto id : closed_connections_ ) {
+        tcp_connections_.erase( id );
+    }
+
+    closed_connections_.clear();
 }
 
 unique_ptr<DNSProxy> DNSProxy::maybe_proxy( const Address & listen_address, const Address & s_udp_target, const Address & s_tcp_target )
@@ -140,8 +336,30 @@ unique_ptr<DNSProxy> DNSProxy::maybe_proxy( const Address & listen_address, cons
 
 void DNSProxy::register_handlers( EventLoop & event_loop )
 {
+    if ( event_loop_ ) {
+        throw runtime_error( "DNSProxy: handlers already registered" );
+    }
+
+    event_loop_ = &event_loop;
+
+    /* a failed query or connection shouldn't take down the event loop */
+    auto print_errors = [] ( const function<void(void)> & handler ) {
+        return [handler] () {
+            try {
+                handler();
+            } catch ( const exception & e ) {
+                print_exception( e );
+            }
+            return ResultType::Continue;
+        };
+    };
+
     event_loop.add_simple_input_handler( udp_listener(),
-                                         [&] () { handle_udp(); return ResultType::Continue; } );
+                                         print_errors( [&] () { handle_udp(); } ) );
+    event_loop.add_simple_input_handler( udp_upstream_,
+                                         print_errors( [&] () { handle_udp_reply(); } ) );
     event_loop.add_simple_input_handler( tcp_listener(),
-                                         [&] () { handle_tcp(); return ResultType::Continue; } );
+                                         print_errors( [&] () { handle_tcp(); } ) );
+    event_loop.add_simple_input_handler( timer_.fd(),
+                                         [&] () { handle_tick(); return ResultType::Continue; } );
 }
@@ -3,12 +3,26 @@
 #ifndef DNS_PROXY_HH
 #define DNS_PROXY_HH
 
+#include <map>
+#include <array>
+#include <vector>
 #include <memory>
+#include <cstdint>
+#include <functional>
 
 #include "socket.hh"
+#include "timerfd.hh"
+#include "poller.hh"
+#include "dns_cache.hh"
 
 class EventLoop;
 
+/* caching DNS resolver that forwards the queries it can't answer,
+   from the event loop's own thread: UDP queries share one upstream
+   socket (matched to replies by rewritten query ID), and TCP queries
+   are forwarded over one upstream connection per client connection.
+   The cache is shared by both. Abandoned queries and idle connections
+   are timed out on a one-second timer wheel. */
 class DNSProxy
 {
 private:
@@ -16,6 +30,73 @@ private:
     TCPSocket tcp_listener_;
     Address udp_target_, tcp_target_;
 
+    UDPSocket udp_upstream_;
+
+    struct UDPTransaction
+    {
+        Address client;
+        Address server; /* which of our addresses it asked */
+        uint16_t client_id;
+        uint64_t expiry_tick;
+    };
+
+    /* in-flight UDP queries, by upstream query ID and by (source, query ID) */
+    std::map<uint16_t, UDPTransaction> udp_transactions_ {};
+    std::map<std::pair<Address, uint16_t>, uint16_t> upstream_ids_ {};
+    uint16_t next_upstream_id_ { 0 };
+
+    struct TCPConnection
+    {
+        TCPSocket client;
+
+        /* connected when the first query that the cache can't answer arrives */
+        std::unique_ptr<TCPSocket> server {};
+        bool server_shut_down { false };
+
+        /* DNS messages, each preceded by its length */
+        std::string from_client {}, to_client {}, from_server {}, to_server {};
+
+        uint64_t expiry_tick;
+
+        TCPConnection( TCPSocket && s_client, const uint64_t s_expiry_tick )
+            : client( std::move( s_client ) ), expiry_tick( s_expiry_tick ) {}
+    };
+
+    std::map<uint64_t, std::unique_ptr<TCPConnection>> tcp_connections_ {};
+    uint64_t next_connection_id_ { 0 };
+
+    /* closed from inside one of their own callbacks; destroyed later */
+    std::vector<uint64_t> closed_connections_ {};
+
+    DNSCache cache_ {};
+
+    /* timer wheel: each slot lists what might expire on that tick */
+    const static unsigned int TICK_MS = 1000;
+    const static unsigned int TIMEOUT_TICKS = 60;
+    const static unsigned int WHEEL_SLOTS = 64;
+
+    enum class TimeoutType { UDPQuery, TCPConnection };
+
+    TimerFD timer_ {};
+    uint64_t current_tick_ { 0 };
+    std::array<std::vector<std::pair<TimeoutType, uint64_t>>, WHEEL_SLOTS> wheel_ {};
+
+    EventLoop * event_loop_ { nullptr };
+
+    uint64_t schedule_timeout( const TimeoutType type, const uint64_t key );
+    void handle_tick( void );
+
+    void handle_udp( void );
+    void handle_udp_reply( void );
+    void forget_udp_transaction( const uint16_t upstream_id );
+
+    void handle_tcp( void );
+    void connect_to_server( const uint64_t id, TCPConnection & connection );
+    Poller::Action::CallbackType tcp_callback( const uint64_t id, TCPConnection & connection,
+                                               const std::function<void(void)> & callback );
+    void close_tcp_connection( const uint64_t id );
+    void destroy_closed_connections( void );
+
 public:
     DNSProxy( const Address & listen_address, const Address & s_udp_target, const Address & s_tcp_target );
 
@@ -27,12 +108,14 @@ public:
     UDPSocket & udp_listener( void ) { return udp_listener_; }
     TCPSocket & tcp_listener( void ) { return tcp_listener_; }
 
-    void handle_udp( void );
-    void handle_tcp( void );
-
     static std::unique_ptr<DNSProxy> maybe_proxy( const Address & listen_address, const Address & s_udp_target, const Address & s_tcp_target );
 
+    /* may only be called once: the proxy then runs within this event loop */
     void register_handlers( EventLoop & event_loop );
+
+    /* forbid copying */
+    DNSProxy( const DNSProxy & other ) = delete;
+    DNSProxy & operator=( const DNSProxy & other ) = delete;
 };
 
 #endif /* DNS_PROXY_HH */
@@ -0,0 +1,325 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+
+#include <sys/socket.h>
+
+#include "dns_responder.hh"
+#include "dns_framing.hh"
+#include "dns_cache.hh"
+#include "poller.hh"
+#include "event_loop.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+namespace {
+    const size_t HEADER_LENGTH = 12;
+
+    const uint16_t FLAG_RESPONSE = 0x8000;
+    const uint16_t FLAG_AUTHORITATIVE = 0x0400;
+    const uint16_t FLAG_TRUNCATED = 0x0200;
+    const uint16_t FLAG_RECURSION_DESIRED = 0x0100;
+
+    const uint16_t RCODE_FORMERR = 1;
+    const uint16_t RCODE_NXDOMAIN = 3;
+    const uint16_t RCODE_NOTIMP = 4;
+    const uint16_t RCODE_REFUSED = 5;
+
+    const uint16_t TYPE_A = 1;
+    const uint16_t TYPE_AAAA = 28;
+    const uint16_t TYPE_ANY = 255;
+    const uint16_t CLASS_IN = 1;
+
+    /* as dnsmasq gave the entries of a hosts file */
+    const uint32_t RECORD_TTL = 0;
+
+    /* don't read more while the client is behind */
+    const size_t MAX_PENDING_TO_CLIENT = 64 * 1024;
+
+    uint16_t get_16( const string & message, const size_t offset )
+    {
+        return ( uint8_t( message.at( offset ) ) << 8 ) | uint8_t( message.at( offset + 1 ) );
+    }
+
+    string put_16( const uint16_t value )
+    {
+        return string( 1, value >> 8 ) + string( 1, value & 0xff );
+    }
+
+    string put_32( const uint32_t value )
+    {
+        return put_16( value >> 16 ) + put_16( value & 0xffff );
+    }
+
+    string lower_case( string name )
+    {
+        transform( name.begin(), name.end(), name.begin(),
+                   [] ( const char c ) { return ( c >= 'A' and c <= 'Z' ) ? c - 'A' + 'a' : c; } );
+        return name;
+    }
+
+    /* the name in a Host header, without any port number or trailing dot */
+    string host_name( const string & host_header )
+    {
+        string name = host_header;
+
+        const size_t colon = name.rfind( ':' );
+        if ( colon != string::npos and name.find( ']' ) == string::npos ) {
+            name.resize( colon );
+        }
+
+        if ( not name.empty() and name.back() == '.' ) {
+            name.pop_back();
+        }
+
+        return lower_case( name );
+    }
+
+    /* header-only response with the given rcode */
+    string error_response( const string & query, const uint16_t rcode )
+    {
+        const uint16_t flags = FLAG_RESPONSE | ( get_16( query, 2 ) & ( 0x7800 | FLAG_RECURSION_DESIRED ) ) | rcode;
+        return query.substr( 0, 2 ) + put_16( flags ) + string( 8, 0 );
+    }
+}
+
+DNSResponder::DNSResponder( const Address & listen_address,
+                            const vector<pair<string, Address>> & hostname_to_ip )
+    : udp_listener_(), tcp_listener_()
+{
+    udp_listener_.bind( listen_address );
+    tcp_listener_.bind( udp_listener_.local_address() );
+    tcp_listener_.listen();
+
+    /* answer from whichever of our addresses was asked */
+    udp_listener_.set_pktinfo();
+
+    for ( const auto & mapping : hostname_to_ip ) {
+        const string name = host_name( mapping.first );
+        if ( name.empty() ) {
+            continue;
+        }
+
+        Records & records = table_[ name ];
+
+        const sockaddr & addr = mapping.second.to_sockaddr();
+        string ip;
+        vector<string> * list;
+        if ( addr.sa_family == AF_INET ) {
+            const in_addr & ipv4 = reinterpret_cast<const sockaddr_in &>( addr ).sin_addr;
+            ip.assign( reinterpret_cast<const char *>( &ipv4 ), sizeof( ipv4 ) );
+            list = &records.ipv4;
+        } else if ( addr.sa_family == AF_INET6 ) {
+            const in6_addr & ipv6 = reinterpret_cast<const sockaddr_in6 &>( addr ).sin6_addr;
+            ip.assign( reinterpret_cast<const char *>( &ipv6 ), sizeof( ipv6 ) );
+            list = &records.ipv6;
+        } else {
+            throw runtime_error( "DNSResponder: unknown address family for " + name );
+        }
+
+        /* the recording has many requests to each server */
+        if ( find( list->begin(), list->end(), ip ) == list->end() ) {
+            list->push_back( ip );
+        }
+    }
+}
+
+string DNSResponder::answer( const string & query, const size_t max_response_size ) const
+{
+    if ( query.size() < HEADER_LENGTH or ( get_16( query, 2 ) & FLAG_RESPONSE ) ) {
+        return string();
+    }
+
+    if ( ( get_16( query, 2 ) >> 11 ) & 0xf ) {
+        return error_response( query, RCODE_NOTIMP );
+    }
+
+    if ( get_16( query, 4 ) != 1 ) {
+        return error_response( query, RCODE_FORMERR );
+    }
+
+    /* the question's name (questions don't use compression) */
+    string name;
+    size_t offset = HEADER_LENGTH;
+    while ( true ) {
+        if ( offset >= query.size() ) {
+            return error_response( query, RCODE_FORMERR );
+        }
+
+        const uint8_t length = query.at( offset );
+        if ( length == 0 ) {
+            offset++;
+            break;
+        } else if ( length & 0xc0 or offset + 1 + length > query.size() ) {
+            return error_response( query, RCODE_FORMERR );
+        }
+
+        name.append( name.empty() ? "" : "." );
+        name.append( query, offset + 1, length );
+        offset += 1 + length;
+    }
+
+    if ( offset + 4 > query.size() ) {
+        return error_response( query, RCODE_FORMERR );
+    }
+
+    const uint16_t type = get_16( query, offset );
+    const uint16_t qclass = get_16( query, offset + 2 );
+    const string question = query.substr( HEADER_LENGTH, offset + 4 - HEADER_LENGTH );
+
+    if ( qclass != CLASS_IN ) {
+        return error_response( query, RCODE_REFUSED );
+    }
+
+    uint16_t flags = FLAG_RESPONSE | FLAG_AUTHORITATIVE | ( get_16( query, 2 ) & FLAG_RECURSION_DESIRED );
+    vector<pair<uint16_t, string>> answers;
+
+    const auto records = table_.find( lower_case( name ) );
+    if ( records == table_.end() ) {
+        flags |= RCODE_NXDOMAIN;
+    } else {
+        if ( type == TYPE_A or type == TYPE_ANY ) {
+            for ( const auto & ip : records->second.ipv4 ) {
+                answers.emplace_back( TYPE_A, ip );
+            }
+        }
+
+        if ( type == TYPE_AAAA or type == TYPE_ANY ) {
+            for ( const auto & ip : records->second.ipv6 ) {
+                answers.emplace_back( TYPE_AAAA, ip );
+            }
+        }
+    }
+
+    /* answers point back to the name in the question */
+    string answer_section;
+    for ( const auto & x : answers ) {
+        answer_section.append( put_16( 0xc000 | HEADER_LENGTH ) + put_16( x.first ) + put_16( CLASS_IN )
+                               + put_32( RECORD_TTL ) + put_16( x.second.size() ) + x.second );
+    }
+
+    /* the client should ask again over TCP */
+    if ( HEADER_LENGTH + question.size() + answer_section.size() > max_response_size ) {
+        flags |= FLAG_TRUNCATED;
+        answers.clear();
+        answer_section.clear();
+    }
+
+    return query.substr( 0, 2 ) + put_16( flags ) + put_16( 1 ) + put_16( answers.size() )
+        + string( 4, 0 ) + question + answer_section;
+}
+
+void DNSResponder::handle_udp( void )
+{
+    const UDPSocket::ReceivedDatagram query = udp_listener_.recv_with_destination();
+
+    const string response = answer( query.payload, DNSCache::max_udp_response_size( query.payload ) );
+    if ( not response.empty() ) {
+        udp_listener_.sendto_from( query.destination, query.source, response );
+    }
+}
+
+void DNSResponder::handle_tcp( void )
+{
+    destroy_closed_connections();
+
+    const uint64_t id = next_connection_id_++;
+
+    TCPConnection & c = *tcp_connections_.emplace( id, unique_ptr<TCPConnection>(
+        new TCPConnection( tcp_listener_.accept() ) ) ).first->second;
+    c.socket.set_blocking( false );
+
+    /* close once the client is done and has all its answers */
+    auto callback = [this, id, &c] ( const function<void(void)> & body ) {
+        return [this, id, &c, body] () {
+            try {
+                body();
+
+                if ( c.socket.eof() and c.to_client.empty() ) {
+                    close_tcp_connection( id );
+                }
+            } catch ( const exception & e ) {
+                print_exception( e );
+                close_tcp_connection( id );
+            }
+
+            return ResultType::Continue;
+        };
+    };
+
+    auto close_connection = [this, id] () { close_tcp_connection( id ); };
+
+    event_loop_->add_action( Poller::Action( c.socket, Direction::In,
+                                             callback( [this, &c] () {
+                                                     c.from_client.append( c.socket.read() );
+
+                                                     for ( const auto & query : unframe_dns_messages( c.from_client ) ) {
+                                                         const string response = answer( query, UINT16_MAX );
+                                                         if ( not response.empty() ) {
+                                                             c.to_client.append( frame_dns_message( response ) );
+                                                         }
+                                                     }
+                                                 } ),
+                                             [&c] () { return not c.socket.eof() and c.to_client.size() < MAX_PENDING_TO_CLIENT; },
+                                             close_connection ) );
+
+    event_loop_->add_action( Poller::Action( c.socket, Direction::Out,
+                                             callback( [&c] () {
+                                                     c.to_client.erase( c.to_client.cbegin(), c.socket.write( c.to_client, false ) );
+                                                 } ),
+                                             [&c] () { return not c.to_client.empty(); },
+                                             close_connection ) );
+}
+
+/* stop polling the connection's socket (but it may only be closed
+   once the callback that got us here has returned) */
+void DNSResponder::close_tcp_connection( const uint64_t id )
+{
+    const auto connection = tcp_connections_.find( id );
+    if ( connection == tcp_connections_.end() ) {
+        return;
+    }
+
+    event_loop_->remove_actions( connection->second->socket );
+    closed_connections_.push_back( id );
+
+    /* meanwhile, let the client know we're done (unless it's already gone) */
+    shutdown( connection->second->socket.fd_num(), SHUT_RDWR );
+}
+
+void DNSResponder::destroy_closed_connections( void )
+{
+    for ( const auto id : closed_connections_ ) {
+        tcp_connections_.erase( id );
+    }
+
+    closed_connections_.clear();
+}
+
+void DNSResponder::register_handlers( EventLoop & event_loop )
+{
+    if ( event_loop_ ) {
+        throw runtime_error( "DNSResponder: handlers already registered" );
+    }
+
+    event_loop_ = &event_loop;
+
+    /* a bad query shouldn't take down the event loop */
+    auto print_errors = [] ( const function<void(void)> & handler ) {
+        return [handler] () {
+            try {
+                handler();
+            } catch ( const exception & e ) {
+                print_exception( e );
+            }
+            return ResultType::Continue;
+        };
+    };
+
+    event_loop.add_simple_input_handler( udp_listener_,
+                                         print_errors( [&] () { handle_udp(); } ) );
+    event_loop.add_simple_input_handler( tcp_listener_,
+                                         print_errors( [&] () { handle_tcp(); } ) );
+}
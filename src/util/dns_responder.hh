@@ -0,0 +1,72 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DNS_RESPONDER_HH
+#define DNS_RESPONDER_HH
+
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <utility>
+
+#include "socket.hh"
+
+class EventLoop;
+
+/* authoritative DNS server for a fixed table of host names (e.g. those
+   of a recorded site), answering UDP and TCP queries from the event
+   loop's own thread. Names that aren't in the table don't exist. */
+class DNSResponder
+{
+private:
+    UDPSocket udp_listener_;
+    TCPSocket tcp_listener_;
+
+    struct Records
+    {
+        std::vector<std::string> ipv4 {}, ipv6 {}; /* addresses in network byte order */
+    };
+
+    /* by lower-case name, without the trailing dot */
+    std::map<std::string, Records> table_ {};
+
+    struct TCPConnection
+    {
+        TCPSocket socket;
+        std::string from_client {}, to_client {}; /* DNS messages, each preceded by its length */
+
+        TCPConnection( TCPSocket && s_socket ) : socket( std::move( s_socket ) ) {}
+    };
+
+    std::map<uint64_t, std::unique_ptr<TCPConnection>> tcp_connections_ {};
+    uint64_t next_connection_id_ { 0 };
+
+    /* closed from inside one of their own callbacks; destroyed later */
+    std::vector<uint64_t> closed_connections_ {};
+
+    EventLoop * event_loop_ { nullptr };
+
+    void handle_udp( void );
+    void handle_tcp( void );
+    void close_tcp_connection( const uint64_t id );
+    void destroy_closed_connections( void );
+
+public:
+    /* listens on listen_address (the wildcard address answers
+       from whichever local address each query was sent to) */
+    DNSResponder( const Address & listen_address,
+                  const std::vector<std::pair<std::string, Address>> & hostname_to_ip );
+
+    /* the response to a query, or an empty string if it doesn't deserve one */
+    std::string answer( const std::string & query, const size_t max_response_size ) const;
+
+    /* may only be called once: the responder then runs within this event loop */
+    void register_handlers( EventLoop & event_loop );
+
+    /* forbid copying */
+    DNSResponder( const DNSResponder & other ) = delete;
+    DNSResponder & operator=( const DNSResponder & other ) = delete;
+};
+
+#endif /* DNS_RESPONDER_HH */
@@ -21,8 +21,6 @@ private:
     PollerShortNames::Result handle_signal( const signalfd_siginfo & sig );
 
 protected:
-    void add_action( Poller::Action action ) { poller_.add_action( action ); }
-
     int internal_loop( const std::function<int(void)> & wait_time );
 
 public:
@@ -30,6 +28,9 @@ public:
 
     void add_simple_input_handler( FileDescriptor & fd, const Poller::Action::CallbackType & callback );
 
+    void add_action( Poller::Action action ) { poller_.add_action( action ); }
+    void remove_actions( const FileDescriptor & fd ) { poller_.remove_actions( fd ); }
+
     template <typename... Targs>
     void add_child_process( Targs&&... Fargs )
     {
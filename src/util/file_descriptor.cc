@@ -5,6 +5,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 
 using namespace std;
 
@@ -49,6 +50,18 @@ FileDescriptor::~FileDescriptor()
     }
 }
 
+void FileDescriptor::set_blocking( const bool block )
+{
+    int flags = SystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
+    if ( block ) {
+        flags &= ~O_NONBLOCK;
+    } else {
+        flags |= O_NONBLOCK;
+    }
+
+    SystemCall( "fcntl F_SETFL", fcntl( fd_, F_SETFL, flags ) );
+}
+
 /* attempt to write a portion of a string */
 string::const_iterator FileDescriptor::write( const string::const_iterator & begin,
                                               const string::const_iterator & end )
@@ -82,6 +95,51 @@ string FileDescriptor::read( const size_t limit )
     return string( buffer, bytes_read );
 }
 
+size_t FileDescriptor::splice_from( FileDescriptor & source, const size_t limit )
+{
+    const ssize_t bytes_moved = ::splice( source.fd_, nullptr, fd_, nullptr, limit,
+                                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+
+    /* both fds were serviced, even if the pipe turned out to be full */
+    source.register_read();
+    register_write();
+
+    if ( bytes_moved < 0 and errno == EAGAIN ) {
+        return 0;
+    }
+
+    SystemCall( "splice", bytes_moved );
+
+    if ( bytes_moved == 0 ) {
+        source.set_eof();
+    }
+
+    return bytes_moved;
+}
+
+size_t FileDescriptor::tee_from( FileDescriptor & source, const size_t limit )
+{
+    const ssize_t bytes_copied = ::tee( source.fd_, fd_, limit, SPLICE_F_NONBLOCK );
+
+    source.register_read();
+    register_write();
+
+    if ( bytes_copied < 0 and errno == EAGAIN ) {
+        return 0;
+    }
+
+    SystemCall( "tee", bytes_copied );
+
+    return bytes_copied;
+}
+
+pair<FileDescriptor, FileDescriptor> FileDescriptor::make_pipe( void )
+{
+    int fds[ 2 ];
+    SystemCall( "pipe2", pipe2( fds, O_NONBLOCK ) );
+    return make_pair( FileDescriptor( fds[ 0 ] ), FileDescriptor( fds[ 1 ] ) );
+}
+
 /* write method */
 string::const_iterator FileDescriptor::write( const std::string & buffer, const bool write_all )
 {
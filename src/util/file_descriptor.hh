@@ -4,6 +4,7 @@
 #define FILE_DESCRIPTOR_HH
 
 #include <string>
+#include <utility>
 
 /* Unix file descriptors (sockets, files, etc.) */
 class FileDescriptor
@@ -38,12 +39,28 @@ public:
     unsigned int read_count( void ) const { return read_count_; }
     unsigned int write_count( void ) const { return write_count_; }
 
+    /* make reads and writes return immediately (after poll() says they won't block) */
+    void set_blocking( const bool block );
+
     /* read and write methods */
     std::string read( const size_t limit = BUFFER_SIZE );
     std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
     std::string::const_iterator write( const std::string::const_iterator & begin,
                                        const std::string::const_iterator & end );
 
+    /* move up to limit bytes from source to this fd (one of the two must be a
+       pipe) without copying them through user space. Returns 0 at the source's
+       end of file, and also (without setting eof) if the move would block */
+    size_t splice_from( FileDescriptor & source, const size_t limit );
+
+    /* copy up to limit bytes from the front of the source pipe into this
+       one (a pipe), leaving them in the source. Returns 0 if the copy
+       would block */
+    size_t tee_from( FileDescriptor & source, const size_t limit );
+
+    /* a non-blocking pipe (read end, write end) */
+    static std::pair<FileDescriptor, FileDescriptor> make_pipe( void );
+
     /* forbid copying FileDescriptor objects or assigning them */
     FileDescriptor( const FileDescriptor & other ) = delete;
     const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
@@ -6,106 +6,345 @@
    We mark the connections on entry from the ingress address (with our PID),
    and then look for the mark on output. */
 
+#include <atomic>
+
 #include <unistd.h>
-#include <iostream>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <linux/if.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
 
 #include "nat.hh"
 #include "exception.hh"
-#include "config.h"
+#include "util.hh"
 
 using namespace std;
 
-NATRule::NATRule( const vector< string > & s_args )
-    : arguments( s_args )
-{
-    if (!arguments.empty()) {
-      vector< string > command = { IPTABLES, "-w", "-t", "nat", "-I" };
-      command.insert( command.end(), arguments.begin(), arguments.end() );
-      cout << "command: ";
-      for (auto i = command.begin(); i != command.end(); ++i)
-           cout << *i << ' ';
-      cout << endl;
-      run( command );
+/* nftables messages, all in the ip family */
+static NetlinkMessage nft_message( const uint16_t type, const uint16_t flags )
+{
+    NetlinkMessage message( ( NFNL_SUBSYS_NFTABLES << 8 ) | type, NLM_F_REQUEST | NLM_F_ACK | flags );
+
+    nfgenmsg header;
+    zero( header );
+    header.nfgen_family = NFPROTO_IPV4;
+    header.version = NFNETLINK_V0;
+    message.add_header( header );
+
+    return message;
+}
+
+/* brackets a batch; these are not acknowledged themselves */
+static NetlinkMessage batch_message( const uint16_t type )
+{
+    NetlinkMessage message( type, NLM_F_REQUEST );
+
+    nfgenmsg header;
+    zero( header );
+    header.nfgen_family = AF_UNSPEC;
+    header.version = NFNETLINK_V0;
+    header.res_id = htons( NFNL_SUBSYS_NFTABLES );
+    message.add_header( header );
+
+    return message;
+}
+
+/* commit the messages as one transaction */
+static void nftables_transaction( vector< NetlinkMessage > && messages )
+{
+    vector< NetlinkMessage > batch;
+    batch.push_back( batch_message( NFNL_MSG_BATCH_BEGIN ) );
+    for ( auto & message : messages ) {
+        batch.push_back( move( message ) );
     }
+    batch.push_back( batch_message( NFNL_MSG_BATCH_END ) );
+
+    NetlinkSocket nfnetlink( NETLINK_NETFILTER );
+    nfnetlink.transact( batch );
+}
+
+/* expressions; each loads into, compares or acts on register 1 (and 2) */
+static void expression( NetlinkMessage & rule, const string & name,
+                        const function<void( NetlinkMessage & )> & data )
+{
+    rule.begin_nested( NFTA_LIST_ELEM );
+    rule.add_string( NFTA_EXPR_NAME, name );
+    rule.begin_nested( NFTA_EXPR_DATA );
+    data( rule );
+    rule.end_nested();
+    rule.end_nested();
 }
 
-NATRule::NATRule( const vector< string > & s_args, bool as_sudo )
-    : arguments( s_args )
+static void immediate( NetlinkMessage & rule, const uint32_t reg, const string & value )
 {
-  if (!arguments.empty()) {
-    vector< string > command;
-    if (as_sudo) {
-      command = { "sudo", IPTABLES, "-w", "-t", "nat", "-I" };
-    } else {
-      command = { IPTABLES, "-w", "-t", "nat", "-I" };
+    expression( rule, "immediate", [&] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_IMMEDIATE_DREG, htonl( reg ) );
+            data.begin_nested( NFTA_IMMEDIATE_DATA );
+            data.add_attribute( NFTA_DATA_VALUE, value );
+            data.end_nested();
+        } );
+}
+
+static void compare_equal( NetlinkMessage & rule, const string & value )
+{
+    expression( rule, "cmp", [&] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_CMP_SREG, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_CMP_OP, htonl( NFT_CMP_EQ ) );
+            data.begin_nested( NFTA_CMP_DATA );
+            data.add_attribute( NFTA_DATA_VALUE, value );
+            data.end_nested();
+        } );
+}
+
+static void load_payload( NetlinkMessage & rule, const uint32_t base,
+                          const uint32_t offset, const uint32_t length )
+{
+    expression( rule, "payload", [&] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_PAYLOAD_DREG, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_PAYLOAD_BASE, htonl( base ) );
+            data.add_attribute( NFTA_PAYLOAD_OFFSET, htonl( offset ) );
+            data.add_attribute( NFTA_PAYLOAD_LEN, htonl( length ) );
+        } );
+}
+
+static void load_meta( NetlinkMessage & rule, const uint32_t key )
+{
+    expression( rule, "meta", [&] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_META_DREG, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_META_KEY, htonl( key ) );
+        } );
+}
+
+static string raw_bytes( const uint32_t value )
+{
+    return string( reinterpret_cast<const char *>( &value ), sizeof( value ) );
+}
+
+static string raw_ip( const Address & addr )
+{
+    const sockaddr_in & sin = reinterpret_cast<const sockaddr_in &>( addr.to_sockaddr() );
+    return string( reinterpret_cast<const char *>( &sin.sin_addr ), sizeof( sin.sin_addr ) );
+}
+
+static string raw_port( const uint16_t port )
+{
+    const uint16_t port_n = htons( port );
+    return string( reinterpret_cast<const char *>( &port_n ), sizeof( port_n ) );
+}
+
+/* matches */
+static void match_source( NetlinkMessage & rule, const Address & addr )
+{
+    load_payload( rule, NFT_PAYLOAD_NETWORK_HEADER, offsetof( iphdr, saddr ), sizeof( iphdr::saddr ) );
+    compare_equal( rule, raw_ip( addr ) );
+}
+
+static uint8_t protocol_number( const string & protocol )
+{
+    if ( protocol == "tcp" or protocol == "TCP" ) {
+        return IPPROTO_TCP;
+    } else if ( protocol == "udp" or protocol == "UDP" ) {
+        return IPPROTO_UDP;
     }
-    command.insert( command.end(), arguments.begin(), arguments.end() );
-    cout << "command: ";
-    for (auto i = command.begin(); i != command.end(); ++i)
-         cout << *i << ' ';
-    cout << endl;
-    run( command );
-  }
+
+    throw runtime_error( "NAT: unsupported protocol " + protocol );
 }
 
-NATRule::~NATRule()
+static void match_protocol( NetlinkMessage & rule, const uint8_t protocol )
 {
-    try {
-      if (!arguments.empty()) {
-        cout << "[nat] Removing NAT rule" << endl;
-        vector< string > command = { IPTABLES, "-w", "-t", "nat", "-D" };
-        for (auto it = arguments.begin(); it != arguments.end(); ++it) {
-          auto argument = *it;
-          if (argument != "1") {
-            command.push_back(*it);
-          }
+    load_meta( rule, NFT_META_L4PROTO );
+    compare_equal( rule, string( 1, protocol ) );
+}
+
+/* the ports are at the same offset for TCP and UDP */
+static void match_destination_port( NetlinkMessage & rule, const uint16_t port )
+{
+    load_payload( rule, NFT_PAYLOAD_TRANSPORT_HEADER, 2, 2 );
+    compare_equal( rule, raw_port( port ) );
+}
+
+static void match_input_interface( NetlinkMessage & rule, const string & interface )
+{
+    if ( interface.size() >= IFNAMSIZ ) {
+        throw runtime_error( "NAT: interface name too long: " + interface );
+    }
+
+    load_meta( rule, NFT_META_IIFNAME );
+    compare_equal( rule, interface + string( IFNAMSIZ - interface.size(), '\0' ) );
+}
+
+static void match_connection_mark( NetlinkMessage & rule, const uint32_t mark )
+{
+    expression( rule, "ct", [] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_CT_DREG, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_CT_KEY, htonl( NFT_CT_MARK ) );
+        } );
+    compare_equal( rule, raw_bytes( mark ) );
+}
+
+/* actions */
+static void set_connection_mark( NetlinkMessage & rule, const uint32_t mark )
+{
+    immediate( rule, NFT_REG_1, raw_bytes( mark ) );
+    expression( rule, "ct", [] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_CT_SREG, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_CT_KEY, htonl( NFT_CT_MARK ) );
+        } );
+}
+
+static void masquerade( NetlinkMessage & rule )
+{
+    expression( rule, "masq", [] ( NetlinkMessage & ) {} );
+}
+
+static void destination_nat( NetlinkMessage & rule, const Address & to )
+{
+    immediate( rule, NFT_REG_1, raw_ip( to ) );
+    immediate( rule, NFT_REG_2, raw_port( to.port() ) );
+    expression( rule, "nat", [] ( NetlinkMessage & data ) {
+            data.add_attribute( NFTA_NAT_TYPE, htonl( NFT_NAT_DNAT ) );
+            data.add_attribute( NFTA_NAT_FAMILY, htonl( NFPROTO_IPV4 ) );
+            data.add_attribute( NFTA_NAT_REG_ADDR_MIN, htonl( NFT_REG_1 ) );
+            data.add_attribute( NFTA_NAT_REG_PROTO_MIN, htonl( NFT_REG_2 ) );
+        } );
+}
+
+static string chain_name( const NATRule::Chain chain )
+{
+    return chain == NATRule::Chain::Prerouting ? "prerouting" : "postrouting";
+}
+
+static NetlinkMessage new_chain( const string & table, const NATRule::Chain chain )
+{
+    const bool pre = chain == NATRule::Chain::Prerouting;
+
+    NetlinkMessage message = nft_message( NFT_MSG_NEWCHAIN, NLM_F_CREATE );
+    message.add_string( NFTA_CHAIN_TABLE, table );
+    message.add_string( NFTA_CHAIN_NAME, chain_name( chain ) );
+    message.begin_nested( NFTA_CHAIN_HOOK );
+    message.add_attribute( NFTA_HOOK_HOOKNUM, htonl( pre ? NF_INET_PRE_ROUTING : NF_INET_POST_ROUTING ) );
+    message.add_attribute( NFTA_HOOK_PRIORITY, htonl( pre ? NF_IP_PRI_NAT_DST : NF_IP_PRI_NAT_SRC ) );
+    message.end_nested();
+    message.add_string( NFTA_CHAIN_TYPE, "nat" );
+    message.add_attribute( NFTA_CHAIN_POLICY, htonl( NF_ACCEPT ) );
+
+    return message;
+}
+
+NATTable::NATTable( const vector< NATRule > & rules )
+    : name_()
+{
+    if ( rules.empty() ) {
+        return;
+    }
+
+    /* tables are global to the network namespace, so make the name unique */
+    static atomic<unsigned int> table_count( 0 );
+    const string name = "mahimahi-" + to_string( getpid() ) + "-" + to_string( table_count++ );
+
+    vector< NetlinkMessage > batch;
+
+    NetlinkMessage table = nft_message( NFT_MSG_NEWTABLE, NLM_F_CREATE | NLM_F_EXCL );
+    table.add_string( NFTA_TABLE_NAME, name );
+    batch.push_back( move( table ) );
+
+    for ( const auto chain : { NATRule::Chain::Prerouting, NATRule::Chain::Postrouting } ) {
+        for ( const auto & rule : rules ) {
+            if ( rule.chain == chain ) {
+                batch.push_back( new_chain( name, chain ) );
+                break;
+            }
         }
-        // command.insert( command.end(), arguments.begin(), arguments.end() );
-        run( command );
-      }
+    }
+
+    for ( const auto & rule : rules ) {
+        NetlinkMessage message = nft_message( NFT_MSG_NEWRULE, NLM_F_CREATE | NLM_F_APPEND );
+        message.add_string( NFTA_RULE_TABLE, name );
+        message.add_string( NFTA_RULE_CHAIN, chain_name( rule.chain ) );
+        message.begin_nested( NFTA_RULE_EXPRESSIONS );
+        rule.encode( message );
+        message.end_nested();
+        batch.push_back( move( message ) );
+    }
+
+    nftables_transaction( move( batch ) );
+
+    name_ = name;
+}
+
+NATTable::~NATTable()
+{
+    if ( name_.empty() ) {
+        return;
+    }
+
+    try {
+        /* deleting the table takes its chains and rules with it */
+        NetlinkMessage table = nft_message( NFT_MSG_DELTABLE, 0 );
+        table.add_string( NFTA_TABLE_NAME, name_ );
+        nftables_transaction( { move( table ) } );
     } catch ( const exception & e ) { /* don't throw from destructor */
         print_exception( e );
     }
 }
 
 NAT::NAT( const Address & ingress_addr )
-: pre_( { "PREROUTING", "1", "-s", ingress_addr.ip(), "-j", "CONNMARK",
-            "--set-mark", to_string( getpid() ) } ),
-  post_( { "POSTROUTING", "1", "-j", "MASQUERADE", "-m", "connmark",
-              "--mark", to_string( getpid() ) } )
+    : table_( { { NATRule::Chain::Prerouting, [&] ( NetlinkMessage & rule ) {
+                    match_source( rule, ingress_addr );
+                    set_connection_mark( rule, getpid() );
+                } },
+                { NATRule::Chain::Postrouting, [] ( NetlinkMessage & rule ) {
+                    match_connection_mark( rule, getpid() );
+                    masquerade( rule );
+                } } } )
 {}
 
 NAT::NAT()
-: pre_( { } ),
-  post_( { } )
+    : table_( {} )
 {}
 
 DNAT::DNAT()
-  : rule_( { } )
+    : table_( {} )
 {}
 
 DNAT::DNAT( const Address & listener, const string & interface )
-    : rule_( { "PREROUTING", "1", "-p", "TCP", "-i", interface, "-j", "DNAT",
-                "--to-destination", listener.str() } )
+    : table_( { { NATRule::Chain::Prerouting, [&] ( NetlinkMessage & rule ) {
+                    match_protocol( rule, IPPROTO_TCP );
+                    match_input_interface( rule, interface );
+                    destination_nat( rule, listener );
+                } } } )
 {}
 
 DNAT::DNAT( const Address & listener, const uint16_t port )
-    : rule_( { "PREROUTING", "1", "-p", "TCP", "--dport", to_string(port), "-j", "DNAT",
-                "--to-destination", listener.str() } )
+    : table_( { { NATRule::Chain::Prerouting, [&] ( NetlinkMessage & rule ) {
+                    match_protocol( rule, IPPROTO_TCP );
+                    match_destination_port( rule, port );
+                    destination_nat( rule, listener );
+                } } } )
 {}
 
 DNAT::DNAT( const Address & listener, const string & protocol, const uint16_t port )
-    : rule_( { "PREROUTING", "1", "-p", protocol, "--dport", to_string(port), "-j", "DNAT",
-                "--to-destination", listener.str() } )
+    : table_( { { NATRule::Chain::Prerouting, [&] ( NetlinkMessage & rule ) {
+                    match_protocol( rule, protocol_number( protocol ) );
+                    match_destination_port( rule, port );
+                    destination_nat( rule, listener );
+                } } } )
 {}
 
 DNATWithPostrouting::DNATWithPostrouting( const Address & listener, const string & protocol, const uint16_t port )
-    : rule_( { "PREROUTING", "1", "-p", protocol, "--dport", to_string(port), "-j", "DNAT",
-                "--to-destination", listener.str() } ),
-      post_( { "POSTROUTING", "1", "-j", "MASQUERADE" } )
+    : table_( { { NATRule::Chain::Prerouting, [&] ( NetlinkMessage & rule ) {
+                    match_protocol( rule, protocol_number( protocol ) );
+                    match_destination_port( rule, port );
+                    destination_nat( rule, listener );
+                } },
+                { NATRule::Chain::Postrouting, [] ( NetlinkMessage & rule ) {
+                    masquerade( rule );
+                } } } )
 {}
 
 DNATWithPostrouting::DNATWithPostrouting()
-  : rule_( { } ),
-    post_( { } )
+    : table_( {} )
 {}
@@ -6,33 +6,49 @@
 /* Network Address Translator */
 
 #include <string>
+#include <vector>
+#include <functional>
 
-#include "system_runner.hh"
 #include "address.hh"
+#include "netlink.hh"
 
-/* RAII class to make connections coming from the ingress address
-   look like they're coming from the output device's address.
+/* one rule of a NATTable: the chain it belongs to, and a function
+   that encodes its nftables expressions (matches, then the action) */
+struct NATRule
+{
+    enum class Chain { Prerouting, Postrouting };
 
-   We mark the connections on entry from the ingress address (with our PID),
-   and then look for the mark on output. */
+    Chain chain;
+    std::function<void( NetlinkMessage & expressions )> encode;
+};
 
-class NATRule {
+/* RAII class for an nftables table holding NAT rules. The table, its
+   chains and all of its rules are installed in a single netlink batch
+   (one atomic transaction, with no global xtables lock), and removed
+   together. An empty rule list installs nothing. */
+class NATTable
+{
 private:
-    std::vector< std::string > arguments;
+    std::string name_;
 
 public:
-    NATRule( const std::vector< std::string > & s_args );
-    NATRule( const std::vector< std::string > & s_args, bool as_sudo );
-    ~NATRule();
+    NATTable( const std::vector< NATRule > & rules );
+    ~NATTable();
 
-    NATRule( const NATRule & other ) = delete;
-    const NATRule & operator=( const NATRule & other ) = delete;
+    NATTable( const NATTable & other ) = delete;
+    const NATTable & operator=( const NATTable & other ) = delete;
 };
 
+/* RAII class to make connections coming from the ingress address
+   look like they're coming from the output device's address.
+
+   We mark the connections on entry from the ingress address (with our PID),
+   and then look for the mark on output. */
+
 class NAT
 {
 private:
-    NATRule pre_, post_;
+    NATTable table_;
 
 public:
     NAT();
@@ -42,7 +58,7 @@ public:
 class DNAT
 {
 private:
-    NATRule rule_;
+    NATTable table_;
 
 public:
     DNAT();
@@ -54,8 +70,7 @@ public:
 class DNATWithPostrouting
 {
 private:
-    NATRule rule_;
-    NATRule post_;
+    NATTable table_;
 
 public:
     DNATWithPostrouting();
@@ -1,11 +1,17 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <sys/socket.h>
+#include <net/if.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <unistd.h>
 #include <functional>
 
 #include "netdevice.hh"
@@ -13,8 +19,7 @@
 #include "ezio.hh"
 #include "socket.hh"
 #include "util.hh"
-#include "system_runner.hh"
-#include "config.h"
+#include "netlink.hh"
 
 using namespace std;
 
@@ -29,6 +34,51 @@ TunDevice::TunDevice( const string & name,
     assign_address( name, addr, peer );
 }
 
+vector<string> TunDevice::read_packets( const size_t max_packets )
+{
+    /* room for the largest packet a TUN device can have */
+    static const size_t TUN_BUFFER_SIZE = sizeof( tun_pi ) + 65536;
+    char buffer[ TUN_BUFFER_SIZE ];
+
+    vector<string> packets;
+
+    while ( packets.size() < max_packets ) {
+        const ssize_t bytes_read = ::read( fd_num(), buffer, sizeof( buffer ) );
+        if ( bytes_read < 0 and errno == EAGAIN ) {
+            break;
+        }
+
+        SystemCall( "read " + to_string( fd_num() ), bytes_read );
+
+        if ( size_t( bytes_read ) > sizeof( tun_pi ) ) {
+            packets.emplace_back( buffer + sizeof( tun_pi ), bytes_read - sizeof( tun_pi ) );
+        }
+    }
+
+    register_read();
+
+    return packets;
+}
+
+void TunDevice::write_packet( const string & packet )
+{
+    if ( packet.empty() ) {
+        throw runtime_error( "TunDevice: empty packet" );
+    }
+
+    /* the kernel wants to know which protocol the packet is */
+    tun_pi header;
+    zero( header );
+    header.proto = htons( ( uint8_t( packet.front() ) >> 4 ) == 6 ? ETH_P_IPV6 : ETH_P_IP );
+
+    const iovec buffers[] = { { &header, sizeof( header ) },
+                              { const_cast<char *>( packet.data() ), packet.size() } };
+
+    SystemCall( "writev", ::writev( fd_num(), buffers, 2 ) );
+
+    register_write();
+}
+
 void interface_ioctl( FileDescriptor & fd, const unsigned long request,
                       const string & name,
                       function<void( ifreq &ifr )> ifr_adjustment)
@@ -80,6 +130,115 @@ void name_check( const string & str )
     }
 }
 
+/* rtnetlink request addressed to a device by name */
+static NetlinkMessage link_request( const uint16_t type, const uint16_t flags, const string & name )
+{
+    NetlinkMessage request( type, NLM_F_REQUEST | NLM_F_ACK | flags );
+
+    ifinfomsg ifi;
+    zero( ifi );
+    ifi.ifi_family = AF_UNSPEC;
+    request.add_header( ifi );
+
+    request.add_string( IFLA_IFNAME, name );
+
+    return request;
+}
+
+/* send the requests and wait until the kernel has carried them out */
+static void rtnetlink( vector<NetlinkMessage> && requests )
+{
+    NetlinkSocket rtnl( NETLINK_ROUTE );
+    rtnl.transact( requests );
+}
+
+/* creates a link of the given kind (e.g. "dummy"), already up */
+static NetlinkMessage new_link_request( const string & name, const string & kind )
+{
+    NetlinkMessage request( RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL );
+
+    ifinfomsg ifi;
+    zero( ifi );
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_flags = IFF_UP;
+    ifi.ifi_change = IFF_UP;
+    request.add_header( ifi );
+
+    request.add_string( IFLA_IFNAME, name );
+
+    request.begin_nested( IFLA_LINKINFO );
+    request.add_string( IFLA_INFO_KIND, kind );
+    request.end_nested();
+
+    return request;
+}
+
+void add_dummy_interfaces( const vector<pair<string, Address>> & interfaces )
+{
+    if ( interfaces.empty() ) {
+        return;
+    }
+
+    vector<NetlinkMessage> requests;
+    for ( const auto & interface : interfaces ) {
+        requests.push_back( new_link_request( interface.first, "dummy" ) );
+    }
+    rtnetlink( move( requests ) );
+
+    /* (SIOCSIFADDR gives each device the address's classful subnet, as
+       the shells have always had) */
+    UDPSocket temp;
+    for ( const auto & interface : interfaces ) {
+        interface_ioctl( temp, SIOCSIFADDR, interface.first,
+                         [&] ( ifreq &ifr ) { ifr.ifr_addr = interface.second.to_sockaddr(); } );
+    }
+}
+
+void add_loopback_addresses( const vector<Address> & addrs )
+{
+    const unsigned int loopback_index = if_nametoindex( "lo" );
+    if ( loopback_index == 0 ) {
+        throw unix_error( "if_nametoindex lo" );
+    }
+
+    vector<NetlinkMessage> requests;
+
+    for ( const auto & addr : addrs ) {
+        if ( addr.to_sockaddr().sa_family != AF_INET ) {
+            throw runtime_error( "add_loopback_addresses: " + addr.ip() + " is not an IPv4 address" );
+        }
+
+        const in_addr & ip = reinterpret_cast<const sockaddr_in &>( addr.to_sockaddr() ).sin_addr;
+        const string ip_bytes( reinterpret_cast<const char *>( &ip ), sizeof( ip ) );
+
+        NetlinkMessage request( RTM_NEWADDR, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE );
+
+        ifaddrmsg ifa;
+        zero( ifa );
+        ifa.ifa_family = AF_INET;
+        ifa.ifa_prefixlen = 32;
+        ifa.ifa_index = loopback_index;
+        request.add_header( ifa );
+
+        request.add_attribute( IFA_LOCAL, ip_bytes );
+        request.add_attribute( IFA_ADDRESS, ip_bytes );
+
+        requests.push_back( move( request ) );
+    }
+
+    if ( not requests.empty() ) {
+        rtnetlink( move( requests ) );
+    }
+}
+
+void move_to_namespace( const string & device_name, const pid_t pid )
+{
+    NetlinkMessage request = link_request( RTM_NEWLINK, 0, device_name );
+    request.add_attribute( IFLA_NET_NS_PID, static_cast<uint32_t>( pid ) );
+
+    rtnetlink( { move( request ) } );
+}
+
 VirtualEthernetPair::VirtualEthernetPair( const string & outside_name, const string & inside_name )
     : name_( outside_name ),
       kernel_will_destroy_( false )
@@ -88,7 +247,24 @@ VirtualEthernetPair::VirtualEthernetPair( const string & outside_name, const str
     name_check( outside_name );
     name_check( inside_name );
 
-    run( { IP, "link", "add", outside_name, "type", "veth", "peer", "name", inside_name } );
+    NetlinkMessage request = link_request( RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, outside_name );
+
+    request.begin_nested( IFLA_LINKINFO );
+    request.add_string( IFLA_INFO_KIND, "veth" );
+    request.begin_nested( IFLA_INFO_DATA );
+    request.begin_nested( VETH_INFO_PEER );
+
+    ifinfomsg peer;
+    zero( peer );
+    peer.ifi_family = AF_UNSPEC;
+    request.add_header( peer );
+    request.add_string( IFLA_IFNAME, inside_name );
+
+    request.end_nested();
+    request.end_nested();
+    request.end_nested();
+
+    rtnetlink( { move( request ) } );
 }
 
 VirtualEthernetPair::~VirtualEthernetPair()
@@ -98,7 +274,7 @@ VirtualEthernetPair::~VirtualEthernetPair()
     }
 
     try {
-        run( { IP, "link", "del", name_ } );
+        rtnetlink( { link_request( RTM_DELLINK, 0, name_ ) } );
     } catch ( const std::exception & e ) {
         print_exception( e );
     }
@@ -4,8 +4,11 @@
 #define NETDEVICE_HH
 
 #include <string>
+#include <vector>
+#include <utility>
 #include <functional>
 #include <netinet/in.h>
+#include <sys/types.h>
 #include <sys/ioctl.h>
 #include <linux/if.h>
 
@@ -23,10 +26,25 @@ void interface_ioctl( const unsigned long request,
 
 void assign_address( const std::string & device_name, const Address & addr, const Address & peer );
 
+/* create dummy devices (name, address), each answering for its address;
+   the devices are created by one rtnetlink transaction */
+void add_dummy_interfaces( const std::vector<std::pair<std::string, Address>> & interfaces );
+
+/* make the loopback device answer for each of addrs as well */
+void add_loopback_addresses( const std::vector<Address> & addrs );
+
+/* hand a device over to the network namespace of process pid */
+void move_to_namespace( const std::string & device_name, const pid_t pid );
+
 class TunDevice : public FileDescriptor
 {
 public:
     TunDevice( const std::string & name, const Address & addr, const Address & peer );
+
+    /* IP packets, without the tun header: up to max_packets of those
+       waiting to be read (the device must be non-blocking) */
+    std::vector<std::string> read_packets( const size_t max_packets );
+    void write_packet( const std::string & packet );
 };
 
 class VirtualEthernetPair
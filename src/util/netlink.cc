@@ -0,0 +1,144 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <set>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netlink.hh"
+#include "exception.hh"
+#include "util.hh"
+
+using namespace std;
+
+NetlinkMessage::NetlinkMessage( const uint16_t type, const uint16_t flags )
+    : buffer_( NLMSG_HDRLEN, 0 ),
+      nests_()
+{
+    header().nlmsg_len = buffer_.size();
+    header().nlmsg_type = type;
+    header().nlmsg_flags = flags;
+}
+
+nlmsghdr & NetlinkMessage::header( void )
+{
+    return *reinterpret_cast<nlmsghdr *>( &buffer_.front() );
+}
+
+void NetlinkMessage::align( void )
+{
+    buffer_.resize( NLMSG_ALIGN( buffer_.size() ), 0 );
+    header().nlmsg_len = buffer_.size();
+}
+
+void NetlinkMessage::add_attribute( const uint16_t type, const string & payload )
+{
+    nlattr attribute;
+    attribute.nla_type = type;
+    attribute.nla_len = NLA_HDRLEN + payload.size();
+
+    buffer_.append( reinterpret_cast<const char *>( &attribute ), sizeof( attribute ) );
+    align();
+    buffer_.append( payload );
+    align();
+}
+
+void NetlinkMessage::add_attribute( const uint16_t type, const uint32_t payload )
+{
+    add_attribute( type, string( reinterpret_cast<const char *>( &payload ), sizeof( payload ) ) );
+}
+
+void NetlinkMessage::add_string( const uint16_t type, const string & str )
+{
+    add_attribute( type, str + '\0' );
+}
+
+void NetlinkMessage::begin_nested( const uint16_t type )
+{
+    nests_.push_back( buffer_.size() );
+    add_attribute( type, string() );
+}
+
+void NetlinkMessage::end_nested( void )
+{
+    if ( nests_.empty() ) {
+        throw runtime_error( "NetlinkMessage: end_nested() without begin_nested()" );
+    }
+
+    nlattr * attribute = reinterpret_cast<nlattr *>( &buffer_.at( nests_.back() ) );
+    attribute->nla_len = buffer_.size() - nests_.back();
+    nests_.pop_back();
+}
+
+uint16_t NetlinkMessage::flags( void ) const
+{
+    return reinterpret_cast<const nlmsghdr *>( buffer_.data() )->nlmsg_flags;
+}
+
+void NetlinkMessage::set_sequence_number( const uint32_t seq )
+{
+    header().nlmsg_seq = seq;
+}
+
+const string & NetlinkMessage::str( void ) const
+{
+    if ( not nests_.empty() ) {
+        throw runtime_error( "NetlinkMessage: unterminated nested attribute" );
+    }
+
+    return buffer_;
+}
+
+NetlinkSocket::NetlinkSocket( const int protocol )
+    : FileDescriptor( SystemCall( "socket", socket( AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol ) ) ),
+      next_sequence_number_( 1 )
+{}
+
+void NetlinkSocket::transact( vector<NetlinkMessage> & messages )
+{
+    set<uint32_t> awaiting_ack;
+    string batch;
+
+    for ( auto & message : messages ) {
+        const uint32_t seq = next_sequence_number_++;
+        message.set_sequence_number( seq );
+        if ( message.flags() & NLM_F_ACK ) {
+            awaiting_ack.insert( seq );
+        }
+        batch.append( message.str() );
+    }
+
+    sockaddr_nl kernel;
+    zero( kernel );
+    kernel.nl_family = AF_NETLINK;
+
+    const ssize_t bytes_sent = SystemCall( "sendto netlink",
+                                           sendto( fd_num(), batch.data(), batch.size(), 0,
+                                                   reinterpret_cast<const sockaddr *>( &kernel ),
+                                                   sizeof( kernel ) ) );
+    register_write();
+
+    if ( static_cast<size_t>( bytes_sent ) != batch.size() ) {
+        throw runtime_error( "netlink: short write" );
+    }
+
+    while ( not awaiting_ack.empty() ) {
+        const string reply = read();
+
+        int remaining = reply.size();
+        for ( const nlmsghdr * nlh = reinterpret_cast<const nlmsghdr *>( reply.data() );
+              NLMSG_OK( nlh, remaining );
+              nlh = NLMSG_NEXT( nlh, remaining ) ) {
+            if ( nlh->nlmsg_type != NLMSG_ERROR ) {
+                continue;
+            }
+
+            const nlmsgerr * err = static_cast<const nlmsgerr *>( NLMSG_DATA( nlh ) );
+            if ( err->error ) {
+                throw unix_error( "netlink request " + to_string( err->msg.nlmsg_type ), -err->error );
+            }
+
+            awaiting_ack.erase( nlh->nlmsg_seq );
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef NETLINK_HH
+#define NETLINK_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <linux/netlink.h>
+
+#include "file_descriptor.hh"
+
+/* a netlink message under construction: header, family-specific
+   header, then (possibly nested) attributes */
+class NetlinkMessage
+{
+private:
+    std::string buffer_;
+    std::vector<size_t> nests_;
+
+    /* pad to the next boundary and update the length in the header */
+    void align( void );
+    nlmsghdr & header( void );
+
+public:
+    NetlinkMessage( const uint16_t type, const uint16_t flags );
+
+    /* family-specific header (ifinfomsg, nfgenmsg, ...) */
+    template <class FamilyHeader>
+    void add_header( const FamilyHeader & family_header )
+    {
+        buffer_.append( reinterpret_cast<const char *>( &family_header ), sizeof( family_header ) );
+        align();
+    }
+
+    void add_attribute( const uint16_t type, const std::string & payload );
+
+    /* integers are in host byte order; use htonl() for nftables */
+    void add_attribute( const uint16_t type, const uint32_t payload );
+
+    /* NUL-terminated string */
+    void add_string( const uint16_t type, const std::string & str );
+
+    void begin_nested( const uint16_t type );
+    void end_nested( void );
+
+    uint16_t flags( void ) const;
+    void set_sequence_number( const uint32_t seq );
+
+    const std::string & str( void ) const;
+};
+
+/* sends a batch of messages in one write and waits until each
+   message that asked for one (NLM_F_ACK) has been acknowledged */
+class NetlinkSocket : public FileDescriptor
+{
+private:
+    uint32_t next_sequence_number_;
+
+public:
+    NetlinkSocket( const int protocol );
+
+    void transact( std::vector<NetlinkMessage> & messages );
+};
+
+#endif /* NETLINK_HH */
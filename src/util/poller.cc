@@ -10,8 +10,42 @@ using namespace PollerShortNames;
 
 void Poller::add_action( Poller::Action action )
 {
-    actions_.push_back( action );
-    pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+    /* don't grow actions_ underneath a running callback */
+    new_actions_.push_back( action );
+}
+
+/* forget cancelled actions, so their file descriptors may be closed */
+void Poller::remove_cancelled_actions( void )
+{
+    vector< Action > remaining_actions;
+    vector< pollfd > remaining_pollfds;
+
+    for ( unsigned int i = 0; i < actions_.size(); i++ ) {
+        if ( actions_.at( i ).active ) {
+            remaining_actions.push_back( actions_.at( i ) );
+            remaining_pollfds.push_back( pollfds_.at( i ) );
+        }
+    }
+
+    actions_.swap( remaining_actions );
+    pollfds_.swap( remaining_pollfds );
+}
+
+void Poller::remove_actions( const FileDescriptor & fd )
+{
+    for ( auto & action : actions_ ) {
+        if ( &action.fd == &fd ) {
+            action.active = false;
+        }
+    }
+
+    vector< Action > remaining_new_actions;
+    for ( const auto & action : new_actions_ ) {
+        if ( &action.fd != &fd ) {
+            remaining_new_actions.push_back( action );
+        }
+    }
+    new_actions_.swap( remaining_new_actions );
 }
 
 unsigned int Poller::Action::service_count( void ) const
@@ -21,6 +55,15 @@ unsigned int Poller::Action::service_count( void ) const
 
 Poller::Result Poller::poll( const int & timeout_ms )
 {
+    /* actions removed since the last poll may refer to closed fds */
+    remove_cancelled_actions();
+
+    for ( const auto & action : new_actions_ ) {
+        actions_.push_back( action );
+        pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+    }
+    new_actions_.clear();
+
     assert( pollfds_.size() == actions_.size() );
 
     /* tell poll whether we care about each fd */
@@ -47,7 +90,17 @@ Poller::Result Poller::poll( const int & timeout_ms )
     }
 
     for ( unsigned int i = 0; i < pollfds_.size(); i++ ) {
+        /* cancelled by an earlier callback in this round */
+        if ( not actions_.at( i ).active ) {
+            continue;
+        }
+
         if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
+            if ( actions_.at( i ).fderror_callback ) {
+                actions_.at( i ).active = false;
+                actions_.at( i ).fderror_callback();
+                continue;
+            }
             //            throw Exception( "poll fd error" );
             return Result::Type::Exit;
         }
@@ -68,11 +121,14 @@ Poller::Result Poller::poll( const int & timeout_ms )
                 break;
             }
 
-            if ( count_before == actions_.at( i ).service_count() ) {
+            /* (an action that was removed by its callback may not have got that far) */
+            if ( actions_.at( i ).active and count_before == actions_.at( i ).service_count() ) {
                 throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
             }
         }
     }
 
+    remove_cancelled_actions();
+
     return Result::Type::Success;
 }
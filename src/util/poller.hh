@@ -32,12 +32,18 @@ public:
         std::function<bool(void)> when_interested;
         bool active;
 
+        /* called on POLLERR/POLLHUP/POLLNVAL instead of exiting the poller
+           (the action is then cancelled) */
+        std::function<void(void)> fderror_callback;
+
         Action( FileDescriptor & s_fd,
                 const PollDirection & s_direction,
                 const CallbackType & s_callback,
-                const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+                const std::function<bool(void)> & s_when_interested = [] () { return true; },
+                const std::function<void(void)> & s_fderror_callback = nullptr )
             : fd( s_fd ), direction( s_direction ), callback( s_callback ),
-              when_interested( s_when_interested ), active( true ) {}
+              when_interested( s_when_interested ), active( true ),
+              fderror_callback( s_fderror_callback ) {}
 
         unsigned int service_count( void ) const;
     };
@@ -46,6 +52,11 @@ private:
     std::vector< Action > actions_;
     std::vector< pollfd > pollfds_;
 
+    /* actions added since the last poll (possibly from inside a callback) */
+    std::vector< Action > new_actions_;
+
+    void remove_cancelled_actions( void );
+
 public:
     struct Result
     {
@@ -55,8 +66,12 @@ public:
             : result( s_result ), exit_status( s_status ) {}
     };
 
-    Poller() : actions_(), pollfds_() {}
+    Poller() : actions_(), pollfds_(), new_actions_() {}
     void add_action( Action action );
+
+    /* cancel every action on fd, so that it may be closed */
+    void remove_actions( const FileDescriptor & fd );
+
     Result poll( const int & timeout_ms );
 };
 
@@ -0,0 +1,141 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "schedule.hh"
+#include "file_descriptor.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+Schedule::Schedule( const string & filename, const double min_value, const double max_value )
+    : filename_( filename ),
+      min_value_( min_value ),
+      max_value_( max_value ),
+      data_( nullptr ),
+      size_( 0 ),
+      cursor_( nullptr ),
+      line_number_( 0 ),
+      start_( timestamp() ),
+      value_( 0 ),
+      have_next_( false ),
+      next_ms_( 0 ),
+      next_value_( 0 )
+{
+    FileDescriptor fd( SystemCall( "open " + filename_, open( filename_.c_str(), O_RDONLY | O_CLOEXEC ) ) );
+
+    struct stat file_info;
+    SystemCall( "fstat", fstat( fd.fd_num(), &file_info ) );
+    size_ = file_info.st_size;
+
+    if ( size_ == 0 ) {
+        throw runtime_error( filename_ + ": no schedule entries found" );
+    }
+
+    /* the mapping outlives the file descriptor */
+    void * mapping = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd.fd_num(), 0 );
+    if ( mapping == MAP_FAILED ) {
+        throw unix_error( "mmap " + filename_ );
+    }
+    data_ = static_cast<const char *>( mapping );
+    cursor_ = data_;
+
+    /* it is read from start to end, once */
+    madvise( mapping, size_, MADV_SEQUENTIAL );
+
+    read_next();
+    if ( next_ms_ != 0 ) {
+        throw runtime_error( filename_ + ": schedule must begin at time 0" );
+    }
+    value_ = next_value_;
+    read_next();
+}
+
+Schedule::~Schedule()
+{
+    if ( data_ and munmap( const_cast<char *>( data_ ), size_ ) < 0 ) {
+        print_exception( unix_error( "munmap " + filename_ ) );
+    }
+}
+
+Schedule::Schedule( Schedule && other )
+    : filename_( move( other.filename_ ) ),
+      min_value_( other.min_value_ ),
+      max_value_( other.max_value_ ),
+      data_( other.data_ ),
+      size_( other.size_ ),
+      cursor_( other.cursor_ ),
+      line_number_( other.line_number_ ),
+      start_( other.start_ ),
+      value_( other.value_ ),
+      have_next_( other.have_next_ ),
+      next_ms_( other.next_ms_ ),
+      next_value_( other.next_value_ )
+{
+    other.data_ = nullptr;
+}
+
+void Schedule::read_next( void )
+{
+    const char * const end = data_ + size_;
+
+    if ( cursor_ == end ) {
+        have_next_ = false;
+        return;
+    }
+
+    const char * newline = static_cast<const char *>( memchr( cursor_, '\n', end - cursor_ ) );
+    const string line( cursor_, newline ? newline : end );
+    cursor_ = newline ? newline + 1 : end;
+    line_number_++;
+
+    const string where = filename_ + ":" + to_string( line_number_ ) + ": ";
+
+    const size_t space = line.find( ' ' );
+    if ( space == string::npos ) {
+        throw runtime_error( where + "expected \"MS VALUE\", got \"" + line + "\"" );
+    }
+
+    const uint64_t last_ms = next_ms_;
+
+    try {
+        const long int ms = myatoi( line.substr( 0, space ) );
+        if ( ms < 0 ) {
+            throw runtime_error( "negative time" );
+        }
+        next_ms_ = ms;
+        next_value_ = myatof( line.substr( space + 1 ) );
+    } catch ( const exception & e ) {
+        throw runtime_error( where + e.what() );
+    }
+
+    if ( have_next_ and next_ms_ < last_ms ) {
+        throw runtime_error( where + "times must be monotonically nondecreasing" );
+    }
+
+    if ( next_value_ < min_value_ or next_value_ > max_value_ ) {
+        throw runtime_error( where + "value must be between " + to_string( min_value_ )
+                             + " and " + to_string( max_value_ ) );
+    }
+
+    have_next_ = true;
+}
+
+double Schedule::value_at( const uint64_t now )
+{
+    const uint64_t ms = now > start_ ? now - start_ : 0;
+
+    /* catch up with the clock */
+    while ( have_next_ and next_ms_ <= ms ) {
+        value_ = next_value_;
+        read_next();
+    }
+
+    return value_;
+}
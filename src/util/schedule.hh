@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef SCHEDULE_HH
+#define SCHEDULE_HH
+
+#include <string>
+#include <cstdint>
+
+/* a quantity that varies over time (a delay, a loss rate, whether a link
+   is up), read from a file with one "MS VALUE" line per change, where MS
+   counts milliseconds from when the schedule starts (the first line must
+   be at 0, and the times never decrease). Each value holds until the
+   next line's time, and the last value holds for ever.
+
+   The file is memory-mapped and its lines are parsed only as the clock
+   reaches them, so an hours-long recording costs nothing to load, and
+   looking up the current value is O(1) as long as lookups come in time
+   order (as they do for packets). */
+class Schedule
+{
+private:
+    std::string filename_;
+    double min_value_, max_value_;
+
+    const char * data_;
+    size_t size_;
+
+    const char * cursor_; /* start of the first unparsed line */
+    unsigned int line_number_;
+
+    uint64_t start_; /* timestamp when the schedule started */
+    double value_;
+
+    bool have_next_;
+    uint64_t next_ms_; /* relative to start_ */
+    double next_value_;
+
+    /* parse the line at the cursor into next_ms_ and next_value_ */
+    void read_next( void );
+
+public:
+    Schedule( const std::string & filename, const double min_value, const double max_value );
+    ~Schedule();
+
+    /* value at a timestamp, which must not be earlier than the last one */
+    double value_at( const uint64_t now );
+
+    const std::string & filename( void ) const { return filename_; }
+
+    /* allow moving, but forbid copying */
+    Schedule( Schedule && other );
+    Schedule( const Schedule & other ) = delete;
+    Schedule & operator=( const Schedule & other ) = delete;
+};
+
+#endif /* SCHEDULE_HH */
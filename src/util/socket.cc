@@ -1,5 +1,9 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <linux/netfilter_ipv4.h>
@@ -7,6 +11,7 @@
 #include "socket.hh"
 #include "timestamp.hh"
 #include "exception.hh"
+#include "util.hh"
 
 using namespace std;
 
@@ -68,11 +73,14 @@ void Socket::bind( const Address & address )
 }
 
 /* connect socket to a specified peer address */
+/* (a non-blocking socket finishes connecting in the background,
+   and becomes writable when it has) */
 void Socket::connect( const Address & address )
 {
-    SystemCall( "connect", ::connect( fd_num(),
-                                      &address.to_sockaddr(),
-                                      address.size() ) );
+    if ( ::connect( fd_num(), &address.to_sockaddr(), address.size() ) < 0
+         and errno != EINPROGRESS ) {
+        throw unix_error( "connect" );
+    }
 }
 
 /* send datagram to specified address */
@@ -180,6 +188,168 @@ pair<Address, string> UDPSocket::recvfrom( void )
                       string( buffer, recv_len ) );
 }
 
+vector<pair<Address, string>> UDPSocket::recvmmsg( const unsigned int max_datagrams,
+                                                   const size_t max_size )
+{
+    /* one buffer, source address and header per datagram */
+    unique_ptr<char[]> buffer( new char[ max_datagrams * max_size ] );
+    vector<Address::raw> sources( max_datagrams );
+    vector<iovec> payload_iovecs( max_datagrams );
+    vector<mmsghdr> headers( max_datagrams );
+
+    for ( unsigned int i = 0; i < max_datagrams; i++ ) {
+        payload_iovecs.at( i ) = { buffer.get() + i * max_size, max_size };
+
+        msghdr & header = headers.at( i ).msg_hdr;
+        header.msg_name = &sources.at( i );
+        header.msg_namelen = sizeof( Address::raw );
+        header.msg_iov = &payload_iovecs.at( i );
+        header.msg_iovlen = 1;
+    }
+
+    const int count = SystemCall( "recvmmsg", ::recvmmsg( fd_num(), headers.data(), max_datagrams,
+                                                          MSG_WAITFORONE, nullptr ) );
+
+    register_read();
+
+    vector<pair<Address, string>> datagrams;
+    datagrams.reserve( count );
+
+    for ( int i = 0; i < count; i++ ) {
+        const msghdr & header = headers.at( i ).msg_hdr;
+
+        if ( header.msg_flags & MSG_TRUNC ) {
+            throw runtime_error( "recvmmsg (oversized datagram)" );
+        }
+
+        datagrams.emplace_back( Address( sources.at( i ), header.msg_namelen ),
+                                string( buffer.get() + i * max_size, headers.at( i ).msg_len ) );
+    }
+
+    return datagrams;
+}
+
+void UDPSocket::sendmmsg( const Address & destination, const vector<string> & payloads )
+{
+    vector<iovec> payload_iovecs( payloads.size() );
+    vector<mmsghdr> headers( payloads.size() );
+
+    for ( unsigned int i = 0; i < payloads.size(); i++ ) {
+        payload_iovecs.at( i ) = { const_cast<char *>( payloads.at( i ).data() ), payloads.at( i ).size() };
+
+        msghdr & header = headers.at( i ).msg_hdr;
+        header.msg_name = const_cast<sockaddr *>( &destination.to_sockaddr() );
+        header.msg_namelen = destination.size();
+        header.msg_iov = &payload_iovecs.at( i );
+        header.msg_iovlen = 1;
+    }
+
+    /* the kernel may send fewer than asked */
+    for ( size_t sent = 0; sent < payloads.size(); ) {
+        const int count = SystemCall( "sendmmsg", ::sendmmsg( fd_num(), headers.data() + sent,
+                                                              payloads.size() - sent, 0 ) );
+
+        register_write();
+
+        for ( int i = 0; i < count; i++ ) {
+            if ( headers.at( sent + i ).msg_len != payloads.at( sent + i ).size() ) {
+                throw runtime_error( "datagram payload too big for sendmmsg()" );
+            }
+        }
+
+        sent += count;
+    }
+}
+
+void UDPSocket::set_pktinfo( void )
+{
+    setsockopt( IPPROTO_IP, IP_PKTINFO, int( true ) );
+}
+
+UDPSocket::ReceivedDatagram UDPSocket::recv_with_destination( void )
+{
+    static const ssize_t RECEIVE_MTU = 65536;
+
+    /* receive source address, payload, and the address it was sent to */
+    Address::raw datagram_source_address;
+    char buffer[ RECEIVE_MTU ];
+    char control_buffer[ CMSG_SPACE( sizeof( in_pktinfo ) ) ];
+
+    iovec payload_iovec = { buffer, sizeof( buffer ) };
+
+    msghdr header;
+    zero( header );
+    header.msg_name = &datagram_source_address;
+    header.msg_namelen = sizeof( datagram_source_address );
+    header.msg_iov = &payload_iovec;
+    header.msg_iovlen = 1;
+    header.msg_control = control_buffer;
+    header.msg_controllen = sizeof( control_buffer );
+
+    const ssize_t recv_len = SystemCall( "recvmsg", recvmsg( fd_num(), &header, MSG_TRUNC ) );
+
+    if ( recv_len > RECEIVE_MTU ) {
+        throw runtime_error( "recvmsg (oversized datagram)" );
+    }
+
+    register_read();
+
+    sockaddr_in destination;
+    zero( destination );
+    destination.sin_family = AF_INET;
+
+    for ( cmsghdr * control = CMSG_FIRSTHDR( &header ); control; control = CMSG_NXTHDR( &header, control ) ) {
+        if ( control->cmsg_level == IPPROTO_IP and control->cmsg_type == IP_PKTINFO ) {
+            in_pktinfo info;
+            memcpy( &info, CMSG_DATA( control ), sizeof( info ) );
+            destination.sin_addr = info.ipi_addr;
+        }
+    }
+
+    return { Address( datagram_source_address, header.msg_namelen ),
+             Address( destination ),
+             string( buffer, recv_len ) };
+}
+
+void UDPSocket::sendto_from( const Address & source, const Address & destination, const string & payload )
+{
+    if ( source.to_sockaddr().sa_family != AF_INET ) {
+        throw runtime_error( "sendto_from: source must be an IPv4 address" );
+    }
+
+    char control_buffer[ CMSG_SPACE( sizeof( in_pktinfo ) ) ];
+    zero( control_buffer );
+
+    iovec payload_iovec = { const_cast<char *>( payload.data() ), payload.size() };
+
+    msghdr header;
+    zero( header );
+    header.msg_name = const_cast<sockaddr *>( &destination.to_sockaddr() );
+    header.msg_namelen = destination.size();
+    header.msg_iov = &payload_iovec;
+    header.msg_iovlen = 1;
+    header.msg_control = control_buffer;
+    header.msg_controllen = sizeof( control_buffer );
+
+    in_pktinfo info;
+    zero( info );
+    info.ipi_spec_dst = reinterpret_cast<const sockaddr_in &>( source.to_sockaddr() ).sin_addr;
+
+    cmsghdr * const control = CMSG_FIRSTHDR( &header );
+    control->cmsg_level = IPPROTO_IP;
+    control->cmsg_type = IP_PKTINFO;
+    control->cmsg_len = CMSG_LEN( sizeof( info ) );
+    memcpy( CMSG_DATA( control ), &info, sizeof( info ) );
+
+    const ssize_t bytes_sent = SystemCall( "sendmsg", sendmsg( fd_num(), &header, 0 ) );
+
+    register_write();
+
+    if ( size_t( bytes_sent ) != payload.size() ) {
+        throw runtime_error( "datagram payload too big for sendmsg()" );
+    }
+}
+
 Address TCPSocket::original_dest( void ) const
 {
     Address::raw dstaddr;
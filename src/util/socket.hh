@@ -3,6 +3,7 @@
 #ifndef SOCKET_HH
 #define SOCKET_HH
 
+#include <vector>
 #include <functional>
 
 #include "address.hh"
@@ -60,8 +61,32 @@ public:
     /* send datagram to connected address */
     void send( const std::string & payload );
 
+    /* receive up to max_datagrams (of up to max_size bytes) in one call,
+       waiting only for the first */
+    std::vector<std::pair<Address, std::string>> recvmmsg( const unsigned int max_datagrams,
+                                                           const size_t max_size );
+
+    /* send each payload as a datagram to destination, in as few calls as possible */
+    void sendmmsg( const Address & destination, const std::vector<std::string> & payloads );
+
     /* turn on timestamps on receipt */
     void set_timestamps( void );
+
+    /* for a socket bound to the wildcard address: find out which of
+       our addresses each datagram was sent to, so a reply can come from it */
+    void set_pktinfo( void );
+
+    struct ReceivedDatagram
+    {
+        Address source;
+        Address destination; /* (IP only; requires set_pktinfo) */
+        std::string payload;
+    };
+
+    ReceivedDatagram recv_with_destination( void );
+
+    /* send datagram from a particular one of our addresses (IP only) */
+    void sendto_from( const Address & source, const Address & destination, const std::string & payload );
 };
 
 /* TCP socket */
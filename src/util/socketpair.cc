@@ -17,6 +17,51 @@ pair<UnixDomainSocket, UnixDomainSocket> UnixDomainSocket::make_pair( void )
     return ::make_pair( UnixDomainSocket( pipe[ 0 ] ), UnixDomainSocket( pipe[ 1 ] ) );
 }
 
+static sockaddr_un unix_address( const string & path )
+{
+    sockaddr_un address;
+    zero( address );
+    address.sun_family = AF_UNIX;
+
+    if ( path.empty() or path.size() >= sizeof( address.sun_path ) ) {
+        throw runtime_error( "invalid Unix-domain socket path: " + path );
+    }
+
+    path.copy( address.sun_path, path.size() );
+    return address;
+}
+
+UnixDomainSocket UnixDomainSocket::listen_at( const string & path )
+{
+    UnixDomainSocket sock( SystemCall( "socket", socket( AF_UNIX, SOCK_SEQPACKET, 0 ) ) );
+
+    const sockaddr_un address = unix_address( path );
+    SystemCall( "bind " + path, bind( sock.fd_num(),
+                                      reinterpret_cast<const sockaddr *>( &address ),
+                                      sizeof( address ) ) );
+    SystemCall( "listen", listen( sock.fd_num(), 16 ) );
+
+    return sock;
+}
+
+UnixDomainSocket UnixDomainSocket::connect_to( const string & path )
+{
+    UnixDomainSocket sock( SystemCall( "socket", socket( AF_UNIX, SOCK_SEQPACKET, 0 ) ) );
+
+    const sockaddr_un address = unix_address( path );
+    SystemCall( "connect " + path, connect( sock.fd_num(),
+                                            reinterpret_cast<const sockaddr *>( &address ),
+                                            sizeof( address ) ) );
+
+    return sock;
+}
+
+UnixDomainSocket UnixDomainSocket::accept( void )
+{
+    register_read();
+    return UnixDomainSocket( SystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) );
+}
+
 void UnixDomainSocket::send_fd( FileDescriptor & fd )
 {
     msghdr message_header;
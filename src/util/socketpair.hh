@@ -4,6 +4,7 @@
 #define SOCKETPAIR_HH
 
 #include <utility>
+#include <string>
 
 #include "file_descriptor.hh"
 
@@ -17,6 +18,11 @@ public:
     FileDescriptor recv_fd( void );
 
     static std::pair<UnixDomainSocket, UnixDomainSocket> make_pair( void );
+
+    /* connection-oriented (SOCK_SEQPACKET) sockets bound to a filesystem path */
+    static UnixDomainSocket listen_at( const std::string & path );
+    static UnixDomainSocket connect_to( const std::string & path );
+    UnixDomainSocket accept( void );
 };
 
 #endif /* SOCKETPAIR_HH */
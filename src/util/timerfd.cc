@@ -0,0 +1,54 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+
+#include <sys/timerfd.h>
+
+#include "timerfd.hh"
+#include "exception.hh"
+#include "util.hh"
+
+using namespace std;
+
+TimerFD::TimerFD()
+    : fd_( SystemCall( "timerfd_create", timerfd_create( CLOCK_MONOTONIC, 0 ) ) ),
+      armed_( false )
+{
+}
+
+void TimerFD::arm( const unsigned int interval_ms )
+{
+    itimerspec spec;
+    zero( spec );
+
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = ( interval_ms % 1000 ) * 1000000;
+    spec.it_value = spec.it_interval;
+
+    SystemCall( "timerfd_settime", timerfd_settime( fd_.fd_num(), 0, &spec, nullptr ) );
+    armed_ = true;
+}
+
+void TimerFD::disarm( void )
+{
+    itimerspec spec;
+    zero( spec );
+
+    SystemCall( "timerfd_settime", timerfd_settime( fd_.fd_num(), 0, &spec, nullptr ) );
+    armed_ = false;
+}
+
+uint64_t TimerFD::read_ticks( void )
+{
+    uint64_t ticks;
+
+    string ticks_str = fd_.read( sizeof( ticks ) );
+
+    if ( ticks_str.size() != sizeof( ticks ) ) {
+        throw runtime_error( "timerfd read size mismatch" );
+    }
+
+    memcpy( &ticks, ticks_str.data(), sizeof( ticks ) );
+
+    return ticks;
+}
@@ -0,0 +1,31 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TIMERFD_HH
+#define TIMERFD_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* wrapper class for a periodic timer file descriptor
+   (readable once per tick, so it can be polled like any other fd) */
+
+class TimerFD
+{
+private:
+    FileDescriptor fd_;
+    bool armed_;
+
+public:
+    TimerFD();
+
+    FileDescriptor & fd( void ) { return fd_; }
+    bool armed( void ) const { return armed_; }
+
+    void arm( const unsigned int interval_ms ); /* tick every interval_ms */
+    void disarm( void );
+
+    uint64_t read_ticks( void ); /* number of ticks since last read */
+};
+
+#endif /* TIMERFD_HH */
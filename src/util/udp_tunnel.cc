@@ -0,0 +1,171 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <random>
+#include <cctype>
+
+#include "udp_tunnel.hh"
+#include "event_loop.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+namespace {
+    /* packets moved per system call */
+    const unsigned int BATCH_SIZE = 64;
+
+    /* bigger than any packet from a tun device with the default MTU
+       (after its token) */
+    const size_t MAX_DATAGRAM_SIZE = 2048;
+
+    const unsigned int KEEPALIVE_MS = 10000;
+
+    /* bytes of token at the start of each datagram */
+    const size_t TOKEN_LENGTH = 16;
+
+    const string HEX_DIGITS = "0123456789abcdef";
+
+    unsigned int hex_value( const char digit )
+    {
+        const string::size_type value = HEX_DIGITS.find( tolower( digit ) );
+        if ( value == string::npos ) {
+            throw runtime_error( "UDPTunnel: token must be " + to_string( 2 * TOKEN_LENGTH ) + " hexadecimal digits" );
+        }
+
+        return value;
+    }
+}
+
+Address UDPTunnel::server_address( void )
+{
+    return Address( "10.8.0.1", 0 );
+}
+
+Address UDPTunnel::client_address( void )
+{
+    return Address( "10.8.0.2", 0 );
+}
+
+string UDPTunnel::make_token( void )
+{
+    random_device random_source;
+    uniform_int_distribution<unsigned int> digit( 0, 15 );
+
+    string token;
+    for ( size_t i = 0; i < 2 * TOKEN_LENGTH; i++ ) {
+        token.push_back( HEX_DIGITS[ digit( random_source ) ] );
+    }
+
+    return token;
+}
+
+UDPTunnel::UDPTunnel( const Role role, UDPSocket && socket, const string & tun_name,
+                      const string & token )
+    : role_( role ),
+      socket_( move( socket ) ),
+      tun_( tun_name,
+            role == Role::Server ? server_address() : client_address(),
+            role == Role::Server ? client_address() : server_address() ),
+      token_(),
+      peer_(),
+      peer_known_( role == Role::Client )
+{
+    /* the token goes on the wire as the bytes its digits spell */
+    if ( token.size() != 2 * TOKEN_LENGTH ) {
+        throw runtime_error( "UDPTunnel: token must be " + to_string( 2 * TOKEN_LENGTH ) + " hexadecimal digits" );
+    }
+
+    for ( size_t i = 0; i < token.size(); i += 2 ) {
+        token_.push_back( char( hex_value( token[ i ] ) << 4 | hex_value( token[ i + 1 ] ) ) );
+    }
+
+    if ( role_ == Role::Client ) {
+        peer_ = socket_.peer_address();
+    }
+
+    /* a batch ends when the device has nothing more */
+    tun_.set_blocking( false );
+}
+
+/* (compared in constant time, so that the token can't be guessed a
+   byte at a time) */
+bool UDPTunnel::has_token( const string & datagram ) const
+{
+    if ( datagram.size() < token_.size() ) {
+        return false;
+    }
+
+    unsigned char difference = 0;
+    for ( size_t i = 0; i < token_.size(); i++ ) {
+        difference |= datagram[ i ] ^ token_[ i ];
+    }
+
+    return difference == 0;
+}
+
+void UDPTunnel::receive_datagrams( void )
+{
+    for ( auto & datagram : socket_.recvmmsg( BATCH_SIZE, MAX_DATAGRAM_SIZE ) ) {
+        /* anyone can send to our port, but only the client has the token */
+        if ( not has_token( datagram.second ) ) {
+            continue;
+        }
+
+        /* reply to wherever the client is now */
+        if ( role_ == Role::Server ) {
+            peer_ = datagram.first;
+            peer_known_ = true;
+        }
+
+        /* (a datagram with only the token is a keepalive) */
+        datagram.second.erase( 0, token_.size() );
+        if ( not datagram.second.empty() ) {
+            tun_.write_packet( datagram.second );
+        }
+    }
+}
+
+void UDPTunnel::receive_packets( void )
+{
+    vector<string> packets = tun_.read_packets( BATCH_SIZE );
+
+    /* the server can't send anything until it hears from the client */
+    if ( peer_known_ and not packets.empty() ) {
+        for ( auto & packet : packets ) {
+            packet.insert( 0, token_ );
+        }
+        socket_.sendmmsg( peer_, packets );
+    }
+}
+
+void UDPTunnel::register_handlers( EventLoop & event_loop )
+{
+    /* a bad packet shouldn't take down the event loop */
+    auto print_errors = [] ( const function<void(void)> & handler ) {
+        return [handler] () {
+            try {
+                handler();
+            } catch ( const exception & e ) {
+                print_exception( e );
+            }
+            return ResultType::Continue;
+        };
+    };
+
+    event_loop.add_simple_input_handler( socket_,
+                                         print_errors( [&] () { receive_datagrams(); } ) );
+    event_loop.add_simple_input_handler( tun_,
+                                         print_errors( [&] () { receive_packets(); } ) );
+
+    if ( role_ == Role::Client ) {
+        /* introduce ourselves to the server, then keep the path open */
+        socket_.send( token_ );
+
+        keepalive_timer_.arm( KEEPALIVE_MS );
+        event_loop.add_simple_input_handler( keepalive_timer_.fd(),
+                                             print_errors( [&] () {
+                                                     keepalive_timer_.read_ticks();
+                                                     socket_.send( token_ );
+                                                 } ) );
+    }
+}
@@ -0,0 +1,68 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef UDP_TUNNEL_HH
+#define UDP_TUNNEL_HH
+
+#include <string>
+
+#include "socket.hh"
+#include "netdevice.hh"
+#include "timerfd.hh"
+
+class EventLoop;
+
+/* minimal IP-over-UDP tunnel (in place of OpenVPN) between a phone and
+   a shell: each datagram carries one IP packet after a token shared by
+   the two ends, with no encryption, and packets cross in batches
+   (recvmmsg() and sendmmsg()). Datagrams without the token are dropped.
+   The server end sends to wherever the client's latest datagram with
+   the token came from, so the client may be behind a NAT or move; the
+   client sends a datagram with just the token now and then to keep that
+   path open. */
+class UDPTunnel
+{
+public:
+    enum class Role { Server, Client };
+
+    /* the well-known port for the server */
+    const static uint16_t DEFAULT_PORT = 1194;
+
+    /* the two ends of the tunnel's point-to-point link */
+    static Address server_address( void );
+    static Address client_address( void );
+
+    /* a new random token, in the hexadecimal form a client is given */
+    static std::string make_token( void );
+
+private:
+    Role role_;
+    UDPSocket socket_;
+    TunDevice tun_;
+    std::string token_;
+
+    Address peer_;
+    bool peer_known_;
+
+    TimerFD keepalive_timer_ {};
+
+    bool has_token( const std::string & datagram ) const;
+
+    void receive_datagrams( void );
+    void receive_packets( void );
+
+public:
+    /* the server's socket must be bound, and the client's connected to
+       the server; the tun device is created in the current namespace.
+       Both ends must be given the same token (from make_token()) */
+    UDPTunnel( const Role role, UDPSocket && socket, const std::string & tun_name,
+               const std::string & token );
+
+    /* the tunnel then runs within this event loop */
+    void register_handlers( EventLoop & event_loop );
+
+    /* forbid copying */
+    UDPTunnel( const UDPTunnel & other ) = delete;
+    UDPTunnel & operator=( const UDPTunnel & other ) = delete;
+};
+
+#endif /* UDP_TUNNEL_HH */